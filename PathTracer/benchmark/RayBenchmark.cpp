@@ -0,0 +1,409 @@
+/*
+ * RayBenchmark.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+
+#include "RayBenchmark.hpp"
+#include "Types/BoundingBox.hpp"
+#include "Types/BoundingVolumeHierarchy.hpp"
+#include "Types/TileScheduler.hpp"
+#include "Utility/mathUtility.hpp"
+
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	using clock = std::chrono::steady_clock;
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	void RayBenchmark::addStructure(const std::string& name, const StructureBuilder& builder)
+	{
+		this->builders.emplace_back(name, builder);
+	}
+
+	SceneResult RayBenchmark::run(const std::string& name, const aiScene* scene) const
+	{
+		SceneResult result;
+		result.name = name;
+
+		const SceneDatabase database(scene);
+		const std::vector<KdTriangle> triangles = database.getTriangles();
+		result.triangleCount = triangles.size();
+
+		const std::vector<RaySet> raySets = this->createRaySets(database, triangles);
+		std::unique_ptr<AccelerationStructure> tileStructure;
+		for (const std::pair<std::string, StructureBuilder>& builder : this->builders)
+		{
+			StructureResult structureResult;
+			structureResult.name = builder.first;
+
+			const clock::time_point buildStart = clock::now();
+			std::unique_ptr<AccelerationStructure> structure(builder.second(database, triangles));
+			structureResult.buildSeconds = std::chrono::duration<double>(clock::now() - buildStart).count();
+			structureResult.memoryBytes = structure->getMemoryFootprint();
+
+			for (const RaySet& raySet : raySets)
+			{
+				structureResult.raySets.push_back(this->measure(*structure, raySet));
+			}
+			result.structures.push_back(std::move(structureResult));
+
+			if (!tileStructure)
+			{
+				tileStructure = std::move(structure);
+			}
+		}
+
+		if (tileStructure)
+		{
+			result.tileThreads = std::max(this->tileThreads, 1U);
+			result.tileOrders.push_back(this->measureTileOrder(*tileStructure, raySets, "scanline", TileOrder::SCANLINE));
+			result.tileOrders.push_back(this->measureTileOrder(*tileStructure, raySets, "morton", TileOrder::MORTON));
+			result.tileOrders.push_back(this->measureTileOrder(*tileStructure, raySets, "hilbert", TileOrder::HILBERT));
+			result.tileOrders.push_back(this->measureTileOrder(*tileStructure, raySets, "spiral", TileOrder::SPIRAL));
+		}
+		return result;
+	}
+
+	/*static*/ void RayBenchmark::print(const SceneResult& result)
+	{
+		std::printf("%s: %zu triangles\n", result.name.c_str(), result.triangleCount);
+		std::printf("  %-10s %-10s %10s %10s %10s %12s %12s %10s %10s\n",
+			"structure", "rays", "count", "hits", "Mrays/s", "nodes/ray", "tris/ray", "build s", "MiB");
+		for (const StructureResult& structure : result.structures)
+		{
+			for (const RaySetResult& raySet : structure.raySets)
+			{
+				std::printf("  %-10s %-10s %10zu %10zu %10.3f %12.2f %12.2f %10.3f %10.2f\n",
+					structure.name.c_str(),
+					raySet.name.c_str(),
+					raySet.rayCount,
+					raySet.hitCount,
+					raySet.megaRaysPerSecond,
+					raySet.nodesPerRay,
+					raySet.trianglesPerRay,
+					structure.buildSeconds,
+					structure.memoryBytes / (1024. * 1024.));
+			}
+		}
+
+		// Structures disagreeing on the hits point to a traversal bug, not a performance change
+		for (const StructureResult& structure : result.structures)
+		{
+			for (size_t set = 0; set < structure.raySets.size(); set++)
+			{
+				if (structure.raySets[set].hitCount != result.structures.front().raySets[set].hitCount)
+				{
+					std::printf("  Warning: %s finds %zu %s hits, %s finds %zu\n",
+						structure.name.c_str(),
+						structure.raySets[set].hitCount,
+						structure.raySets[set].name.c_str(),
+						result.structures.front().name.c_str(),
+						result.structures.front().raySets[set].hitCount);
+				}
+			}
+		}
+
+		if (!result.tileOrders.empty())
+		{
+			std::printf("  tile orders with %s, all ray sets on %u threads:\n",
+				result.structures.front().name.c_str(),
+				result.tileThreads);
+			std::printf("  %-10s %10s %10s %10s\n", "order", "rays", "seconds", "Mrays/s");
+			for (const TileOrderResult& tileOrder : result.tileOrders)
+			{
+				std::printf("  %-10s %10zu %10.4f %10.3f\n",
+					tileOrder.name.c_str(),
+					tileOrder.rayCount,
+					tileOrder.seconds,
+					tileOrder.megaRaysPerSecond);
+			}
+		}
+	}
+
+	/*static*/ bool RayBenchmark::writeJson(const std::vector<SceneResult>& results, const std::string& path)
+	{
+		std::ofstream file(path, std::ios::trunc);
+		file << "{\n\t\"scenes\": [";
+		for (size_t scene = 0; scene < results.size(); scene++)
+		{
+			const SceneResult& result = results[scene];
+			file << (scene > 0 ? "," : "") << "\n\t\t{\n";
+			file << "\t\t\t\"name\": \"" << result.name << "\",\n";
+			file << "\t\t\t\"triangleCount\": " << result.triangleCount << ",\n";
+			file << "\t\t\t\"structures\": [";
+			for (size_t structure = 0; structure < result.structures.size(); structure++)
+			{
+				const StructureResult& structureResult = result.structures[structure];
+				file << (structure > 0 ? "," : "") << "\n\t\t\t\t{\n";
+				file << "\t\t\t\t\t\"name\": \"" << structureResult.name << "\",\n";
+				file << "\t\t\t\t\t\"buildSeconds\": " << structureResult.buildSeconds << ",\n";
+				file << "\t\t\t\t\t\"memoryBytes\": " << structureResult.memoryBytes << ",\n";
+				file << "\t\t\t\t\t\"raySets\": [";
+				for (size_t set = 0; set < structureResult.raySets.size(); set++)
+				{
+					const RaySetResult& raySet = structureResult.raySets[set];
+					file << (set > 0 ? "," : "") << "\n\t\t\t\t\t\t{ ";
+					file << "\"name\": \"" << raySet.name << "\", ";
+					file << "\"rayCount\": " << raySet.rayCount << ", ";
+					file << "\"hitCount\": " << raySet.hitCount << ", ";
+					file << "\"seconds\": " << raySet.seconds << ", ";
+					file << "\"megaRaysPerSecond\": " << raySet.megaRaysPerSecond << ", ";
+					file << "\"nodesPerRay\": " << raySet.nodesPerRay << ", ";
+					file << "\"trianglesPerRay\": " << raySet.trianglesPerRay << " }";
+				}
+				file << "\n\t\t\t\t\t]\n\t\t\t\t}";
+			}
+			file << "\n\t\t\t],\n";
+			file << "\t\t\t\"tileThreads\": " << result.tileThreads << ",\n";
+			file << "\t\t\t\"tileOrders\": [";
+			for (size_t order = 0; order < result.tileOrders.size(); order++)
+			{
+				const TileOrderResult& tileOrder = result.tileOrders[order];
+				file << (order > 0 ? "," : "") << "\n\t\t\t\t{ ";
+				file << "\"name\": \"" << tileOrder.name << "\", ";
+				file << "\"rayCount\": " << tileOrder.rayCount << ", ";
+				file << "\"seconds\": " << tileOrder.seconds << ", ";
+				file << "\"megaRaysPerSecond\": " << tileOrder.megaRaysPerSecond << " }";
+			}
+			file << "\n\t\t\t]\n\t\t}";
+		}
+		file << "\n\t]\n}\n";
+		return static_cast<bool>(file);
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	std::vector<RaySet> RayBenchmark::createRaySets(const SceneDatabase& database, const std::vector<KdTriangle>& triangles) const
+	{
+		std::vector<RaySet> raySets(4);
+		raySets[0].name = "primary";
+		raySets[1].name = "specular";
+		raySets[2].name = "diffuse";
+		raySets[3].name = "shadow";
+		raySets[3].shadow = true;
+
+		// Same camera model as the renderer
+		const SceneCamera& camera = database.getCameras().front();
+		const float fieldOfView = 49.13434f;
+		const float distance = -0.725f;
+		const aiVector3D& cameraUp = camera.up;
+		const aiVector3D& lookAt = camera.lookAt;
+		const aiVector3D& cameraRight = camera.right;
+		const float halfViewport = distance * std::tan(fieldOfView / 2.f);
+		const aiVector3D pixelShiftX = ((2 * halfViewport) / this->resolution) * cameraRight;
+		const aiVector3D pixelShiftY = ((2 * halfViewport) / this->resolution) * cameraUp;
+		const aiVector3D topLeftPixel = lookAt - (halfViewport * cameraRight) + (halfViewport * cameraUp);
+
+		for (uint32_t y = 0; y < this->resolution; y++)
+		{
+			for (uint32_t x = 0; x < this->resolution; x++)
+			{
+				const aiVector3D direction = topLeftPixel + (x + 0.5f) * pixelShiftX - (y + 0.5f) * pixelShiftY;
+				raySets[0].rays.emplace_back(camera.position, aiVector3D(direction).Normalize());
+				raySets[0].pixels.push_back(y * this->resolution + x);
+			}
+		}
+
+		// Shadow rays end on a light. Scenes without point lights use a point below the top of the scene
+		std::vector<aiVector3D> lightPositions;
+		for (const SceneLight& light : database.getLights())
+		{
+			if (light.type != aiLightSource_DIRECTIONAL)
+			{
+				lightPositions.push_back(light.position);
+			}
+		}
+		if (lightPositions.empty())
+		{
+			const BoundingBox& sceneBounds = database.getBounds();
+			aiVector3D position = sceneBounds.getCenter();
+			position.y = sceneBounds.getMin().y + 0.9f * (sceneBounds.getMax().y - sceneBounds.getMin().y);
+			lightPositions.push_back(position);
+		}
+
+		// Secondary rays start at the primary hits, found with a reference structure
+		std::unique_ptr<BoundingVolumeHierarchy> reference(BoundingVolumeHierarchy::build(triangles));
+		std::mt19937 randomEngine(this->seed);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+		for (size_t pixel = 0; pixel < raySets[0].rays.size(); pixel++)
+		{
+			const aiRay& primaryRay = raySets[0].rays[pixel];
+			IntersectionInformation info;
+			if (!reference->calculateIntersection(primaryRay, &info))
+			{
+				continue;
+			}
+
+			// Geometric normal facing the incoming ray
+			const SurfaceInteraction surface = reference->getSurface(database, primaryRay, info);
+			aiVector3D normal = ((surface.vertices[1] - surface.vertices[0]) ^ (surface.vertices[2] - surface.vertices[0])).Normalize();
+			if ((normal * primaryRay.dir) > 0.f)
+			{
+				normal = -normal;
+			}
+			const aiVector3D origin = surface.hitPoint + BIAS * normal;
+
+			raySets[1].rays.emplace_back(origin, utility::mathUtility::calculateReflectionDirection(primaryRay.dir, normal).Normalize());
+
+			aiVector3D tangent;
+			aiVector3D bitangent;
+			utility::mathUtility::createCoordinateSystem(normal, tangent, bitangent);
+			const aiVector3D sample = utility::mathUtility::uniformSampleHemisphere(uniform(randomEngine), uniform(randomEngine));
+			raySets[2].rays.emplace_back(origin, sample.x * bitangent + sample.y * normal + sample.z * tangent);
+
+			const aiVector3D& light = lightPositions[std::min(static_cast<size_t>(uniform(randomEngine) * lightPositions.size()), lightPositions.size() - 1)];
+			raySets[3].rays.emplace_back(origin, light - origin);
+
+			for (size_t set = 1; set < raySets.size(); set++)
+			{
+				raySets[set].pixels.push_back(static_cast<uint32_t>(pixel));
+			}
+		}
+		return raySets;
+	}
+
+	RaySetResult RayBenchmark::measure(AccelerationStructure& structure, const RaySet& raySet) const
+	{
+		RaySetResult result;
+		result.name = raySet.name;
+		result.rayCount = raySet.rays.size();
+		result.seconds = std::numeric_limits<double>::infinity();
+
+		const TraversalStatistics& statistics = structure.getStatistics();
+		const uint64_t raysBefore = statistics.getRays();
+		const uint64_t nodesBefore = statistics.getNodesVisited();
+		const uint64_t trianglesBefore = statistics.getTrianglesTested();
+
+		for (uint32_t repetition = 0; repetition < std::max(this->repetitions, 1U); repetition++)
+		{
+			size_t hitCount{ 0 };
+			const clock::time_point start = clock::now();
+			for (const aiRay& ray : raySet.rays)
+			{
+				if (raySet.shadow)
+				{
+					hitCount += structure.occluded(ray, 1.f) ? 1 : 0;
+				}
+				else
+				{
+					IntersectionInformation info;
+					hitCount += structure.calculateIntersection(ray, &info) ? 1 : 0;
+				}
+			}
+			result.seconds = std::min(result.seconds, std::chrono::duration<double>(clock::now() - start).count());
+			result.hitCount = hitCount;
+		}
+
+		result.megaRaysPerSecond = (result.seconds > 0.) ? result.rayCount / result.seconds * 1e-6 : 0.;
+
+		// Zero unless traversal statistics are collected
+		const uint64_t raysTraced = statistics.getRays() - raysBefore;
+		if (raysTraced > 0)
+		{
+			result.nodesPerRay = static_cast<double>(statistics.getNodesVisited() - nodesBefore) / raysTraced;
+			result.trianglesPerRay = static_cast<double>(statistics.getTrianglesTested() - trianglesBefore) / raysTraced;
+		}
+		return result;
+	}
+
+	TileOrderResult RayBenchmark::measureTileOrder(AccelerationStructure& structure, const std::vector<RaySet>& raySets, const std::string& name, const TileOrder order) const
+	{
+		TileOrderResult result;
+		result.name = name;
+		result.seconds = std::numeric_limits<double>::infinity();
+
+		// Ray of every set at every pixel, UINT32_MAX where a set has none
+		const uint32_t pixelCount = this->resolution * this->resolution;
+		std::vector<std::vector<uint32_t>> pixelRays(raySets.size(), std::vector<uint32_t>(pixelCount, UINT32_MAX));
+		for (size_t set = 0; set < raySets.size(); set++)
+		{
+			for (uint32_t ray = 0; ray < raySets[set].pixels.size(); ray++)
+			{
+				pixelRays[set][raySets[set].pixels[ray]] = ray;
+			}
+		}
+
+		const uint32_t threadCount = std::max(this->tileThreads, 1U);
+		const uint16_t resolution = static_cast<uint16_t>(this->resolution);
+		TileScheduler scheduler;
+		for (uint32_t repetition = 0; repetition < std::max(this->repetitions, 1U); repetition++)
+		{
+			scheduler.reset(threadCount);
+			scheduler.distribute(TileScheduler::createTiles(resolution, resolution, TILE_SIZE, order));
+			std::vector<size_t> threadRays(threadCount, 0);
+
+			const clock::time_point start = clock::now();
+			std::vector<std::thread> threads;
+			for (uint32_t worker = 0; worker < threadCount; worker++)
+			{
+				threads.emplace_back([&, worker]
+				{
+					size_t rayCount{ 0 };
+					RenderJob job;
+					while (scheduler.next(worker, job))
+					{
+						for (uint32_t y = job.getTileStartY(); y < job.getTileEndY(); y++)
+						{
+							for (uint32_t x = job.getTileStartX(); x < job.getTileEndX(); x++)
+							{
+								for (size_t set = 0; set < raySets.size(); set++)
+								{
+									const uint32_t ray = pixelRays[set][y * this->resolution + x];
+									if (ray == UINT32_MAX)
+									{
+										continue;
+									}
+									if (raySets[set].shadow)
+									{
+										structure.occluded(raySets[set].rays[ray], 1.f);
+									}
+									else
+									{
+										IntersectionInformation info;
+										structure.calculateIntersection(raySets[set].rays[ray], &info);
+									}
+									rayCount++;
+								}
+							}
+						}
+					}
+					threadRays[worker] = rayCount;
+				});
+			}
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
+			result.seconds = std::min(result.seconds, std::chrono::duration<double>(clock::now() - start).count());
+
+			result.rayCount = 0;
+			for (const size_t rayCount : threadRays)
+			{
+				result.rayCount += rayCount;
+			}
+		}
+
+		result.megaRaysPerSecond = (result.seconds > 0.) ? result.rayCount / result.seconds * 1e-6 : 0.;
+		return result;
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
@@ -0,0 +1,171 @@
+/*
+ * RayBenchmark.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "assimp/scene.h"
+
+#include "raytracing.hpp"
+#include "Types/AccelerationStructure.hpp"
+#include "Types/SceneDatabase.hpp"
+#include "settings.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Fixed set of rays traced against every structure of a scene. Shadow rays end at the
+	// ray parameter 1 and are tested with occluded, all others search the closest hit.
+	struct RaySet
+	{
+		std::string name;
+
+		std::vector<aiRay> rays;
+
+		// Camera ray pixel of every ray, counted in rows
+		std::vector<uint32_t> pixels;
+
+		bool shadow{ false };
+	};
+
+	struct RaySetResult
+	{
+		std::string name;
+
+		size_t rayCount{ 0 };
+
+		// Compared between structures, every structure has to find the same hits
+		size_t hitCount{ 0 };
+
+		// Fastest of all repetitions
+		double seconds{ 0. };
+
+		double megaRaysPerSecond{ 0. };
+
+		double nodesPerRay{ 0. };
+
+		double trianglesPerRay{ 0. };
+	};
+
+	// All ray sets traced tile by tile on several threads, with tiles handed out in one order
+	struct TileOrderResult
+	{
+		std::string name;
+
+		size_t rayCount{ 0 };
+
+		// Fastest of all repetitions
+		double seconds{ 0. };
+
+		double megaRaysPerSecond{ 0. };
+	};
+
+	struct StructureResult
+	{
+		std::string name;
+
+		double buildSeconds{ 0. };
+
+		size_t memoryBytes{ 0 };
+
+		std::vector<RaySetResult> raySets;
+	};
+
+	struct SceneResult
+	{
+		std::string name;
+
+		size_t triangleCount{ 0 };
+
+		std::vector<StructureResult> structures;
+
+		uint32_t tileThreads{ 0 };
+
+		// Measured with the first structure
+		std::vector<TileOrderResult> tileOrders;
+	};
+
+	// Builds an acceleration structure from the triangles of a scene. Structures built per mesh
+	// read the meshes from the database.
+	typedef std::function<AccelerationStructure*(const SceneDatabase&, const std::vector<KdTriangle>&)> StructureBuilder;
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Measures the traversal throughput of the acceleration structures. The rays of a scene
+	// are generated once from a fixed seed and traced on a single thread, so results of
+	// different builds can be compared directly. The tile orders of the renderer are compared
+	// by tracing the same rays with several threads, tile by tile.
+	class RayBenchmark
+	{
+
+	// Offset of secondary ray origins along the surface normal
+	static constexpr float BIAS = 1e-3f;
+
+	// Same tile size as the renderer
+	static constexpr uint16_t TILE_SIZE = 32;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		RayBenchmark(const uint32_t resolution, const uint32_t repetitions, const uint32_t seed, const uint32_t tileThreads) :
+			resolution(resolution), repetitions(repetitions), seed(seed), tileThreads(tileThreads)
+		{};
+
+		// Structures are traced in the order they are added
+		void addStructure(const std::string& name, const StructureBuilder& builder);
+
+		// Builds every structure for the scene and traces all ray sets. The scene needs a camera.
+		SceneResult run(const std::string& name, const aiScene* scene) const;
+
+		static void print(const SceneResult& result);
+
+		// Returns false if the file could not be written
+		static bool writeJson(const std::vector<SceneResult>& results, const std::string& path);
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		// Camera rays in scanline order, and from their hits mirror reflections, uniform
+		// hemisphere samples and rays to the lights
+		std::vector<RaySet> createRaySets(const SceneDatabase& database, const std::vector<KdTriangle>& triangles) const;
+
+		RaySetResult measure(AccelerationStructure& structure, const RaySet& raySet) const;
+
+		// Traces the rays of all sets pixel by pixel in the tiles handed out by a TileScheduler
+		TileOrderResult measureTileOrder(AccelerationStructure& structure, const std::vector<RaySet>& raySets, const std::string& name, const TileOrder order) const;
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		// Width and height of the image the camera rays are generated for
+		uint32_t resolution;
+
+		uint32_t repetitions;
+
+		uint32_t seed;
+
+		// Render threads of the tile order comparison
+		uint32_t tileThreads;
+
+		std::vector<std::pair<std::string, StructureBuilder>> builders;
+
+	};
+
+} // end of namespace raytracer
\ No newline at end of file
@@ -0,0 +1,214 @@
+/*
+ * RefitCheck.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "assimp/scene.h"
+
+// Renames main like in the renderer, so the library's main is never linked in
+#include "sdl2/SDL.h"
+
+#include "Types/BoundingVolumeHierarchy.hpp"
+#include "Types/KdTree.hpp"
+#include "Types/SceneDatabase.hpp"
+#include "Types/TwoLevelAccelerationStructure.hpp"
+#include "Types/WideBoundingVolumeHierarchy.hpp"
+
+/*--------------------------------< Constants >-----------------------------------------*/
+
+static constexpr unsigned int MESH_COUNT = 8;
+static constexpr unsigned int TRIANGLES_PER_MESH = 400;
+static constexpr unsigned int FRAME_COUNT = 8;
+static constexpr unsigned int RAYS_PER_FRAME = 20000;
+
+typedef std::chrono::steady_clock SteadyClock;
+
+// Scene of MESH_COUNT blobs of random triangles. Every mesh is placed twice: once standing still
+// and once on a turntable around the vertical axis. restPositions receives the undeformed vertices.
+static aiScene* createScene(std::vector<std::vector<aiVector3D>>& restPositions)
+{
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<float> offset(-1.f, 1.f);
+
+	aiScene* scene = new aiScene();
+	scene->mNumMeshes = MESH_COUNT;
+	scene->mMeshes = new aiMesh*[MESH_COUNT];
+	scene->mRootNode = new aiNode();
+	scene->mRootNode->mNumChildren = 2 * MESH_COUNT;
+	scene->mRootNode->mChildren = new aiNode*[2 * MESH_COUNT];
+
+	for (unsigned int meshIndex = 0; meshIndex < MESH_COUNT; meshIndex++)
+	{
+		aiMesh* mesh = new aiMesh();
+		mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+		mesh->mNumVertices = 3 * TRIANGLES_PER_MESH;
+		mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+		mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+		mesh->mNumFaces = TRIANGLES_PER_MESH;
+		mesh->mFaces = new aiFace[TRIANGLES_PER_MESH];
+		for (unsigned int face = 0; face < TRIANGLES_PER_MESH; face++)
+		{
+			const aiVector3D center(offset(generator), offset(generator), offset(generator));
+			mesh->mFaces[face].mNumIndices = 3;
+			mesh->mFaces[face].mIndices = new unsigned int[3];
+			for (unsigned int corner = 0; corner < 3; corner++)
+			{
+				const unsigned int vertex = 3 * face + corner;
+				mesh->mVertices[vertex] = center + 0.2f * aiVector3D(offset(generator), offset(generator), offset(generator));
+				mesh->mNormals[vertex] = aiVector3D(0.f, 1.f, 0.f);
+				mesh->mFaces[face].mIndices[corner] = vertex;
+			}
+		}
+		scene->mMeshes[meshIndex] = mesh;
+		restPositions.emplace_back(mesh->mVertices, mesh->mVertices + mesh->mNumVertices);
+
+		for (unsigned int copy = 0; copy < 2; copy++)
+		{
+			aiNode* node = new aiNode();
+			node->mParent = scene->mRootNode;
+			node->mNumMeshes = 1;
+			node->mMeshes = new unsigned int[1]{ meshIndex };
+			aiMatrix4x4::Translation(aiVector3D(3.f * meshIndex, 3.f * copy, 0.f), node->mTransformation);
+			scene->mRootNode->mChildren[2 * meshIndex + copy] = node;
+		}
+	}
+	return scene;
+}
+
+// Moves the scene to the given frame. Vertices are sheared by a wave running through the
+// meshes and every second node is turned around the vertical axis of the scene.
+static void animate(aiScene* scene, const std::vector<std::vector<aiVector3D>>& restPositions, const unsigned int frame)
+{
+	for (unsigned int meshIndex = 0; meshIndex < MESH_COUNT; meshIndex++)
+	{
+		aiMesh* mesh = scene->mMeshes[meshIndex];
+		for (unsigned int vertex = 0; vertex < mesh->mNumVertices; vertex++)
+		{
+			const aiVector3D& rest = restPositions[meshIndex][vertex];
+			mesh->mVertices[vertex] = rest + aiVector3D(0.3f * std::sin(0.7f * frame + 3.f * rest.y), 0.f, 0.f);
+		}
+	}
+
+	for (unsigned int meshIndex = 0; meshIndex < MESH_COUNT; meshIndex++)
+	{
+		aiMatrix4x4 rotation;
+		aiMatrix4x4 translation;
+		aiMatrix4x4::RotationY(0.4f * frame, rotation);
+		aiMatrix4x4::Translation(aiVector3D(3.f * meshIndex, 3.f, 0.f), translation);
+		scene->mRootNode->mChildren[2 * meshIndex + 1]->mTransformation = rotation * translation;
+	}
+}
+
+// Animates the scene over FRAME_COUNT frames. One structure is kept up to date with updateMesh,
+// setInstanceTransform and commit, another one is rebuilt from scratch every frame. Both have
+// to find the same closest hits and occlusions. Returns false on the first differing frame.
+static bool checkRefit(const std::string& name, const raytracing::BottomLevelBuilder& buildBottomLevel)
+{
+	std::vector<std::vector<aiVector3D>> restPositions;
+	std::unique_ptr<aiScene> scene(createScene(restPositions));
+	raytracing::SceneDatabase database(scene.get());
+	std::unique_ptr<raytracing::TwoLevelAccelerationStructure> updated(raytracing::TwoLevelAccelerationStructure::build(scene.get(), database, buildBottomLevel));
+
+	double updateSeconds{ 0. };
+	double rebuildSeconds{ 0. };
+	uint64_t rebuiltNodes{ 0 };
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	for (unsigned int frame = 1; frame <= FRAME_COUNT; frame++)
+	{
+		animate(scene.get(), restPositions, frame);
+
+		SteadyClock::time_point start = SteadyClock::now();
+		for (unsigned int meshIndex = 0; meshIndex < MESH_COUNT; meshIndex++)
+		{
+			updated->updateMesh(meshIndex, false);
+		}
+		for (uint32_t instance = 0; instance < updated->getInstanceCount(); instance++)
+		{
+			updated->setInstanceTransform(instance, updated->getInstance(instance).node->mTransformation);
+		}
+		updated->commit();
+		updateSeconds += std::chrono::duration<double>(SteadyClock::now() - start).count();
+
+		start = SteadyClock::now();
+		raytracing::SceneDatabase rebuiltDatabase(scene.get());
+		std::unique_ptr<raytracing::TwoLevelAccelerationStructure> rebuilt(raytracing::TwoLevelAccelerationStructure::build(scene.get(), rebuiltDatabase, buildBottomLevel));
+		rebuildSeconds += std::chrono::duration<double>(SteadyClock::now() - start).count();
+
+		// Rays through the bounds of the animated scene
+		const raytracing::BoundingBox& bounds = rebuiltDatabase.getBounds();
+		const aiVector3D extent = bounds.getMax() - bounds.getMin();
+		uint32_t mismatches{ 0 };
+		for (unsigned int i = 0; i < RAYS_PER_FRAME; i++)
+		{
+			const aiVector3D origin = bounds.getMin() + aiVector3D(extent.x * uniform(generator), extent.y * uniform(generator), extent.z * uniform(generator));
+			aiVector3D direction(2.f * uniform(generator) - 1.f, 2.f * uniform(generator) - 1.f, 2.f * uniform(generator) - 1.f);
+			const aiRay ray(origin, direction.Normalize());
+
+			raytracing::IntersectionInformation updatedHit;
+			raytracing::IntersectionInformation rebuiltHit;
+			const bool updatedHits = updated->calculateIntersection(ray, &updatedHit);
+			const bool rebuiltHits = rebuilt->calculateIntersection(ray, &rebuiltHit);
+			if ((updatedHits != rebuiltHits) ||
+				(rebuiltHits && (std::abs(updatedHit.intersectionDistance - rebuiltHit.intersectionDistance) > 1e-4f * rebuiltHit.intersectionDistance)))
+			{
+				mismatches++;
+			}
+
+			// Shadow rays ending before or behind the closest hit, but not right at it
+			const float tMax = rebuiltHits ? rebuiltHit.intersectionDistance * (0.5f + uniform(generator)) : 10.f;
+			if (rebuiltHits && (std::abs(tMax - rebuiltHit.intersectionDistance) < 1e-3f * rebuiltHit.intersectionDistance))
+			{
+				continue;
+			}
+			if (updated->occluded(ray, tMax) != rebuilt->occluded(ray, tMax))
+			{
+				mismatches++;
+			}
+		}
+
+		rebuiltNodes += rebuilt->getStatistics().getNodesVisited();
+		if (mismatches != 0)
+		{
+			std::cout << name << ": frame " << frame << " differs from the rebuilt structure for " << mismatches << " rays" << std::endl;
+			return false;
+		}
+	}
+	const uint64_t updatedNodes = updated->getStatistics().getNodesVisited();
+
+	// Refitting keeps the topology of the first frame, so the traversal cost grows with the motion
+	std::cout << name << ": " << FRAME_COUNT << " frames match, update " << 1e3 * updateSeconds / FRAME_COUNT << " ms, rebuild "
+		<< 1e3 * rebuildSeconds / FRAME_COUNT << " ms per frame, " << static_cast<double>(updatedNodes) / rebuiltNodes
+		<< "x the nodes visited by the rebuilt structure" << std::endl;
+	return true;
+}
+
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	bool passed = true;
+	passed &= checkRefit("bvh", [](const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::BoundingVolumeHierarchy::build(triangles);
+	});
+	passed &= checkRefit("wbvh", [](const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::WideBoundingVolumeHierarchy::build(triangles);
+	});
+
+	// Cannot be refit, updateMesh falls back to a rebuild
+	passed &= checkRefit("kdtree", [](const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::KdTree::build(triangles);
+	});
+	return passed ? 0 : 1;
+}
\ No newline at end of file
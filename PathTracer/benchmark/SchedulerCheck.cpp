@@ -0,0 +1,98 @@
+/*
+ * SchedulerCheck.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Renames main like in the renderer, so the library's main is never linked in
+#include "sdl2/SDL.h"
+
+#include "Types/TileScheduler.hpp"
+
+/*--------------------------------< Constants >-----------------------------------------*/
+
+// Not a multiple of the tile size, so the uncovered border is checked as well
+static constexpr uint16_t IMAGE_WIDTH = 333;
+static constexpr uint16_t IMAGE_HEIGHT = 250;
+static constexpr uint16_t TILE_SIZE = 32;
+
+// Renders every tile of the frame with the given number of threads and checks that each pixel
+// of the full tiles is rendered exactly once and no pixel outside of them at all. Tiles in the
+// lower right corner take much longer than the rest, so threads run dry early and the
+// scheduler has to steal and split.
+static bool checkCoverage(const uint32_t threadCount, const raytracing::TileOrder order, const char* orderName)
+{
+	const std::vector<raytracing::RenderJob> tiles = raytracing::TileScheduler::createTiles(IMAGE_WIDTH, IMAGE_HEIGHT, TILE_SIZE, order);
+	const uint16_t coveredWidth = IMAGE_WIDTH / TILE_SIZE * TILE_SIZE;
+	const uint16_t coveredHeight = IMAGE_HEIGHT / TILE_SIZE * TILE_SIZE;
+
+	std::unique_ptr<std::atomic<uint32_t>[]> renderCount(new std::atomic<uint32_t>[IMAGE_WIDTH * IMAGE_HEIGHT]);
+	for (uint32_t i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++)
+	{
+		renderCount[i] = 0;
+	}
+
+	raytracing::TileScheduler scheduler;
+	scheduler.reset(threadCount);
+	scheduler.distribute(tiles);
+
+	std::vector<std::thread> threads;
+	for (uint32_t worker = 0; worker < threadCount; worker++)
+	{
+		threads.emplace_back([&, worker]()
+		{
+			raytracing::RenderJob job;
+			while (scheduler.next(worker, job))
+			{
+				uint32_t expensivePixels = 0;
+				for (uint16_t y = job.getTileStartY(); y < job.getTileEndY(); y++)
+				{
+					for (uint16_t x = job.getTileStartX(); x < job.getTileEndX(); x++)
+					{
+						renderCount[y * IMAGE_WIDTH + x]++;
+						expensivePixels += (x >= coveredWidth * 3 / 4) && (y >= coveredHeight * 3 / 4);
+					}
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(20 + expensivePixels / 4));
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	uint32_t wrongPixels = 0;
+	for (uint16_t y = 0; y < IMAGE_HEIGHT; y++)
+	{
+		for (uint16_t x = 0; x < IMAGE_WIDTH; x++)
+		{
+			const uint32_t expected = ((x < coveredWidth) && (y < coveredHeight)) ? 1 : 0;
+			wrongPixels += renderCount[y * IMAGE_WIDTH + x] != expected;
+		}
+	}
+
+	std::cout << orderName << " order, " << threadCount << " threads: " << wrongPixels << " pixels not rendered exactly once" << std::endl;
+	return wrongPixels == 0;
+}
+
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	bool passed = true;
+	for (const uint32_t threadCount : { 1u, 3u, 8u, 16u })
+	{
+		passed &= checkCoverage(threadCount, raytracing::TileOrder::SCANLINE, "scanline");
+		passed &= checkCoverage(threadCount, raytracing::TileOrder::MORTON, "morton");
+		passed &= checkCoverage(threadCount, raytracing::TileOrder::HILBERT, "hilbert");
+		passed &= checkCoverage(threadCount, raytracing::TileOrder::SPIRAL, "spiral");
+	}
+	return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+/*
+ * main.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "assimp/Importer.hpp"
+#include "assimp/postprocess.h"
+#include "assimp/scene.h"
+
+// Renames main like in the renderer, so the library's main is never linked in
+#include "sdl2/SDL.h"
+
+#include "RayBenchmark.hpp"
+#include "Types/BoundingVolume.hpp"
+#include "Types/BoundingVolumeHierarchy.hpp"
+#include "Types/CompressedBoundingVolumeHierarchy.hpp"
+#include "Types/KdTree.hpp"
+#include "Types/WideBoundingVolumeHierarchy.hpp"
+#include "Utility/ArgParser.hpp"
+
+namespace filesystem = std::filesystem;
+
+
+int main(int argc, char* argv[])
+{
+	utility::ArgParser options(argc, argv);
+
+	if (options.cmdOptionExists("-h"))
+	{
+		// Print usage and exit
+		std::cout << "Usage: "
+			"[--res <directory of the scenes to benchmark>] "
+			"[--scene <file name of a single scene>] "
+			"[--output <file to write the results to as JSON>] "
+			"[--resolution <width and height of the camera ray grid>] "
+			"[--repetitions <number of runs per ray set, the fastest is reported>] "
+			"[--seed <seed of the secondary ray directions>] "
+			"[--threads <number of threads tracing the tile orders>] " << std::endl;
+		return 0;
+	}
+
+	const std::string& resStr(options.getCmdOption("--res"));
+	const filesystem::path resPath(resStr.empty() ? "res" : resStr);
+	if (!filesystem::is_directory(resPath))
+	{
+		std::cerr << "Scene directory " << resPath.string() << " not found. Exiting.." << std::endl;
+		return 1;
+	}
+
+	const std::string& sceneStr(options.getCmdOption("--scene"));
+
+	const std::string& outputStr(options.getCmdOption("--output"));
+	const std::string outputPath(outputStr.empty() ? "benchmark.json" : outputStr);
+
+	const std::string& resolutionStr(options.getCmdOption("--resolution"));
+	const uint32_t resolution = resolutionStr.empty() ? 256 : static_cast<uint32_t>(std::stoul(resolutionStr));
+
+	const std::string& repetitionsStr(options.getCmdOption("--repetitions"));
+	const uint32_t repetitions = repetitionsStr.empty() ? 3 : static_cast<uint32_t>(std::stoul(repetitionsStr));
+
+	const std::string& seedStr(options.getCmdOption("--seed"));
+	const uint32_t seed = seedStr.empty() ? 1 : static_cast<uint32_t>(std::stoul(seedStr));
+
+	const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+
+	const std::string& threadsStr(options.getCmdOption("--threads"));
+	const uint32_t tileThreads = threadsStr.empty() ? threadCount : static_cast<uint32_t>(std::stoul(threadsStr));
+
+	raytracing::RayBenchmark benchmark(resolution, repetitions, seed, tileThreads);
+	benchmark.addStructure("kdtree", [threadCount](const raytracing::SceneDatabase&, const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::KdTree::build(triangles, threadCount);
+	});
+	benchmark.addStructure("bvh", [](const raytracing::SceneDatabase&, const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::BoundingVolumeHierarchy::build(triangles);
+	});
+	benchmark.addStructure("sbvh", [](const raytracing::SceneDatabase&, const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::BoundingVolumeHierarchy::buildSpatial(triangles, 0.3f);
+	});
+	benchmark.addStructure("wbvh", [](const raytracing::SceneDatabase&, const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::WideBoundingVolumeHierarchy::build(triangles);
+	});
+	benchmark.addStructure("cbvh", [](const raytracing::SceneDatabase&, const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::CompressedBoundingVolumeHierarchy::build(triangles);
+	});
+	benchmark.addStructure("bv", [](const raytracing::SceneDatabase& database, const std::vector<raytracing::KdTriangle>&) -> raytracing::AccelerationStructure*
+	{
+		return raytracing::BoundingVolume::build(database);
+	});
+
+	// Scenes are benchmarked in name order to keep the results comparable
+	std::vector<filesystem::path> scenePaths;
+	for (const filesystem::directory_entry& entry : filesystem::directory_iterator(resPath))
+	{
+		if ((entry.path().extension() == ".dae") && (sceneStr.empty() || (entry.path().filename().string() == sceneStr)))
+		{
+			scenePaths.push_back(entry.path());
+		}
+	}
+	std::sort(scenePaths.begin(), scenePaths.end());
+
+	std::vector<raytracing::SceneResult> results;
+	for (const filesystem::path& scenePath : scenePaths)
+	{
+		Assimp::Importer assetImporter;
+		const aiScene* scene = assetImporter.ReadFile(scenePath.string(),
+			aiProcess_ImproveCacheLocality |
+			aiProcess_RemoveRedundantMaterials |
+			aiProcess_Triangulate |
+			aiProcess_JoinIdenticalVertices |
+			aiProcess_FindDegenerates |
+			aiProcess_SortByPType);
+		if (!scene || !scene->HasCameras())
+		{
+			std::cerr << "Skipping " << scenePath.filename().string() << ": no camera or import failed" << std::endl;
+			continue;
+		}
+
+		// Transform cameras and lights to world space
+		for (unsigned int currentCamera = 0; currentCamera < scene->mNumCameras; currentCamera++)
+		{
+			aiCamera* camera = scene->mCameras[currentCamera];
+			camera->Transform(scene->mRootNode->FindNode(camera->mName)->mTransformation);
+		}
+		for (unsigned int currentLight = 0; currentLight < scene->mNumLights; currentLight++)
+		{
+			aiLight* light = scene->mLights[currentLight];
+			light->Transform(scene->mRootNode->FindNode(light->mName)->mTransformation);
+		}
+
+		results.push_back(benchmark.run(scenePath.filename().string(), scene));
+		raytracing::RayBenchmark::print(results.back());
+	}
+
+	if (!raytracing::RayBenchmark::writeJson(results, outputPath))
+	{
+		std::cerr << "Writing results to " << outputPath << " failed" << std::endl;
+		return 1;
+	}
+	std::cout << "Results written to " << outputPath << std::endl;
+	return 0;
+}
\ No newline at end of file
@@ -18,7 +18,6 @@
 #include "exceptions.hpp"
 #include "raytracing.hpp"
 #include "Types/RenderJob.hpp"
-#include "Types/SynchronizedQueue.hpp"
 #include "settings.hpp"
 
 namespace raytracing
@@ -6,9 +6,11 @@
 #include <vector>
 #include <math.h>
 #include <random>
+#include <limits>
 
 #include "PathTracer.hpp"
 #include "exceptions.hpp"
+#include "Types/RayStream.hpp"
 
 #include "Utility/mathUtility.hpp"
 #include "Utility/materialUtility.hpp"
@@ -28,27 +30,27 @@ namespace raytracing
 	/*--------------------------------< Public members >-------------------------------------*/
 
 
-	void PathTracer::initialize(const std::string sceneDirPath)
+	void PathTracer::initialize(const std::string sceneDirPath, const uint8_t threadCount)
 	{
-		if (!this->scene->HasCameras())
+		if (this->database.getCameras().empty())
 		{
 			throw Renderer("No camera found!");
 		}
 		// Using first camera in scene
-		aiCamera* camera = (*this->scene->mCameras);
+		const SceneCamera& camera = this->database.getCameras().front();
 
-		//float aspectRatio = camera->mAspect;
+		//float aspectRatio = camera.aspect;
 		float aspectRatio = 1.0f;
-		//float fieldOfView = camera->mHorizontalFOV;
+		//float fieldOfView = camera.horizontalFOV;
 		float fieldOfView = 49.13434f;
 		if (aspectRatio != 1.0f)
 		{
 			SDL_LogWarn(SDL_LOG_CATEGORY_INPUT, "Aspect ratio of camera is not 1! Proceeding..");
 		}
 
-		const aiVector3D cameraUp = camera->mUp.Normalize();
-		const aiVector3D lookAt = camera->mLookAt.Normalize();
-		const aiVector3D cameraRight = camera->mRight.Normalize();
+		const aiVector3D& cameraUp = camera.up;
+		const aiVector3D& lookAt = camera.lookAt;
+		const aiVector3D& cameraRight = camera.right;
 
 		float distance = -0.725; // Why this specific value??
 		float halfViewportWidth = distance * std::tan(fieldOfView / 2.0f);
@@ -58,6 +60,9 @@ namespace raytracing
 		this->pixelShiftY = ((2 * halfViewportHeight) / (this->renderSettings.getHeight())) * cameraUp;
 		this->topLeftPixel = lookAt - (halfViewportWidth * cameraRight) + (halfViewportHeight * cameraUp);
 
+		this->sceneBounds = this->database.getBounds();
+
+		this->renderJobs.reset(threadCount);
 		this->createJobs();
 
 		std::srand(static_cast<unsigned int>(time(0)));
@@ -68,11 +73,27 @@ namespace raytracing
 	}
 
 
-	void PathTracer::renderMultiThreaded()
+	void PathTracer::renderMultiThreaded(const uint8_t worker)
 	{
 		RenderJob job;
-		while (this->renderJobs.popFront(job))
+		while (this->renderJobs.next(worker, job))
 		{
+			if (this->renderSettings.getUseRaySorting())
+			{
+				this->renderBatched(job);
+				continue;
+			}
+
+#if PRIMARY_RAY_PACKETS && USE_ACCELERATION_STRUCTURE
+			if (this->renderSettings.getUseAA())
+			{
+				this->renderAntiAliasedPackets(job);
+			}
+			else
+			{
+				this->renderPackets(job);
+			}
+#else
 			if (this->renderSettings.getUseAA())
 			{
 				this->renderAntiAliased(job);
@@ -81,8 +102,7 @@ namespace raytracing
 			{
 				this->render(job);
 			}
-
-			std::this_thread::yield();
+#endif
 		}
 	}
 
@@ -98,7 +118,7 @@ namespace raytracing
 			{
 				uint32_t currentPixel = y * this->renderSettings.getWidth() + x;
 				aiVector3D rayDirection = (this->topLeftPixel + (this->pixelShiftX * static_cast<float>(x)) + (this->pixelShiftY * static_cast<float>(y))).Normalize();
-				aiRay currentRay((*this->scene->mCameras)->mPosition, rayDirection);
+				aiRay currentRay(this->database.getCameras().front().position, rayDirection);
 #if PATH_TRACE
 				this->pixels[currentPixel] = this->tracePath(currentRay);
 #else
@@ -112,7 +132,7 @@ namespace raytracing
 	void PathTracer::render(RenderJob& renderJob)
 	{
 		const uint8_t maxSamples = this->renderSettings.getMaxSamples();
-		aiVector3D& cameraPosition = (*this->scene->mCameras)->mPosition;
+		const aiVector3D& cameraPosition = this->database.getCameras().front().position;
 
 		for (uint16_t x = renderJob.getTileStartX(); x < renderJob.getTileEndX(); x++)
 		{
@@ -158,7 +178,7 @@ namespace raytracing
 	void PathTracer::renderAntiAliased(RenderJob& renderJob)
 	{
 		const uint8_t aa = this->renderSettings.getMaxSamples();
-		aiVector3D& cameraPosition = (*this->scene->mCameras)->mPosition;
+		const aiVector3D& cameraPosition = this->database.getCameras().front().position;
 
 		for (unsigned int x = renderJob.getTileStartX(); x < renderJob.getTileEndX(); x++)
 		{
@@ -210,26 +230,307 @@ namespace raytracing
 		}
 	}
 
-	aiColor3D PathTracer::sampleLight(IntersectionInformation& intersectionInformation, uint8_t rayDepth)
+	void PathTracer::renderPackets(RenderJob& renderJob)
 	{
-		unsigned int materialIndex = intersectionInformation.hitMesh->mMaterialIndex;
-		aiMaterial* meshMaterial = this->scene->mMaterials[materialIndex];
+		const uint8_t maxSamples = this->renderSettings.getMaxSamples();
+		const aiVector3D& cameraPosition = this->database.getCameras().front().position;
+
+		for (uint16_t blockY = renderJob.getTileStartY(); blockY < renderJob.getTileEndY(); blockY += PACKET_BLOCK_HEIGHT)
+		{
+			for (uint16_t blockX = renderJob.getTileStartX(); blockX < renderJob.getTileEndX(); blockX += PACKET_BLOCK_WIDTH)
+			{
+				aiRay rays[RayPacket::WIDTH];
+				uint32_t pixelIndices[RayPacket::WIDTH];
+				aiColor3D pixelAverages[RayPacket::WIDTH];
+				uint32_t rayCount{ 0 };
+
+				const uint16_t blockEndX = std::min<uint16_t>(blockX + PACKET_BLOCK_WIDTH, renderJob.getTileEndX());
+				const uint16_t blockEndY = std::min<uint16_t>(blockY + PACKET_BLOCK_HEIGHT, renderJob.getTileEndY());
+				for (uint16_t y = blockY; y < blockEndY; y++)
+				{
+					for (uint16_t x = blockX; x < blockEndX; x++)
+					{
+						aiVector3D nextPixelX = this->pixelShiftX * static_cast<float>(x);
+						aiVector3D nextPixelY = this->pixelShiftY * static_cast<float>(y);
+						aiVector3D rayDirection = (this->topLeftPixel + nextPixelX - nextPixelY).Normalize();
+						pixelIndices[rayCount] = y * this->renderSettings.getWidth() + x;
+						rays[rayCount++] = aiRay(cameraPosition, rayDirection);
+					}
+				}
+
+				for (unsigned int i = 0; i < std::pow(maxSamples, 2U); i++)
+				{
+					// DOF
+					if (this->renderSettings.getUseDOF())
+					{
+						for (uint32_t ray = 0; ray < rayCount; ray++)
+						{
+							mathUtility::calculateDepthOfFieldRay(
+								&rays[ray],
+								this->renderSettings.getAperture(),
+								this->renderSettings.getFocalDistance());
+						}
+					}
+
+					aiColor3D colors[RayPacket::WIDTH];
+					this->tracePrimaryPacket(rays, rayCount, colors);
+					for (uint32_t ray = 0; ray < rayCount; ray++)
+					{
+						pixelAverages[ray] += colors[ray];
+					}
+				}
+
+				for (uint32_t ray = 0; ray < rayCount; ray++)
+				{
+					aiColor3D pixelAverage = pixelAverages[ray] * static_cast<float>(1.f / std::pow(maxSamples, 2U));
+
+					// sRGB 
+					mathUtility::gammaCorrectSrgb(&pixelAverage);
+
+					this->pixels[pixelIndices[ray]] = pixelAverage;
+				}
+			}
+		}
+	}
+
+	void PathTracer::renderAntiAliasedPackets(RenderJob& renderJob)
+	{
+		const uint8_t aa = this->renderSettings.getMaxSamples();
+		const unsigned int subSampleCount = aa * aa;
+		const aiVector3D& cameraPosition = this->database.getCameras().front().position;
+
+		for (unsigned int x = renderJob.getTileStartX(); x < renderJob.getTileEndX(); x++)
+		{
+			for (unsigned int y = renderJob.getTileStartY(); y < renderJob.getTileEndY(); y++)
+			{
+				uint32_t currentPixel = y * this->renderSettings.getWidth() + x;
+				aiColor3D pixelAverage{};
+
+				// Sub-samples in the order of renderAntiAliased, RayPacket::WIDTH at a time
+				for (unsigned int firstSample = 0; firstSample < subSampleCount; firstSample += RayPacket::WIDTH)
+				{
+					aiRay rays[RayPacket::WIDTH];
+					const uint32_t rayCount = std::min<uint32_t>(RayPacket::WIDTH, subSampleCount - firstSample);
+					for (uint32_t ray = 0; ray < rayCount; ray++)
+					{
+						const unsigned int p = (firstSample + ray) / aa;
+						const unsigned int q = (firstSample + ray) % aa;
+
+						// Anti aliasing
+						float r = mathUtility::getRandomFloat(0.f, 1.f);
+						float aaShiftX = x + (p + r) / aa;
+						float aaShiftY = y + (q + r) / aa;
+
+						aiVector3D nextPixelX = this->pixelShiftX * static_cast<float>(aaShiftX);
+						aiVector3D nextPixelY = this->pixelShiftY * static_cast<float>(aaShiftY);
+						aiVector3D rayDirection = (this->topLeftPixel + nextPixelX - nextPixelY).Normalize();
+						rays[ray] = aiRay(cameraPosition, rayDirection);
+
+						// DOF
+						if (this->renderSettings.getUseDOF())
+						{
+							mathUtility::calculateDepthOfFieldRay(
+								&rays[ray],
+								this->renderSettings.getAperture(),
+								this->renderSettings.getFocalDistance());
+						}
+					}
+
+					aiColor3D colors[RayPacket::WIDTH];
+					this->tracePrimaryPacket(rays, rayCount, colors);
+					for (uint32_t ray = 0; ray < rayCount; ray++)
+					{
+						pixelAverage += colors[ray];
+					}
+				}
+				pixelAverage = pixelAverage * static_cast<float>(1.f / std::pow(aa, 2U));
+
+				// sRGB 
+				mathUtility::gammaCorrectSrgb(&pixelAverage);
+
+				this->pixels[currentPixel] = pixelAverage;
+			}
+		}
+	}
+
+	void PathTracer::tracePrimaryPacket(const aiRay* rays, const uint32_t rayCount, aiColor3D* outColors)
+	{
+		IntersectionInformation intersections[RayPacket::WIDTH];
+		const uint32_t hitMask = this->accelerationStructure->intersectPacket(rays, rayCount, intersections);
+
+		// Shading diverges right away, every hit continues on its own
+		for (uint32_t ray = 0; ray < rayCount; ray++)
+		{
+			if ((hitMask & (1U << ray)) == 0)
+			{
+				// TODO: Get scene background color
+				outColors[ray] = { .1f, .1f, .1f };
+				continue;
+			}
+
+			uint8_t rayDepth{ 0 };
+#if PATH_TRACE
+			outColors[ray] = this->sampleLight(this->getSurface(rays[ray], intersections[ray]), rayDepth);
+#else
+			outColors[ray] = this->shadePixel(this->getSurface(rays[ray], intersections[ray]), rayDepth);
+#endif
+		}
+	}
+
+	void PathTracer::renderBatched(RenderJob& renderJob)
+	{
+		const uint8_t maxSamples = this->renderSettings.getMaxSamples();
+		const unsigned int sampleCount = maxSamples * maxSamples;
+		const uint8_t maxRayDepth = this->renderSettings.getMaxRayDepth();
+		const aiVector3D& cameraPosition = this->database.getCameras().front().position;
+		// TODO: Get scene background color
+		const aiColor3D background{ .1f, .1f, .1f };
+
+		std::vector<aiColor3D> pixelSums(renderJob.getTileSize());
+		RayStream paths(this->sceneBounds);
+		RayStream bounces(this->sceneBounds);
+
+		// Camera rays are generated like by render and renderAntiAliased
+		for (uint16_t x = renderJob.getTileStartX(); x < renderJob.getTileEndX(); x++)
+		{
+			for (uint16_t y = renderJob.getTileStartY(); y < renderJob.getTileEndY(); y++)
+			{
+				const uint32_t tilePixel = (y - renderJob.getTileStartY()) * renderJob.getTileWidth() + (x - renderJob.getTileStartX());
+				aiVector3D nextPixelX = this->pixelShiftX * static_cast<float>(x);
+				aiVector3D nextPixelY = this->pixelShiftY * static_cast<float>(y);
+				aiRay pixelRay(cameraPosition, (this->topLeftPixel + nextPixelX - nextPixelY).Normalize());
+
+				for (unsigned int i = 0; i < sampleCount; i++)
+				{
+					aiRay* currentRay = &pixelRay;
+					aiRay subSampleRay;
+					if (this->renderSettings.getUseAA())
+					{
+						// Anti aliasing
+						float r = mathUtility::getRandomFloat(0.f, 1.f);
+						float aaShiftX = x + (i / maxSamples + r) / maxSamples;
+						float aaShiftY = y + (i % maxSamples + r) / maxSamples;
+
+						aiVector3D subSampleX = this->pixelShiftX * static_cast<float>(aaShiftX);
+						aiVector3D subSampleY = this->pixelShiftY * static_cast<float>(aaShiftY);
+						subSampleRay = aiRay(cameraPosition, (this->topLeftPixel + subSampleX - subSampleY).Normalize());
+						currentRay = &subSampleRay;
+					}
+
+					// DOF
+					if (this->renderSettings.getUseDOF())
+					{
+						mathUtility::calculateDepthOfFieldRay(
+							currentRay,
+							this->renderSettings.getAperture(),
+							this->renderSettings.getFocalDistance());
+					}
+
+					paths.push(*currentRay, { 1.f, 1.f, 1.f }, tilePixel);
+				}
+			}
+		}
+
+		for (uint8_t rayDepth = 0; !paths.empty(); rayDepth++)
+		{
+			// Camera rays are coherent in pixel order already, bounces are scattered all over the scene
+			if (rayDepth > 0)
+			{
+				paths.sort();
+			}
+
+			bounces.clear();
+			for (size_t currentPath = 0; currentPath < paths.size(); currentPath++)
+			{
+				const PathState& path = paths[currentPath];
+				if (rayDepth > maxRayDepth)
+				{
+					pixelSums[path.pixel] += path.throughput * background;
+					continue;
+				}
+
+				IntersectionInformation intersectionInformation;
+#if USE_ACCELERATION_STRUCTURE
+				bool intersects = this->accelerationStructure->calculateIntersection(path.ray, &intersectionInformation);
+#else
+				aiRay ray = path.ray;
+				bool intersects = this->calculateIntersection(ray, intersectionInformation);
+#endif
+				if (!intersects)
+				{
+					pixelSums[path.pixel] += path.throughput * background;
+					continue;
+				}
+
+				aiRay sampleRay{};
+				aiColor3D distributionFunction, emission;
+				if (!this->scatterRay(this->getSurface(path.ray, intersectionInformation), &sampleRay, &distributionFunction, &emission))
+				{
+					pixelSums[path.pixel] += path.throughput * emission;
+					continue;
+				}
+
+				// Simplified rendering equation for cosine weighted sampling
+				bounces.push(sampleRay, path.throughput * distributionFunction * PI, path.pixel);
+			}
+			paths.swap(bounces);
+		}
+
+		for (uint16_t x = renderJob.getTileStartX(); x < renderJob.getTileEndX(); x++)
+		{
+			for (uint16_t y = renderJob.getTileStartY(); y < renderJob.getTileEndY(); y++)
+			{
+				const uint32_t tilePixel = (y - renderJob.getTileStartY()) * renderJob.getTileWidth() + (x - renderJob.getTileStartX());
+				aiColor3D pixelAverage = pixelSums[tilePixel] * static_cast<float>(1.f / sampleCount);
+
+				// sRGB 
+				mathUtility::gammaCorrectSrgb(&pixelAverage);
+
+				this->pixels[y * this->renderSettings.getWidth() + x] = pixelAverage;
+			}
+		}
+	}
+
+	aiColor3D PathTracer::sampleLight(const SurfaceInteraction& surface, uint8_t rayDepth)
+	{
+		aiRay sampleRay{};
+		aiColor3D distributionFunction, emission;
+		if (!this->scatterRay(surface, &sampleRay, &distributionFunction, &emission))
+		{
+			return emission;
+		}
+
+		// Cast a ray in calculated direction
+		aiColor3D incomingLight = tracePath(sampleRay, rayDepth + 1);
+
+		// Simplified rendering equation for cosine weighted sampling
+		return distributionFunction * incomingLight * PI;
+	}
+
+	bool PathTracer::scatterRay(
+		const SurfaceInteraction& surface,
+		aiRay* outRay,
+		aiColor3D* outDistributionFunction,
+		aiColor3D* outEmission)
+	{
+		aiMaterial* meshMaterial = this->scene->mMaterials[surface.material];
 		Material* material = this->materialMapping[meshMaterial].get();
 
-		aiVector3D smoothNormal = mathUtility::calculateSmoothNormal(intersectionInformation.uv, intersectionInformation.vertexNormals);
+		const aiVector3D& smoothNormal = surface.smoothNormal;
 
 		// Return immediately if hit object is emissive
 		const aiColor3D& mEmissive = material->getEmissive();
 		if (aiColor3D{0.f, 0.f, 0.f} < mEmissive)
 		{
-			return mEmissive;
+			*outEmission = mEmissive;
+			return false;
 		}
 		
 		// Compute indirect light
-		const aiColor3D mDiffuse = material->getDiffuse(intersectionInformation.uvTextureCoords);
-		aiColor3D distributionFunction;
+		const aiColor3D mDiffuse = material->getDiffuse(surface.uvTextureCoords);
+		aiColor3D& distributionFunction = *outDistributionFunction;
 		aiVector3D Nt{}, Nb{}, newRayDirection{}, newRayPosition{};
-		aiRay sampleRay{};
+		aiRay& sampleRay = *outRay;
 		const float r1 = mathUtility::getRandomFloat(0.f, 1.f);
 		const float r2 = mathUtility::getRandomFloat(0.f, 1.f);
 
@@ -245,27 +546,27 @@ namespace raytracing
 		{
 			// Perfect translucent refraction
 			const float ior = material->getRefractionIndex();
-			float fresnelResult = mathUtility::fresnel(intersectionInformation.ray.dir, smoothNormal, ior);
+			float fresnelResult = mathUtility::fresnel(surface.ray.dir, smoothNormal, ior);
 
-			bool outside = (intersectionInformation.ray.dir * smoothNormal) < 0;
+			bool outside = (surface.ray.dir * smoothNormal) < 0;
 			aiVector3D bias = this->renderSettings.getBias() * smoothNormal;
 			const float refractionPropability = mathUtility::getRandomFloat(0.f, 1.f);
 
 			if (refractionPropability > fresnelResult)
 			{
 				// New ray is a refraction ray
-				newRayDirection = mathUtility::calculateRefractionDirection(intersectionInformation.ray.dir, smoothNormal, ior);
+				newRayDirection = mathUtility::calculateRefractionDirection(surface.ray.dir, smoothNormal, ior);
 				newRayDirection.Normalize();
-				newRayPosition = outside ? intersectionInformation.hitPoint - bias : intersectionInformation.hitPoint + bias;
+				newRayPosition = outside ? surface.hitPoint - bias : surface.hitPoint + bias;
 				sampleRay = { newRayPosition, newRayDirection, RayType::REFRACTION };
 				distributionFunction = mDiffuse / PI;
 			}
 			else
 			{
 				// New ray is a reflection ray
-				newRayDirection = mathUtility::calculateReflectionDirection(intersectionInformation.ray.dir, smoothNormal);
+				newRayDirection = mathUtility::calculateReflectionDirection(surface.ray.dir, smoothNormal);
 				newRayDirection.Normalize();
-				newRayPosition = outside ? intersectionInformation.hitPoint + bias : intersectionInformation.hitPoint - bias;
+				newRayPosition = outside ? surface.hitPoint + bias : surface.hitPoint - bias;
 				sampleRay = { newRayPosition, newRayDirection, RayType::REFLECTION };
 				distributionFunction = material->getReflective() / PI;
 			}
@@ -279,10 +580,10 @@ namespace raytracing
 			randomScatter *= toLocalMatrix;
 
 			// Calculate reflection direction
-			newRayDirection = mathUtility::calculateReflectionDirection(intersectionInformation.ray.dir, smoothNormal);
+			newRayDirection = mathUtility::calculateReflectionDirection(surface.ray.dir, smoothNormal);
 			newRayDirection = newRayDirection + randomScatter * roughness;
 
-			newRayPosition = intersectionInformation.hitPoint + (newRayDirection * this->renderSettings.getBias());
+			newRayPosition = surface.hitPoint + (newRayDirection * this->renderSettings.getBias());
 			sampleRay = { newRayPosition, newRayDirection, RayType::REFLECTION };
 			distributionFunction = material->getReflective() / PI;
 		}
@@ -292,27 +593,22 @@ namespace raytracing
 			newRayDirection = mathUtility::cosineSampleHemisphere(r1, r2);
 			newRayDirection *= toLocalMatrix;
 
-			newRayPosition = intersectionInformation.hitPoint + (newRayDirection * this->renderSettings.getBias());
+			newRayPosition = surface.hitPoint + (newRayDirection * this->renderSettings.getBias());
 			sampleRay = { newRayPosition, newRayDirection, RayType::INDIRECT_DIFFUSE };
 			distributionFunction = mDiffuse / PI;
 		}
 
-		// Cast a ray in calculated direction
-		aiColor3D incomingLight = tracePath(sampleRay, rayDepth + 1);
-
-		// Simplified rendering equation for cosine weighted sampling
-		return distributionFunction * incomingLight * PI;
+		return true;
 	}
 
 
-	aiColor3D PathTracer::shadePixel(IntersectionInformation& intersectionInformation, uint8_t& rayDepth)
+	aiColor3D PathTracer::shadePixel(const SurfaceInteraction& surface, uint8_t& rayDepth)
 	{
 		// Get mesh properties
-		aiVector3D edge1 = *(intersectionInformation.hitTriangle[1]) - *(intersectionInformation.hitTriangle[0]);
-		aiVector3D edge2 = *(intersectionInformation.hitTriangle[2]) - *(intersectionInformation.hitTriangle[0]);
+		aiVector3D edge1 = surface.vertices[1] - surface.vertices[0];
+		aiVector3D edge2 = surface.vertices[2] - surface.vertices[0];
 		aiVector3D faceNormal = (edge1 ^ edge2).Normalize();
-		unsigned int materialIndex = intersectionInformation.hitMesh->mMaterialIndex;
-		aiMaterial* material = this->scene->mMaterials[materialIndex];
+		aiMaterial* material = this->scene->mMaterials[surface.material];
 		aiColor3D materialColorDiffuse{}, materialColorEmission{}, materialColorAmbient{}, colorReflective{};
 		int shadingModel{};
 		float reflectivity{}, opacity{ 1 }, refractionIndex{ 1 };
@@ -326,22 +622,17 @@ namespace raytracing
 		material->Get(AI_MATKEY_REFRACTI, refractionIndex);
 		aiColor3D intersectionColor{ 0.f, 0.f, 0.f };
 
-		// Calculate vertex normal for smooth shading
-		aiVector3D smoothNormal = (1 - intersectionInformation.uv.x - intersectionInformation.uv.y) *
-			*intersectionInformation.vertexNormals[0] + intersectionInformation.uv.x *
-			*intersectionInformation.vertexNormals[1] + intersectionInformation.uv.y *
-			*intersectionInformation.vertexNormals[2];
-		smoothNormal.Normalize();
+		// Vertex normal for smooth shading
+		const aiVector3D& smoothNormal = surface.smoothNormal;
 
 		if (shadingModel == aiShadingMode::aiShadingMode_NoShading)
 		{
 			aiColor3D ambientLightStrength{};
-			for (unsigned int currentLight = 0; currentLight < scene->mNumLights; currentLight++)
+			for (const SceneLight& light : this->database.getLights())
 			{
-				aiLight* light = this->scene->mLights[currentLight];
-				if (light->mType == aiLightSourceType::aiLightSource_AMBIENT)
+				if (light.type == aiLightSourceType::aiLightSource_AMBIENT)
 				{
-					ambientLightStrength += light->mColorAmbient;
+					ambientLightStrength += light.colorAmbient;
 				}
 			}
 			// TODO: Verify ambient light contributes to shadeless model
@@ -355,16 +646,16 @@ namespace raytracing
 				// Surface transmits light. Cast refraction ray and calculate color
 				const float EPSILON = 1e-3f;
 				aiColor3D refractionColor{}, reflectionColor{};
-				float fresnelResult = mathUtility::fresnel(intersectionInformation.ray.dir, smoothNormal, refractionIndex);
-				bool outside = (intersectionInformation.ray.dir * smoothNormal) < 0;
+				float fresnelResult = mathUtility::fresnel(surface.ray.dir, smoothNormal, refractionIndex);
+				bool outside = (surface.ray.dir * smoothNormal) < 0;
 				aiVector3D bias = this->renderSettings.getBias() * smoothNormal;
 
 				if (fresnelResult < 1.f)
 				{
 					// Ignore total internal reflection
-					aiVector3D refractionDirection = mathUtility::calculateRefractionDirection(intersectionInformation.ray.dir, smoothNormal, refractionIndex);
+					aiVector3D refractionDirection = mathUtility::calculateRefractionDirection(surface.ray.dir, smoothNormal, refractionIndex);
 					refractionDirection.Normalize();
-					aiVector3D refractionPoint = outside ? intersectionInformation.hitPoint - bias : intersectionInformation.hitPoint + bias;
+					aiVector3D refractionPoint = outside ? surface.hitPoint - bias : surface.hitPoint + bias;
 					aiRay refractionRay(refractionPoint, refractionDirection);
 					refractionColor = traceRay(refractionRay, rayDepth + 1) * (1 - fresnelResult);
 				}
@@ -372,9 +663,9 @@ namespace raytracing
 				if ((fresnelResult > EPSILON) && (reflectivity > 0.f))
 				{
 					// Surface also is reflective. Cast reflection ray and blend color with fresnel
-					aiVector3D reflectionDirection = mathUtility::calculateReflectionDirection(intersectionInformation.ray.dir, smoothNormal);
+					aiVector3D reflectionDirection = mathUtility::calculateReflectionDirection(surface.ray.dir, smoothNormal);
 					reflectionDirection.Normalize();
-					aiVector3D reflectionPoint = outside ? intersectionInformation.ray.pos + bias : intersectionInformation.ray.pos - bias;
+					aiVector3D reflectionPoint = outside ? surface.ray.pos + bias : surface.ray.pos - bias;
 					aiRay reflectionRay(reflectionPoint, reflectionDirection);
 					reflectionColor = traceRay(reflectionRay, rayDepth + 1) * fresnelResult * reflectivity;
 				}
@@ -385,36 +676,38 @@ namespace raytracing
 			else if (reflectivity > 0.f)
 			{
 				// Surface only is reflective. Cast reflection ray and calculate color at reflection
-				aiVector3D reflectionDirection = mathUtility::calculateReflectionDirection(intersectionInformation.ray.dir, smoothNormal);
-				aiVector3D reflectionPoint = intersectionInformation.hitPoint + (smoothNormal * this->renderSettings.getBias());
+				aiVector3D reflectionDirection = mathUtility::calculateReflectionDirection(surface.ray.dir, smoothNormal);
+				aiVector3D reflectionPoint = surface.hitPoint + (smoothNormal * this->renderSettings.getBias());
 				aiRay reflectionRay(reflectionPoint, reflectionDirection);
 				intersectionColor += traceRay(reflectionRay, rayDepth + 1) * reflectivity;
 			}
 
 			// Calculate surface color
-			for (unsigned int currentLight = 0; currentLight < scene->mNumLights; currentLight++)
+			for (const SceneLight& light : this->database.getLights())
 			{
-				aiLight* light = this->scene->mLights[currentLight];
 				aiVector3D lightDirection;
 				aiColor3D lightIntensity;
+				// Directional lights are occluded by anything along the ray
+				bool isPointLight{ false };
 
-				if (light->mType == aiLightSourceType::aiLightSource_POINT)
+				if (light.type == aiLightSourceType::aiLightSource_POINT)
 				{
-					lightDirection = (light->mPosition - intersectionInformation.hitPoint);
+					lightDirection = (light.position - surface.hitPoint);
 					float distance = lightDirection.Length();
 					float squareDistance = lightDirection.SquareLength();
 					lightDirection.Normalize();
-					float attConst = light->mAttenuationConstant;
-					float attLinear = light->mAttenuationLinear;
-					float attQuad = light->mAttenuationQuadratic;
+					float attConst = light.attenuationConstant;
+					float attLinear = light.attenuationLinear;
+					float attQuad = light.attenuationQuadratic;
 					float attenuation = 1 / (attConst + attLinear * distance + attQuad * squareDistance);
-					lightIntensity = light->mColorDiffuse * attenuation;
+					lightIntensity = light.colorDiffuse * attenuation;
+					isPointLight = true;
 				}
-				else if (light->mType == aiLightSourceType::aiLightSource_DIRECTIONAL)
+				else if (light.type == aiLightSourceType::aiLightSource_DIRECTIONAL)
 				{
-					lightDirection = -light->mDirection;
+					lightDirection = -light.direction;
 					lightDirection.Normalize();
-					lightIntensity = light->mColorDiffuse;
+					lightIntensity = light.colorDiffuse;
 				}
 				else
 				{
@@ -422,11 +715,16 @@ namespace raytracing
 					continue;
 				}
 
-				aiRay shadowRay(intersectionInformation.hitPoint + (smoothNormal * this->renderSettings.getBias()), lightDirection, RayType::SHADOW);
-				IntersectionInformation shadowRayIntersectionInfo;
+				aiRay shadowRay(surface.hitPoint + (smoothNormal * this->renderSettings.getBias()), lightDirection, RayType::SHADOW);
 #if USE_ACCELERATION_STRUCTURE
-				bool pointInShadow = !this->accelerationStructure->calculateIntersection(shadowRay, &shadowRayIntersectionInfo);
+				// Objects behind a point light do not cast shadows. The direction is normalized, so the
+				// ray parameter equals the distance.
+				const float lightDistance = isPointLight ?
+					(light.position - shadowRay.pos).Length() :
+					std::numeric_limits<float>::infinity();
+				bool pointInShadow = !this->accelerationStructure->occluded(shadowRay, lightDistance);
 #else
+				IntersectionInformation shadowRayIntersectionInfo;
 				bool pointInShadow = !calculateIntersection(shadowRay, shadowRayIntersectionInfo);
 #endif
 				intersectionColor += materialColorDiffuse * pointInShadow * lightIntensity * std::max(0.f, smoothNormal * lightDirection) * (1 - reflectivity) * opacity;
@@ -450,64 +748,46 @@ namespace raytracing
 		IntersectionInformation& outIntersection)
 	{
 		bool intersects{ false };
-		std::vector<aiVector3D*> nearestIntersectedTriangle;
-		std::vector<aiVector3D*> triangleVertexNormals;
-		std::vector<aiVector3D*> textureCoordinates;
+		aiVector3D vertices[3];
+		std::vector<aiVector3D*> triangle{ &vertices[0], &vertices[1], &vertices[2] };
 		aiVector3D intersectionPoint;
 		aiVector2D uvCoordinates;
-		// Iterate through meshes and faces and check for  ray-triangle intersections
-		for (unsigned int currentMesh = 0; currentMesh < this->scene->mNumMeshes; currentMesh++)
+		// Iterate through all triangles and check for ray-triangle intersections
+		for (uint32_t currentTriangle = 0; currentTriangle < this->database.getTriangleCount(); currentTriangle++)
 		{
-			aiString name = this->scene->mMeshes[currentMesh]->mName;
-			aiMesh* mesh = this->scene->mMeshes[currentMesh];
-
-			for (unsigned int currentFace = 0; currentFace < mesh->mNumFaces; currentFace++)
+			for (uint32_t corner = 0; corner < 3; corner++)
 			{
-				aiFace* face = &(mesh->mFaces[currentFace]);
-				for (unsigned int currentIndex = 0; currentIndex < face->mNumIndices; currentIndex++)
-				{
-					nearestIntersectedTriangle.push_back(&(mesh->mVertices[face->mIndices[currentIndex]]));
-					triangleVertexNormals.push_back(&(mesh->mNormals[face->mIndices[currentIndex]]));
-					// Always use first texture channel
-					textureCoordinates.push_back(&(mesh->mTextureCoords[0][face->mIndices[currentIndex]]));
-				}
-				// Evaluate nearest intersection point and return
-				bool intersectsCurrentTriangle = mathUtility::rayTriangleIntersection(ray, nearestIntersectedTriangle, &intersectionPoint, &uvCoordinates);
-				// We can immediately return if the cast ray is a shadow ray
-				if (ray.type == RayType::SHADOW)
-				{
-					return true;
-				}
-				float distanceToIntersectionPoint = (intersectionPoint - ray.pos).Length();
-				if (intersectsCurrentTriangle && (distanceToIntersectionPoint < outIntersection.intersectionDistance))
-				{
-					outIntersection.intersectionDistance = distanceToIntersectionPoint;
-					outIntersection.hitMesh = mesh;
-					outIntersection.hitTriangle = nearestIntersectedTriangle;
-					outIntersection.hitPoint = intersectionPoint;
-					outIntersection.ray = ray;
-					outIntersection.uv = uvCoordinates;
-					// Always use first texture channel
-					if (mesh->HasTextureCoords(0))
-					{
-						outIntersection.uvTextureCoords =
-							(1 - uvCoordinates.x - uvCoordinates.y) *
-							*(textureCoordinates[0]) + uvCoordinates.x *
-							*(textureCoordinates[1]) + uvCoordinates.y *
-							*(textureCoordinates[2]);
-					}
-					outIntersection.vertexNormals = triangleVertexNormals;
-					outIntersection.textureCoordinates = textureCoordinates;
-					intersects = true;
-				}
-				nearestIntersectedTriangle.clear();
-				triangleVertexNormals.clear();
-				textureCoordinates.clear();
+				vertices[corner] = this->database.getVertex(currentTriangle, corner);
+			}
+			// Evaluate nearest intersection point and return
+			bool intersectsCurrentTriangle = mathUtility::rayTriangleIntersection(ray, triangle, &intersectionPoint, &uvCoordinates);
+			// We can immediately return if the cast ray is a shadow ray
+			if (intersectsCurrentTriangle && (ray.type == RayType::SHADOW))
+			{
+				return true;
+			}
+			float distanceToIntersectionPoint = (intersectionPoint - ray.pos).Length();
+			if (intersectsCurrentTriangle && (distanceToIntersectionPoint < outIntersection.intersectionDistance))
+			{
+				outIntersection.intersectionDistance = distanceToIntersectionPoint;
+				outIntersection.triangle = currentTriangle;
+				outIntersection.uv = uvCoordinates;
+				intersects = true;
 			}
 		}
 		return intersects;
 	}
 
+	SurfaceInteraction PathTracer::getSurface(const aiRay& ray, const IntersectionInformation& intersection) const
+	{
+#if USE_ACCELERATION_STRUCTURE
+		return this->accelerationStructure->getSurface(this->database, ray, intersection);
+#else
+		// Meshes are tested in world space without instances
+		return this->database.getSurface(ray, intersection, nullptr);
+#endif
+	}
+
 
 	aiColor3D PathTracer::tracePath(aiRay& ray, uint8_t rayDepth /*= 0*/)
 	{
@@ -525,7 +805,7 @@ namespace raytracing
 		if (intersects)
 		{
 			// Calculate color at the intersection
-			return this->sampleLight(intersectionInformation, rayDepth);
+			return this->sampleLight(this->getSurface(ray, intersectionInformation), rayDepth);
 		}
 		else
 		{
@@ -550,7 +830,7 @@ namespace raytracing
 		if (intersects)
 		{
 			// Calculate color at the intersection
-			return this->shadePixel(intersectionInformation, rayDepth);
+			return this->shadePixel(this->getSurface(ray, intersectionInformation), rayDepth);
 		}
 		else
 		{
@@ -561,18 +841,11 @@ namespace raytracing
 
 	void PathTracer::createJobs()
 	{
-		for (uint16_t numberOfTileY = 0; numberOfTileY < this->renderSettings.getHeight() / TILE_SIZE; numberOfTileY++)
-		{
-			for (uint16_t numberOfTileX = 0; numberOfTileX < this->renderSettings.getWidth() / TILE_SIZE; numberOfTileX++)
-			{
-				RenderJob job(
-					numberOfTileX * this->TILE_SIZE,
-					numberOfTileY * this->TILE_SIZE,
-					numberOfTileX * this->TILE_SIZE + this->TILE_SIZE,
-					numberOfTileY * this->TILE_SIZE + this->TILE_SIZE);
-				this->renderJobs.pushBack(job);
-			}
-		}
+		this->renderJobs.distribute(TileScheduler::createTiles(
+			this->renderSettings.getWidth(),
+			this->renderSettings.getHeight(),
+			TILE_SIZE,
+			this->renderSettings.getTileOrder()));
 	}
 
 } // end of namespace raytracing
\ No newline at end of file
@@ -17,9 +17,11 @@
 #include "Application.hpp"
 #include "raytracing.hpp"
 #include "settings.hpp"
-#include "Types/SynchronizedQueue.hpp"
 #include "Types/RenderJob.hpp"
+#include "Types/TileScheduler.hpp"
 #include "Types/AccelerationStructure.hpp"
+#include "Types/BoundingBox.hpp"
+#include "Types/SceneDatabase.hpp"
 #include "Types/Material.hpp"
 #include "Textures/Texture.hpp"
 
@@ -37,12 +39,18 @@ namespace raytracing
 	{
 		static const uint16_t TILE_SIZE = 32;
 
+		// Pixel block traced as one ray packet: 2x2 pixels for 4 lanes, 4x2 for 8 and 4x4 for 16
+		static const uint16_t PACKET_BLOCK_WIDTH = (RayPacket::WIDTH == 4) ? 2 : 4;
+
+		static const uint16_t PACKET_BLOCK_HEIGHT = RayPacket::WIDTH / PACKET_BLOCK_WIDTH;
+
 		/*--------------------------------< Public methods >------------------------------------*/
 	public:
 
-		PathTracer(Application& app, const aiScene* scene, Settings settings, std::unique_ptr<AccelerationStructure> accStruct):
+		PathTracer(Application& app, const aiScene* scene, const SceneDatabase& database, Settings settings, std::unique_ptr<AccelerationStructure> accStruct):
 			application(app),
 			scene(scene),
+			database(database),
 			renderSettings(settings),
 			accelerationStructure(std::move(accStruct))
 		{
@@ -54,15 +62,17 @@ namespace raytracing
 			delete[] this->pixels;
 		}
 
-		void initialize(const std::string sceneFilePath);
+		// Tiles are scheduled for threadCount render threads
+		void initialize(const std::string sceneFilePath, const uint8_t threadCount);
 
-		void renderMultiThreaded();
+		void renderMultiThreaded(const uint8_t worker);
 
-		std::thread createRenderThread(std::atomic<uint8_t>& threadsTerminated)
+		// Worker is the index of the thread, counting from zero up to the thread count
+		std::thread createRenderThread(const uint8_t worker, std::atomic<uint8_t>& threadsTerminated)
 		{
-			return std::thread([&] 
+			return std::thread([this, worker, &threadsTerminated] 
 			{ 
-				renderMultiThreaded(); 
+				renderMultiThreaded(worker); 
 				threadsTerminated++; 
 			});
 		}
@@ -72,6 +82,16 @@ namespace raytracing
 			return this->pixels;
 		}
 
+		inline const AccelerationStructure& getAccelerationStructure() const
+		{
+			return *this->accelerationStructure;
+		}
+
+		inline const TileScheduler& getTileScheduler() const
+		{
+			return this->renderJobs;
+		}
+
 		/*--------------------------------< Protected methods >---------------------------------*/
 	protected:
 
@@ -84,12 +104,36 @@ namespace raytracing
 
 		void renderAntiAliased(RenderJob& renderJob);
 
-		aiColor3D sampleLight(IntersectionInformation& intersectionInformation, uint8_t rayDepth);
+		// Same as render, but traces the primary rays of pixel blocks as packets
+		void renderPackets(RenderJob& renderJob);
 
-		aiColor3D shadePixel(IntersectionInformation& intersectionInformation, uint8_t& rayDepth);
+		// Same as renderAntiAliased, but traces the sub-samples of every pixel as packets
+		void renderAntiAliasedPackets(RenderJob& renderJob);
+
+		// Intersects up to RayPacket::WIDTH primary rays together and shades every hit on its own
+		void tracePrimaryPacket(const aiRay* rays, const uint32_t rayCount, aiColor3D* outColors);
+
+		// Path traces the tile one bounce at a time. The rays of every bounce are collected for
+		// the whole tile and sorted before they are traced.
+		void renderBatched(RenderJob& renderJob);
+
+		aiColor3D sampleLight(const SurfaceInteraction& surface, uint8_t rayDepth);
+
+		// Samples the direction the path continues in at the intersection. Returns false with the
+		// emitted light if the path ends at an emissive surface.
+		bool scatterRay(
+			const SurfaceInteraction& surface,
+			aiRay* outRay,
+			aiColor3D* outDistributionFunction,
+			aiColor3D* outEmission);
+
+		aiColor3D shadePixel(const SurfaceInteraction& surface, uint8_t& rayDepth);
 
 		bool calculateIntersection(aiRay& ray, IntersectionInformation& outIntersection);
 
+		// Fetches the surface attributes of the closest hit of the ray
+		SurfaceInteraction getSurface(const aiRay& ray, const IntersectionInformation& intersection) const;
+
 		aiColor3D traceRay(aiRay& ray, uint8_t rayDepth = 0);
 		
 		aiColor3D tracePath(aiRay& ray, uint8_t rayDepth = 0);
@@ -110,7 +154,7 @@ namespace raytracing
 		// rrrrrrrr gggggggg bbbbbbbb
 		Uint24* pixels;
 
-		SynchronizedQueue<RenderJob> renderJobs;
+		TileScheduler renderJobs;
 
 		aiVector3D pixelShiftX;
 
@@ -118,10 +162,17 @@ namespace raytracing
 
 		aiVector3D topLeftPixel;
 
+		// Bounds of all meshes, used to sort rays by their origin
+		BoundingBox sceneBounds;
+
 		Application& application;
 
+		// Materials of the imported scene
 		const aiScene* scene;
 
+		// Geometry, lights and cameras read while rendering
+		const SceneDatabase& database;
+
 		const Settings renderSettings;
 
 		std::unique_ptr<AccelerationStructure> accelerationStructure;
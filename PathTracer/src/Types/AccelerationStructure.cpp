@@ -1,9 +1,12 @@
 /*
- * <template>.cpp
+ * AccelerationStructure.cpp
  */
 
 /*--------------------------------< Includes >-------------------------------------------*/
+#include "sdl2/SDL.h"
+
 #include "AccelerationStructure.hpp"
+#include "Utility/Simd.hpp"
 
 
 namespace raytracing
@@ -12,12 +15,329 @@ namespace raytracing
 
 	/*--------------------------------< Typedefs >-------------------------------------------*/
 
+	using utility::SimdFloat;
+
+	// Ray broadcast to all lanes of the intersection kernel
+	struct SimdRay
+	{
+		explicit SimdRay(const aiRay& ray) :
+			directionX(SimdFloat::broadcast(ray.dir.x)),
+			directionY(SimdFloat::broadcast(ray.dir.y)),
+			directionZ(SimdFloat::broadcast(ray.dir.z)),
+			originX(SimdFloat::broadcast(ray.pos.x)),
+			originY(SimdFloat::broadcast(ray.pos.y)),
+			originZ(SimdFloat::broadcast(ray.pos.z))
+		{
+		}
+
+		SimdFloat directionX;
+		SimdFloat directionY;
+		SimdFloat directionZ;
+		SimdFloat originX;
+		SimdFloat originY;
+		SimdFloat originZ;
+	};
+
 	/*--------------------------------< Constants >------------------------------------------*/
+
+	// Same tolerance as mathUtility::rayTriangleIntersection
+	static constexpr float TRIANGLE_EPSILON = 1e-6f;
+
+	/*--------------------------------< Functions >------------------------------------------*/
+
+	// Moeller-Trumbore as in mathUtility::rayTriangleIntersection for all lanes of a packet at once.
+	// Operations are ordered like the scalar version to produce the same results. Returns the mask
+	// of lanes hit in front of the ray origin; t, u and v are only valid for those lanes.
+	static inline uint32_t intersectTrianglePacket(
+		const TrianglePacket& packet,
+		const SimdRay& ray,
+		SimdFloat* outT,
+		SimdFloat* outU,
+		SimdFloat* outV)
+	{
+		const SimdFloat epsilon = SimdFloat::broadcast(TRIANGLE_EPSILON);
+		const SimdFloat negativeEpsilon = SimdFloat::broadcast(-TRIANGLE_EPSILON);
+		const SimdFloat zero = SimdFloat::broadcast(0.f);
+		const SimdFloat one = SimdFloat::broadcast(1.f);
+
+		const SimdFloat edge1X = SimdFloat::load(packet.edge1X);
+		const SimdFloat edge1Y = SimdFloat::load(packet.edge1Y);
+		const SimdFloat edge1Z = SimdFloat::load(packet.edge1Z);
+		const SimdFloat edge2X = SimdFloat::load(packet.edge2X);
+		const SimdFloat edge2Y = SimdFloat::load(packet.edge2Y);
+		const SimdFloat edge2Z = SimdFloat::load(packet.edge2Z);
+
+		const SimdFloat pVecX = ray.directionY * edge2Z - ray.directionZ * edge2Y;
+		const SimdFloat pVecY = ray.directionZ * edge2X - ray.directionX * edge2Z;
+		const SimdFloat pVecZ = ray.directionX * edge2Y - ray.directionY * edge2X;
+		const SimdFloat determinant = edge1X * pVecX + edge1Y * pVecY + edge1Z * pVecZ;
+		// Reject rays parallel to the triangle
+		uint32_t hitMask = (determinant <= negativeEpsilon) | (determinant >= epsilon);
+		if (hitMask == 0)
+		{
+			return 0;
+		}
+
+		const SimdFloat invDet = one / determinant;
+		const SimdFloat tVecX = ray.originX - SimdFloat::load(packet.vertex0X);
+		const SimdFloat tVecY = ray.originY - SimdFloat::load(packet.vertex0Y);
+		const SimdFloat tVecZ = ray.originZ - SimdFloat::load(packet.vertex0Z);
+		const SimdFloat u = (invDet * tVecX) * pVecX + (invDet * tVecY) * pVecY + (invDet * tVecZ) * pVecZ;
+		hitMask &= (u >= zero) & (u <= one);
+		if (hitMask == 0)
+		{
+			return 0;
+		}
+
+		const SimdFloat qVecX = tVecY * edge1Z - tVecZ * edge1Y;
+		const SimdFloat qVecY = tVecZ * edge1X - tVecX * edge1Z;
+		const SimdFloat qVecZ = tVecX * edge1Y - tVecY * edge1X;
+		const SimdFloat v = (invDet * ray.directionX) * qVecX + (invDet * ray.directionY) * qVecY + (invDet * ray.directionZ) * qVecZ;
+		hitMask &= (v >= zero) & ((u + v) <= one);
+		if (hitMask == 0)
+		{
+			return 0;
+		}
+
+		const SimdFloat t = (invDet * edge2X) * qVecX + (invDet * edge2Y) * qVecY + (invDet * edge2Z) * qVecZ;
+		// Line intersections behind the ray origin do not count
+		hitMask &= (t > epsilon);
+
+		*outT = t;
+		*outU = u;
+		*outV = v;
+		return hitMask;
+	}
 		
 	/*--------------------------------< Public members >-------------------------------------*/
+
+	void AccelerationStructure::logStatistics() const
+	{
+#if COLLECT_TRAVERSAL_STATISTICS
+		const uint64_t rays = this->statistics.getRays();
+		if (rays == 0)
+		{
+			return;
+		}
+		const double nodesVisited = static_cast<double>(this->statistics.getNodesVisited());
+		const double trianglesTested = static_cast<double>(this->statistics.getTrianglesTested());
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Traversal statistics: %llu rays, %.2f nodes visited per ray, %.2f triangles tested per ray",
+			static_cast<unsigned long long>(rays),
+			nodesVisited / rays,
+			trianglesTested / rays);
+#endif
+	}
+		
+	uint32_t AccelerationStructure::intersectPacket(const aiRay* rays, const uint32_t rayCount, IntersectionInformation* outIntersections)
+	{
+		uint32_t hitMask{ 0 };
+		for (uint32_t i = 0; i < rayCount; i++)
+		{
+			if (this->calculateIntersection(rays[i], &outIntersections[i]))
+			{
+				hitMask |= 1U << i;
+			}
+		}
+		return hitMask;
+	}
 		
 	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*static*/ bool AccelerationStructure::loadRayPacket(
+		const aiRay* rays,
+		const uint32_t rayCount,
+		const IntersectionInformation* intersections,
+		RayPacket* outPacket)
+	{
+		if ((rayCount == 0) || (rayCount > RayPacket::WIDTH))
+		{
+			return false;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			// Zero components are excluded as well, their slab tests depend on the ray origin
+			const bool positive = rays[0].dir[k] > 0.f;
+			for (uint32_t i = 0; i < rayCount; i++)
+			{
+				if (positive ? !(rays[i].dir[k] > 0.f) : !(rays[i].dir[k] < 0.f))
+				{
+					return false;
+				}
+			}
+		}
+
+		// Lanes without a ray repeat the first one, so they never produce NaNs
+		for (uint32_t lane = 0; lane < RayPacket::WIDTH; lane++)
+		{
+			const uint32_t i = (lane < rayCount) ? lane : 0;
+			const aiRay& ray = rays[i];
+			outPacket->originX[lane] = ray.pos.x;
+			outPacket->originY[lane] = ray.pos.y;
+			outPacket->originZ[lane] = ray.pos.z;
+			outPacket->inverseDirectionX[lane] = 1.f / ray.dir.x;
+			outPacket->inverseDirectionY[lane] = 1.f / ray.dir.y;
+			outPacket->inverseDirectionZ[lane] = 1.f / ray.dir.z;
+			outPacket->directionLength[lane] = ray.dir.Length();
+			outPacket->tMax[lane] = intersections[i].intersectionDistance / outPacket->directionLength[lane];
+		}
+		outPacket->activeMask = (1U << rayCount) - 1;
+		return true;
+	}
+
+	/*static*/ void AccelerationStructure::appendTrianglePackets(
+		const std::vector<KdTriangle>& triangles,
+		const uint32_t* triangleIds,
+		const uint32_t triangleCount,
+		TrianglePacketArray* outPackets)
+	{
+		for (uint32_t first = 0; first < triangleCount; first += TrianglePacket::WIDTH)
+		{
+			// Unused lanes keep zero edges, which the kernel rejects as parallel to every ray
+			TrianglePacket packet{};
+			for (uint32_t lane = 0; lane < TrianglePacket::WIDTH; lane++)
+			{
+				if (first + lane >= triangleCount)
+				{
+					packet.triangle[lane] = TrianglePacket::EMPTY;
+					continue;
+				}
+
+				setTriangle(triangles, triangleIds[first + lane], lane, &packet);
+			}
+			outPackets->push_back(packet);
+		}
+	}
+
+	/*static*/ BoundingBox AccelerationStructure::refreshTrianglePackets(
+		const std::vector<KdTriangle>& triangles,
+		TrianglePacket* packets,
+		const uint32_t triangleCount)
+	{
+		BoundingBox bounds;
+		const uint32_t packetCount = TrianglePacket::getPacketCount(triangleCount);
+		for (uint32_t currentPacket = 0; currentPacket < packetCount; currentPacket++)
+		{
+			TrianglePacket& packet = packets[currentPacket];
+			for (uint32_t lane = 0; lane < TrianglePacket::WIDTH; lane++)
+			{
+				const uint32_t triangleId = packet.triangle[lane];
+				if (triangleId == TrianglePacket::EMPTY)
+				{
+					continue;
+				}
+				setTriangle(triangles, triangleId, lane, &packet);
+				bounds.extend(BoundingBox(triangles[triangleId]));
+			}
+		}
+		return bounds;
+	}
+
+	bool AccelerationStructure::intersectTriangles(
+		const std::vector<KdTriangle>& triangles,
+		const TrianglePacket* packets,
+		const uint32_t triangleCount,
+		const aiRay& ray,
+		IntersectionInformation* outIntersection) const
+	{
+		const SimdRay simdRay(ray);
+
+		alignas(sizeof(float) * TrianglePacket::WIDTH) float tValues[TrianglePacket::WIDTH];
+		alignas(sizeof(float) * TrianglePacket::WIDTH) float uValues[TrianglePacket::WIDTH];
+		alignas(sizeof(float) * TrianglePacket::WIDTH) float vValues[TrianglePacket::WIDTH];
+
+		// Hit distances are measured in world space, the packets report the ray parameter
+		const float directionLength = ray.dir.Length();
+		uint32_t nearestTriangle{ TrianglePacket::EMPTY };
+		float nearestDistance{ outIntersection->intersectionDistance };
+		aiVector2D nearestUV;
+
+		const uint32_t packetCount = TrianglePacket::getPacketCount(triangleCount);
+		for (uint32_t currentPacket = 0; currentPacket < packetCount; currentPacket++)
+		{
+			const TrianglePacket& packet = packets[currentPacket];
+			SimdFloat t, u, v;
+			const uint32_t hitMask = intersectTrianglePacket(packet, simdRay, &t, &u, &v);
+			if (hitMask == 0)
+			{
+				continue;
+			}
+
+			t.store(tValues);
+			u.store(uValues);
+			v.store(vValues);
+			for (uint32_t lane = 0; lane < TrianglePacket::WIDTH; lane++)
+			{
+				if ((hitMask & (1U << lane)) == 0)
+				{
+					continue;
+				}
+				const float distanceToIntersectionPoint = tValues[lane] * directionLength;
+				if (distanceToIntersectionPoint < nearestDistance)
+				{
+					nearestTriangle = packet.triangle[lane];
+					nearestDistance = distanceToIntersectionPoint;
+					nearestUV = aiVector2D(uValues[lane], vValues[lane]);
+				}
+			}
+		}
+
+		if (nearestTriangle == TrianglePacket::EMPTY)
+		{
+			return false;
+		}
+
+		outIntersection->intersectionDistance = nearestDistance;
+		outIntersection->uv = nearestUV;
+		outIntersection->triangle = triangles[nearestTriangle].triangle;
+		return true;
+	}
+
+	bool AccelerationStructure::occludedTriangles(
+		const TrianglePacket* packets,
+		const uint32_t triangleCount,
+		const aiRay& ray,
+		const float tMax) const
+	{
+		const SimdRay simdRay(ray);
+		const SimdFloat tLimit = SimdFloat::broadcast(tMax);
+
+		const uint32_t packetCount = TrianglePacket::getPacketCount(triangleCount);
+		for (uint32_t currentPacket = 0; currentPacket < packetCount; currentPacket++)
+		{
+			SimdFloat t, u, v;
+			const uint32_t hitMask = intersectTrianglePacket(packets[currentPacket], simdRay, &t, &u, &v);
+			if ((hitMask != 0) && ((hitMask & (t < tLimit)) != 0))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
 		
 	/*--------------------------------< Private members >------------------------------------*/
+
+	/*static*/ void AccelerationStructure::setTriangle(
+		const std::vector<KdTriangle>& triangles,
+		const uint32_t triangleId,
+		const uint32_t lane,
+		TrianglePacket* outPacket)
+	{
+		const KdTriangle& triangle = triangles[triangleId];
+		const aiVector3D vertex0 = triangle.getVertex(0);
+		const aiVector3D edge1 = triangle.getVertex(1) - vertex0;
+		const aiVector3D edge2 = triangle.getVertex(2) - vertex0;
+
+		outPacket->vertex0X[lane] = vertex0.x;
+		outPacket->vertex0Y[lane] = vertex0.y;
+		outPacket->vertex0Z[lane] = vertex0.z;
+		outPacket->edge1X[lane] = edge1.x;
+		outPacket->edge1Y[lane] = edge1.y;
+		outPacket->edge1Z[lane] = edge1.z;
+		outPacket->edge2X[lane] = edge2.x;
+		outPacket->edge2Y[lane] = edge2.y;
+		outPacket->edge2Z[lane] = edge2.z;
+		outPacket->triangle[lane] = triangleId;
+	}
 	
 } // end of namespace raytracer
\ No newline at end of file
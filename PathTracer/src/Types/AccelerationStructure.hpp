@@ -1,11 +1,19 @@
 /*
- * <template>.hpp
+ * AccelerationStructure.hpp
  */
 
 #pragma once
 
 /*--------------------------------< Includes >-------------------------------------------*/
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
 #include "raytracing.hpp"
+#include "settings.hpp"
+#include "BoundingBox.hpp"
+#include "SceneDatabase.hpp"
+#include "Utility/AlignedAllocator.hpp"
 
 #include "assimp/camera.h"
 
@@ -16,6 +24,146 @@ namespace raytracing
 
 	/*--------------------------------< Typedefs >------------------------------------------*/
 
+	// Work done by all intersection queries of an acceleration structure. Every thread counts
+	// into a slot on its own cache line, so render threads do not contend on the counters. The
+	// slots are only summed up when the counters are read.
+	struct TraversalStatistics
+	{
+		// Threads beyond this share slots, which stays correct but contends again
+		static constexpr uint32_t SLOTS = 32;
+
+		struct alignas(64) Counters
+		{
+			std::atomic<uint64_t> rays{ 0 };
+
+			std::atomic<uint64_t> nodesVisited{ 0 };
+
+			std::atomic<uint64_t> trianglesTested{ 0 };
+		};
+
+		inline void record(const uint64_t nodes, const uint64_t triangles, const uint64_t rayCount)
+		{
+			Counters& counters = this->slots[getThreadSlot()];
+			counters.rays.fetch_add(rayCount, std::memory_order_relaxed);
+			counters.nodesVisited.fetch_add(nodes, std::memory_order_relaxed);
+			counters.trianglesTested.fetch_add(triangles, std::memory_order_relaxed);
+		}
+
+		inline uint64_t getRays() const
+		{
+			return this->sum(&Counters::rays);
+		}
+
+		inline uint64_t getNodesVisited() const
+		{
+			return this->sum(&Counters::nodesVisited);
+		}
+
+		inline uint64_t getTrianglesTested() const
+		{
+			return this->sum(&Counters::trianglesTested);
+		}
+
+		// Slot of the calling thread, assigned on its first query
+		static inline uint32_t getThreadSlot()
+		{
+			static std::atomic<uint32_t> nextSlot{ 0 };
+			thread_local const uint32_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % SLOTS;
+			return slot;
+		}
+
+		inline uint64_t sum(std::atomic<uint64_t> Counters::* counter) const
+		{
+			uint64_t total{ 0 };
+			for (const Counters& counters : this->slots)
+			{
+				total += (counters.*counter).load(std::memory_order_relaxed);
+			}
+			return total;
+		}
+
+		Counters slots[SLOTS];
+	};
+
+	// TRIANGLE_PACKET_WIDTH triangles as read by the intersection kernel, stored as structure
+	// of arrays. Acceleration structures store the packets of every leaf contiguously in leaf
+	// order, so leaf tests never touch the scene meshes. Unused lanes hold a degenerate triangle.
+	struct alignas(sizeof(float) * TRIANGLE_PACKET_WIDTH) TrianglePacket
+	{
+		static constexpr uint32_t WIDTH = TRIANGLE_PACKET_WIDTH;
+
+		// Marks an unused lane
+		static constexpr uint32_t EMPTY = UINT32_MAX;
+
+		static inline uint32_t getPacketCount(const uint32_t triangleCount)
+		{
+			return (triangleCount + WIDTH - 1) / WIDTH;
+		}
+
+		float vertex0X[WIDTH];
+
+		float vertex0Y[WIDTH];
+
+		float vertex0Z[WIDTH];
+
+		float edge1X[WIDTH];
+
+		float edge1Y[WIDTH];
+
+		float edge1Z[WIDTH];
+
+		float edge2X[WIDTH];
+
+		float edge2Y[WIDTH];
+
+		float edge2Z[WIDTH];
+
+		// Index into the triangles the structure was built from
+		uint32_t triangle[WIDTH];
+	};
+
+	typedef std::vector<TrianglePacket, utility::AlignedAllocator<TrianglePacket>> TrianglePacketArray;
+
+	// Up to TRIANGLE_PACKET_WIDTH rays traversed together, stored as structure of arrays so every
+	// node is tested against all rays at once. Lanes without a ray are inactive.
+	struct alignas(sizeof(float) * TRIANGLE_PACKET_WIDTH) RayPacket
+	{
+		static constexpr uint32_t WIDTH = TRIANGLE_PACKET_WIDTH;
+
+		// Index of the lowest lane set in a non-empty mask
+		static inline uint32_t getLowestLane(uint32_t mask)
+		{
+			uint32_t lane{ 0 };
+			while ((mask & 1U) == 0)
+			{
+				mask >>= 1;
+				lane++;
+			}
+			return lane;
+		}
+
+		float originX[WIDTH];
+
+		float originY[WIDTH];
+
+		float originZ[WIDTH];
+
+		float inverseDirectionX[WIDTH];
+
+		float inverseDirectionY[WIDTH];
+
+		float inverseDirectionZ[WIDTH];
+
+		// Ray parameter of the closest hit found so far
+		float tMax[WIDTH];
+
+		// Length of the ray directions, to convert between the ray parameter and hit distances
+		float directionLength[WIDTH];
+
+		// One bit per lane holding a ray
+		uint32_t activeMask;
+	};
+
 	/*--------------------------------< Constants >-----------------------------------------*/
 
 	class AccelerationStructure
@@ -23,13 +171,122 @@ namespace raytracing
 	/*--------------------------------< Public methods >------------------------------------*/
 	public:
 
+		virtual ~AccelerationStructure() = default;
+
 		virtual bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) = 0;
+
+		// Any-hit query for shadow rays. Returns true if a triangle is hit in front of the ray origin
+		// closer than tMax, measured in units of the ray direction. No hit information is gathered.
+		virtual bool occluded(const aiRay& ray, const float tMax) = 0;
+
+		// Closest hit query for up to TRIANGLE_PACKET_WIDTH coherent rays, such as primary rays of
+		// neighbouring pixels. Every intersection is updated like by calculateIntersection. Returns
+		// a bit mask of the rays that hit. The default traces the rays one by one.
+		virtual uint32_t intersectPacket(const aiRay* rays, const uint32_t rayCount, IntersectionInformation* outIntersections);
+
+		// Bytes held by the structure including the triangles it references
+		virtual size_t getMemoryFootprint() const = 0;
+
+		// Fetches the surface attributes of a hit reported by one of the closest hit queries
+		inline SurfaceInteraction getSurface(const SceneDatabase& database, const aiRay& ray, const IntersectionInformation& intersection) const
+		{
+			return database.getSurface(
+				ray,
+				intersection,
+				(intersection.instance == IntersectionInformation::NO_INSTANCE) ? nullptr : this->getNormalTransform(intersection.instance));
+		}
+
+		// Updates the bounds after the vertices of the triangles moved while their faces stayed
+		// the same. Returns false if the structure cannot be refit and has to be rebuilt instead.
+		virtual bool refit()
+		{
+			return false;
+		}
+
+		inline const TraversalStatistics& getStatistics() const
+		{
+			return this->statistics;
+		}
+
+		void logStatistics() const;
 	
 	/*--------------------------------< Protected methods >---------------------------------*/
 	protected:
 
+		// Maps normals of an instance reported in a hit to world space. Only structures placing
+		// instances report them.
+		virtual const aiMatrix3x3* getNormalTransform(const uint32_t /*instance*/) const
+		{
+			return nullptr;
+		}
+
+		// Accumulates the counters of a single query or ray packet into the slot of the calling thread
+		inline void recordTraversal(const uint64_t nodesVisited, const uint64_t trianglesTested, const uint64_t rays = 1)
+		{
+#if COLLECT_TRAVERSAL_STATISTICS
+			if (this->ownerStatistics != nullptr)
+			{
+				// The rays were already counted by the owner when they entered it
+				this->ownerStatistics->record(nodesVisited, trianglesTested, 0);
+				return;
+			}
+			this->statistics.record(nodesVisited, trianglesTested, rays);
+#endif
+		}
+
+		// Makes a structure traversed by this one, such as a bottom level, count its nodes and
+		// triangles into the statistics of this one
+		inline void countTraversalsOf(AccelerationStructure& nested)
+		{
+			nested.ownerStatistics = &this->statistics;
+		}
+
+		// Fills the packet with the rays, limited to the closest hits of the intersections. Returns
+		// false if the rays are not coherent enough for packet traversal: their directions have to
+		// share the sign of every component, so all of them visit the children in the same order.
+		static bool loadRayPacket(
+			const aiRay* rays,
+			const uint32_t rayCount,
+			const IntersectionInformation* intersections,
+			RayPacket* outPacket);
+
+		// Packs the given triangles into as few packets as possible and appends them
+		static void appendTrianglePackets(
+			const std::vector<KdTriangle>& triangles,
+			const uint32_t* triangleIds,
+			const uint32_t triangleCount,
+			TrianglePacketArray* outPackets);
+
+		// Reloads the vertex positions of the packets and returns the bounds of their triangles
+		static BoundingBox refreshTrianglePackets(
+			const std::vector<KdTriangle>& triangles,
+			TrianglePacket* packets,
+			const uint32_t triangleCount);
+
+		// Tests all triangles of the packets and updates the intersection if a closer hit is found
+		bool intersectTriangles(
+			const std::vector<KdTriangle>& triangles,
+			const TrianglePacket* packets,
+			const uint32_t triangleCount,
+			const aiRay& ray,
+			IntersectionInformation* outIntersection) const;
+
+		// Returns true as soon as any triangle of the packets is hit at a ray parameter in (0, tMax)
+		bool occludedTriangles(
+			const TrianglePacket* packets,
+			const uint32_t triangleCount,
+			const aiRay& ray,
+			const float tMax) const;
+
 	/*--------------------------------< Private methods >-----------------------------------*/
 	private:
+
+		// Stores the vertex and edges of a triangle in a lane of the packet
+		static void setTriangle(
+			const std::vector<KdTriangle>& triangles,
+			const uint32_t triangleId,
+			const uint32_t lane,
+			TrianglePacket* outPacket);
 	
 	/*--------------------------------< Public members >------------------------------------*/
 	public:
@@ -40,6 +297,11 @@ namespace raytracing
 	/*--------------------------------< Private members >-----------------------------------*/
 	private:
 
+		TraversalStatistics statistics;
+
+		// Statistics of the structure this one is nested in, null for a top level structure
+		TraversalStatistics* ownerStatistics{ nullptr };
+
 	};
 	
 } // end of namespace raytracer
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <iostream>
 
 #include "BoundingBox.hpp"
+#include "SceneDatabase.hpp"
 
 
 namespace raytracing
@@ -49,54 +50,25 @@ namespace raytracing
 		this->containedMesh = mesh;
 	}
 
-	BoundingBox::BoundingBox(std::vector<KdTriangle>& triangles)
+	BoundingBox::BoundingBox(const std::vector<KdTriangle>& triangles)
 	{
-		aiVector3D meshMin{ std::numeric_limits<float>::max() };
-		aiVector3D meshMax{ -std::numeric_limits<float>::max() };
-		
-		for (KdTriangle& currentPair : triangles)
+		this->reset();
+		for (const KdTriangle& triangle : triangles)
 		{
-			aiFace* triangle{ currentPair.faceMeshPair.first };
-			aiMesh* associatedMesh{ currentPair.faceMeshPair.second };
-
-			for (unsigned int currentIndex = 0; currentIndex < triangle->mNumIndices; currentIndex++)
+			for (uint32_t corner = 0; corner < 3; corner++)
 			{
-				aiVector3D& vertex = associatedMesh->mVertices[triangle->mIndices[currentIndex]];
-				meshMin.x = meshMin.x < vertex.x ? meshMin.x : vertex.x;
-				meshMin.y = meshMin.y < vertex.y ? meshMin.y : vertex.y;
-				meshMin.z = meshMin.z < vertex.z ? meshMin.z : vertex.z;
-
-				meshMax.x = meshMax.x < vertex.x ? vertex.x : meshMax.x;
-				meshMax.y = meshMax.y < vertex.y ? vertex.y : meshMax.y;
-				meshMax.z = meshMax.z < vertex.z ? vertex.z : meshMax.z;
+				this->extend(triangle.getVertex(corner));
 			}
-			this->min = meshMin;
-			this->max = meshMax;
 		}
 	}
 
 	BoundingBox::BoundingBox(const KdTriangle& triangle)
 	{
-		aiVector3D triMin{ std::numeric_limits<float>::max() };
-		aiVector3D triMax{ -std::numeric_limits<float>::max() };
-
-		aiFace* tri = triangle.faceMeshPair.first;
-		aiMesh* associatedMesh = triangle.faceMeshPair.second;
-
-		for (unsigned int currentIndex = 0; currentIndex < tri->mNumIndices; currentIndex++)
+		this->reset();
+		for (uint32_t corner = 0; corner < 3; corner++)
 		{
-			aiVector3D& vertex = associatedMesh->mVertices[tri->mIndices[currentIndex]];
-			triMin.x = triMin.x < vertex.x ? triMin.x : vertex.x;
-			triMin.y = triMin.y < vertex.y ? triMin.y : vertex.y;
-			triMin.z = triMin.z < vertex.z ? triMin.z : vertex.z;
-
-			triMax.x = triMax.x < vertex.x ? vertex.x : triMax.x;
-			triMax.y = triMax.y < vertex.y ? vertex.y : triMax.y;
-			triMax.z = triMax.z < vertex.z ? vertex.z : triMax.z;
+			this->extend(triangle.getVertex(corner));
 		}
-
-		this->min = triMin;
-		this->max = triMax;
 	}
 
 	BoundingBox::BoundingBox(std::pair<aiFace*, aiMesh*>& triangle)
@@ -237,6 +209,23 @@ namespace raytracing
 		return tMaximum >= tMinimum;
 	}
 
+	bool BoundingBox::intersects(const aiRay& ray, float* outTMin, float* outTMax) const
+	{
+		aiVector3D tMin((this->min - ray.pos) / ray.dir);
+		aiVector3D tMax((this->max - ray.pos) / ray.dir);
+		float tMinimum = std::min(tMin[0], tMax[0]);
+		float tMaximum = std::max(tMin[0], tMax[0]);
+
+		tMinimum = std::max(tMinimum, std::min(tMin[1], tMax[1]));
+		tMaximum = std::min(tMaximum, std::max(tMin[1], tMax[1]));
+		tMinimum = std::max(tMinimum, std::min(tMin[2], tMax[2]));
+		tMaximum = std::min(tMaximum, std::max(tMin[2], tMax[2]));
+
+		*outTMin = std::max(tMinimum, 0.f);
+		*outTMax = tMaximum;
+		return (tMaximum >= tMinimum) && (tMaximum >= 0.f);
+	}
+
 	const float BoundingBox::getSurfaceArea() const
 	{
 		aiVector3D length = this->max - this->min;
@@ -296,6 +285,24 @@ namespace raytracing
 		}
 	}
 
+	void BoundingBox::extend(const BoundingBox& box)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			this->min[k] = std::min(this->min[k], box.min[k]);
+			this->max[k] = std::max(this->max[k], box.max[k]);
+		}
+	}
+
+	void BoundingBox::extend(const aiVector3D& point)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			this->min[k] = std::min(this->min[k], point[k]);
+			this->max[k] = std::max(this->max[k], point[k]);
+		}
+	}
+
 	/*--------------------------------< Protected members >----------------------------------*/
 		
 	/*--------------------------------< Private members >------------------------------------*/
@@ -34,7 +34,7 @@ namespace raytracing
 
 		BoundingBox(aiMesh* mesh);
 
-		BoundingBox(std::vector<KdTriangle>& triangles);
+		BoundingBox(const std::vector<KdTriangle>& triangles);
 		
 		BoundingBox(const KdTriangle& triangles);
 
@@ -72,6 +72,10 @@ namespace raytracing
 
 		bool intersects(const aiRay& ray) const;
 
+		// Clips the ray against the box. Returns the parametric entry and exit distance of the ray
+		// while only accepting intersections in front of the ray origin.
+		bool intersects(const aiRay& ray, float* outTMin, float* outTMax) const;
+
 		inline const aiVector3D& getMin() const
 		{
 			return this->min;
@@ -105,6 +109,11 @@ namespace raytracing
 
 		void clipToBox(const BoundingBox& box);
 
+		// Grows the box to enclose the given box or point
+		void extend(const BoundingBox& box);
+
+		void extend(const aiVector3D& point);
+
 	/*--------------------------------< Protected methods >---------------------------------*/
 	protected:
 	
@@ -1,11 +1,10 @@
 /*
- * <template>.cpp
+ * BoundingVolume.cpp
  */
 
 /*--------------------------------< Includes >-------------------------------------------*/
 #include "BoundingVolume.hpp"
-
-#include "Utility/mathUtility.hpp"
+#include "exceptions.hpp"
 
 
 namespace raytracing
@@ -14,89 +13,88 @@ namespace raytracing
 
 	/*--------------------------------< Typedefs >-------------------------------------------*/
 
-	using namespace utility;
-
 	/*--------------------------------< Constants >------------------------------------------*/
 		
 	/*--------------------------------< Public members >-------------------------------------*/
 
-	void BoundingVolume::initialize(const aiScene* scene)
+	/*static*/ BoundingVolume* BoundingVolume::build(const SceneDatabase& database)
 	{
-		if (scene->HasMeshes())
+		std::unique_ptr<BoundingVolume> structure(new BoundingVolume());
+		for (uint32_t currentMesh = 0; currentMesh < database.getMeshCount(); currentMesh++)
 		{
-			aiMesh** meshes = scene->mMeshes;
-			unsigned int numberOfMeshes = scene->mNumMeshes;
-			for (unsigned int currentMesh = 0; currentMesh < numberOfMeshes; currentMesh++)
+			if (database.getMeshTriangleCount(currentMesh) == 0)
 			{
-				aiMesh* mesh = meshes[currentMesh];
-				this->bBoxes.push_back(
-					std::unique_ptr<BoundingBox>(new raytracing::BoundingBox(mesh)));
+				// Points, lines and faces with more than 3 edges are not part of the database
+				continue;
 			}
+			structure->bBoxes.push_back(database.getMeshBounds(currentMesh));
+			structure->meshHierarchies.emplace_back(BoundingVolumeHierarchy::build(database.getMeshTriangles(currentMesh)));
+			structure->countTraversalsOf(*structure->meshHierarchies.back());
+		}
+		if (structure->meshHierarchies.empty())
+		{
+			throw AccStructure("Cannot build a bounding volume without triangle meshes");
 		}
+
+		// Leaves of the top level reference meshes instead of triangles
+		structure->topLevel.reset(new BoundingVolumeHierarchy(std::vector<KdTriangle>()));
+		structure->topLevel->buildNodes(structure->bBoxes);
+
+		return structure.release();
 	}
 
 	bool BoundingVolume::calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection)
 	{
-		float leastDistanceIntersection{ std::numeric_limits<float>::max() };
-		std::vector<aiVector3D*> nearestIntersectedTriangle;
-		std::vector<aiVector3D*> triangleVertexNormals;
-		std::vector<aiVector3D*> textureCoordinates;
-		aiVector3D intersectionPoint;
-		aiVector2D uvCoordinates;
+		// Mesh hierarchies report world space distances, the nodes are clipped with the ray parameter
+		const float directionLength = ray.dir.Length();
 		bool intersects{ false };
 
-		for (std::unique_ptr<BoundingBox>& box : this->bBoxes)
-		{
-			if (box->intersects(ray))
+		const uint64_t nodesVisited = this->topLevel->traverseLeaves(ray, outIntersection->intersectionDistance / directionLength,
+			[&](const uint32_t mesh, float* tMax)
 			{
-				const aiMesh* intersectedMesh = box->getContainedMesh();
-				for (unsigned int currentFace = 0; currentFace < intersectedMesh->mNumFaces; currentFace++)
+				// Every mesh hierarchy only reports hits closer than the current one
+				if (this->meshHierarchies[mesh]->calculateIntersection(ray, outIntersection))
 				{
-					aiFace* face = &(intersectedMesh->mFaces[currentFace]);
-					for (unsigned int currentIndex = 0; currentIndex < face->mNumIndices; currentIndex++)
-					{
-						nearestIntersectedTriangle.push_back(&(intersectedMesh->mVertices[face->mIndices[currentIndex]]));
-						triangleVertexNormals.push_back(&(intersectedMesh->mNormals[face->mIndices[currentIndex]]));
-						textureCoordinates.push_back(&(intersectedMesh->mTextureCoords[0][face->mIndices[currentIndex]]));
-					}
-					// Evaluate nearest intersection point and return
-					bool intersectsCurrentTriangle = mathUtility::rayTriangleIntersection(ray, nearestIntersectedTriangle, &intersectionPoint, &uvCoordinates);
-					// We can immediately return if the cast ray is a shadow ray
-					if (intersectsCurrentTriangle && (ray.type == RayType::SHADOW))
-					{
-						return true;
-					}
-					float distanceToIntersectionPoint = (intersectionPoint - ray.pos).Length();
-					if (intersectsCurrentTriangle && (distanceToIntersectionPoint < leastDistanceIntersection))
-					{
-						leastDistanceIntersection = distanceToIntersectionPoint;
-						outIntersection->hitMesh = intersectedMesh;
-						outIntersection->hitTriangle = nearestIntersectedTriangle;
-						outIntersection->hitPoint = intersectionPoint;
-						outIntersection->ray = ray;
-						outIntersection->uv = uvCoordinates;
-						// Always use first texture channel
-						if (intersectedMesh->HasTextureCoords(0))
-						{
-							outIntersection->uvTextureCoords =
-								(1 - uvCoordinates.x - uvCoordinates.y) *
-								*(textureCoordinates[0]) + uvCoordinates.x *
-								*(textureCoordinates[1]) + uvCoordinates.y *
-								*(textureCoordinates[2]);
-						}
-						outIntersection->vertexNormals = triangleVertexNormals;
-						outIntersection->textureCoordinates = textureCoordinates;
-						intersects = true;
-					}
-					nearestIntersectedTriangle.clear();
-					triangleVertexNormals.clear();
-					textureCoordinates.clear();
+					intersects = true;
+					*tMax = outIntersection->intersectionDistance / directionLength;
 				}
-			}
-		}
+				return false;
+			});
+
+		// Triangle tests are counted by the mesh hierarchies
+		this->recordTraversal(nodesVisited, 0);
 		return intersects;
 	}
 
+	bool BoundingVolume::occluded(const aiRay& ray, const float tMax)
+	{
+		bool occluded{ false };
+
+		const uint64_t nodesVisited = this->topLevel->traverseLeaves(ray, tMax,
+			[&](const uint32_t mesh, float* /*tMax*/)
+			{
+				occluded = this->meshHierarchies[mesh]->occluded(ray, tMax);
+				return occluded;
+			});
+
+		this->recordTraversal(nodesVisited, 0);
+		return occluded;
+	}
+
+	size_t BoundingVolume::getMemoryFootprint() const
+	{
+		size_t footprint =
+			sizeof(BoundingVolume) +
+			this->topLevel->getMemoryFootprint() +
+			this->bBoxes.capacity() * sizeof(BoundingBox) +
+			this->meshHierarchies.capacity() * sizeof(std::unique_ptr<BoundingVolumeHierarchy>);
+		for (const std::unique_ptr<BoundingVolumeHierarchy>& meshHierarchy : this->meshHierarchies)
+		{
+			footprint += meshHierarchy->getMemoryFootprint();
+		}
+		return footprint;
+	}
+
 	/*--------------------------------< Protected members >----------------------------------*/
 		
 	/*--------------------------------< Private members >------------------------------------*/
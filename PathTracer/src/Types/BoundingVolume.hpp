@@ -1,14 +1,17 @@
 /*
- * <template>.hpp
+ * BoundingVolume.hpp
  */
 
 #pragma once
 
 /*--------------------------------< Includes >-------------------------------------------*/
-#include "assimp/scene.h"
+#include <memory>
+#include <vector>
 
 #include "AccelerationStructure.hpp"
 #include "BoundingBox.hpp"
+#include "BoundingVolumeHierarchy.hpp"
+#include "SceneDatabase.hpp"
 
 namespace raytracing
 {
@@ -18,22 +21,34 @@ namespace raytracing
 
 	/*--------------------------------< Constants >-----------------------------------------*/
 
+	// Hierarchy over the bounds of the meshes of the scene. Every mesh gets its own binned SAH
+	// hierarchy over its triangles, so the build only sorts the triangles of one mesh at a time
+	// and the top level only sorts a few boxes. Meant for scenes made of many small meshes.
 	class BoundingVolume : public AccelerationStructure
 	{
 	/*--------------------------------< Public methods >------------------------------------*/
 	public:
 
-		BoundingVolume() = default;
-
-		void initialize(const aiScene* scene);
+		static BoundingVolume* build(const SceneDatabase& database);
 
 		bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) override;
+
+		bool occluded(const aiRay& ray, const float tMax) override;
+
+		size_t getMemoryFootprint() const override;
+
+		inline size_t getMeshCount() const
+		{
+			return this->meshHierarchies.size();
+		}
 	
 	/*--------------------------------< Protected methods >---------------------------------*/
 	protected:
 	
 	/*--------------------------------< Private methods >-----------------------------------*/
 	private:
+
+		BoundingVolume() = default;
 	
 	/*--------------------------------< Public members >------------------------------------*/
 	public:
@@ -44,7 +59,14 @@ namespace raytracing
 	/*--------------------------------< Private members >-----------------------------------*/
 	private:
 
-		std::vector<std::unique_ptr<BoundingBox>> bBoxes;
+		// Hierarchy over the mesh bounds. Leaves reference mesh hierarchies.
+		std::unique_ptr<BoundingVolumeHierarchy> topLevel;
+
+		// Bounds of every mesh with triangles
+		std::vector<BoundingBox> bBoxes;
+
+		// Hierarchy over the triangles of every mesh with triangles
+		std::vector<std::unique_ptr<BoundingVolumeHierarchy>> meshHierarchies;
 
 	};
 	
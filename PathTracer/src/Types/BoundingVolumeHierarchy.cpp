@@ -0,0 +1,879 @@
+/*
+ * BoundingVolumeHierarchy.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <memory>
+
+#include "BoundingVolumeHierarchy.hpp"
+#include "exceptions.hpp"
+#include "Utility/Simd.hpp"
+
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	using utility::SimdFloat;
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	/*static*/ BoundingVolumeHierarchy* BoundingVolumeHierarchy::build(const std::vector<KdTriangle>& triangles)
+	{
+		if (triangles.empty())
+		{
+			throw AccStructure("Cannot build a bounding volume hierarchy without triangles");
+		}
+		if (triangles.size() > UINT32_MAX)
+		{
+			throw AccStructure("Bounding volume hierarchy exceeds the capacity of the flattened node layout");
+		}
+
+		std::unique_ptr<BoundingVolumeHierarchy> bvh(new BoundingVolumeHierarchy(triangles));
+
+		std::vector<BoundingBox> triangleBounds;
+		triangleBounds.reserve(triangles.size());
+		for (const KdTriangle& triangle : triangles)
+		{
+			triangleBounds.emplace_back(triangle);
+		}
+		bvh->buildNodes(triangleBounds);
+		bvh->packLeaves();
+
+		return bvh.release();
+	}
+
+	/*static*/ BoundingVolumeHierarchy* BoundingVolumeHierarchy::buildSpatial(const std::vector<KdTriangle>& triangles, const float duplicationBudget)
+	{
+		if (triangles.empty())
+		{
+			throw AccStructure("Cannot build a bounding volume hierarchy without triangles");
+		}
+		if (triangles.size() * (1.f + std::max(duplicationBudget, 0.f)) > UINT32_MAX)
+		{
+			throw AccStructure("Bounding volume hierarchy exceeds the capacity of the flattened node layout");
+		}
+
+		std::unique_ptr<BoundingVolumeHierarchy> bvh(new BoundingVolumeHierarchy(triangles));
+
+		// Every triangle starts with one reference bounding all of it
+		BvhSpatialBuildState state;
+		state.remainingDuplicates = static_cast<uint32_t>(triangles.size() * std::max(duplicationBudget, 0.f));
+		state.referenceBounds.reserve(triangles.size() + state.remainingDuplicates);
+		state.referenceCentroids.reserve(triangles.size() + state.remainingDuplicates);
+		state.referenceTriangles.reserve(triangles.size() + state.remainingDuplicates);
+		std::vector<uint32_t> references(triangles.size());
+		BoundingBox rootBounds;
+		for (uint32_t i = 0; i < triangles.size(); i++)
+		{
+			state.referenceBounds.emplace_back(triangles[i]);
+			state.referenceCentroids.push_back(state.referenceBounds.back().getCenter());
+			state.referenceTriangles.push_back(i);
+			rootBounds.extend(state.referenceBounds.back());
+			references[i] = i;
+		}
+		state.rootArea = rootBounds.getSurfaceArea();
+
+		bvh->buildSpatialRecursive(&state, &references, 0);
+		bvh->nodes.shrink_to_fit();
+		bvh->packLeaves();
+
+		return bvh.release();
+	}
+
+	bool BoundingVolumeHierarchy::calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection)
+	{
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		const bool intersects = this->intersectSubtree(0, ray, outIntersection, &nodesVisited, &trianglesTested);
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return intersects;
+	}
+
+	bool BoundingVolumeHierarchy::occluded(const aiRay& ray, const float tMax)
+	{
+		const aiVector3D inverseDirection(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+		uint32_t stack[MAX_DEPTH];
+		uint32_t stackSize{ 0 };
+		uint32_t nodeIndex{ 0 };
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+
+		while (true)
+		{
+			const BvhNode& node = this->nodes[nodeIndex];
+			nodesVisited++;
+
+			if (intersectsNode(node, ray, inverseDirection, tMax))
+			{
+				if (!node.isLeaf())
+				{
+					// Any order finds an occluder, but the near side usually finds it sooner
+					if (ray.dir[node.axis] < 0.f)
+					{
+						stack[stackSize++] = nodeIndex + 1;
+						nodeIndex = node.offset;
+					}
+					else
+					{
+						stack[stackSize++] = node.offset;
+						nodeIndex = nodeIndex + 1;
+					}
+					continue;
+				}
+
+				trianglesTested += node.triangleCount;
+				if (this->occludedTriangles(this->trianglePackets.data() + node.offset, node.triangleCount, ray, tMax))
+				{
+					this->recordTraversal(nodesVisited, trianglesTested);
+					return true;
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+		}
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return false;
+	}
+
+	bool BoundingVolumeHierarchy::refit()
+	{
+		// Children are always stored behind their parent
+		for (size_t nodeIndex = this->nodes.size(); nodeIndex-- > 0;)
+		{
+			BvhNode& node = this->nodes[nodeIndex];
+			BoundingBox bounds;
+			if (node.isLeaf())
+			{
+				bounds = refreshTrianglePackets(this->triangles, this->trianglePackets.data() + node.offset, node.triangleCount);
+			}
+			else
+			{
+				const BvhNode& left = this->nodes[nodeIndex + 1];
+				const BvhNode& right = this->nodes[node.offset];
+				bounds = BoundingBox(left.min, left.max);
+				bounds.extend(BoundingBox(right.min, right.max));
+			}
+			node.min = bounds.getMin();
+			node.max = bounds.getMax();
+		}
+		return true;
+	}
+
+	size_t BoundingVolumeHierarchy::getTriangleReferenceCount() const
+	{
+		size_t referenceCount{ 0 };
+		for (const BvhNode& node : this->nodes)
+		{
+			referenceCount += node.triangleCount;
+		}
+		return referenceCount;
+	}
+
+	uint32_t BoundingVolumeHierarchy::intersectPacket(const aiRay* rays, const uint32_t rayCount, IntersectionInformation* outIntersections)
+	{
+		RayPacket packet;
+		if (!loadRayPacket(rays, rayCount, outIntersections, &packet))
+		{
+			// Rays heading in different directions split up right away, they are traced one by one
+			return AccelerationStructure::intersectPacket(rays, rayCount, outIntersections);
+		}
+
+		uint32_t stack[MAX_DEPTH];
+		uint32_t stackSize{ 0 };
+		uint32_t nodeIndex{ 0 };
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		uint32_t hitMask{ 0 };
+
+		while (true)
+		{
+			const BvhNode& node = this->nodes[nodeIndex];
+			nodesVisited++;
+
+			const uint32_t nodeMask = intersectsNode(node, packet);
+			if ((nodeMask != 0) && ((nodeMask & (nodeMask - 1)) == 0))
+			{
+				// Only one ray enters the subtree. It continues on its own instead of occupying all lanes.
+				const uint32_t lane = RayPacket::getLowestLane(nodeMask);
+				if (this->intersectSubtree(nodeIndex, rays[lane], &outIntersections[lane], &nodesVisited, &trianglesTested))
+				{
+					hitMask |= 1U << lane;
+					packet.tMax[lane] = outIntersections[lane].intersectionDistance / packet.directionLength[lane];
+				}
+			}
+			else if (nodeMask != 0)
+			{
+				if (!node.isLeaf())
+				{
+					// All rays head the same way, so the child order of the first ray holds for all
+					if (rays[0].dir[node.axis] < 0.f)
+					{
+						stack[stackSize++] = nodeIndex + 1;
+						nodeIndex = node.offset;
+					}
+					else
+					{
+						stack[stackSize++] = node.offset;
+						nodeIndex = nodeIndex + 1;
+					}
+					continue;
+				}
+
+				for (uint32_t lanes = nodeMask; lanes != 0; lanes &= lanes - 1)
+				{
+					const uint32_t lane = RayPacket::getLowestLane(lanes);
+					trianglesTested += node.triangleCount;
+					if (this->intersectTriangles(
+						this->triangles,
+						this->trianglePackets.data() + node.offset,
+						node.triangleCount,
+						rays[lane],
+						&outIntersections[lane]))
+					{
+						hitMask |= 1U << lane;
+						packet.tMax[lane] = outIntersections[lane].intersectionDistance / packet.directionLength[lane];
+					}
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+		}
+
+		this->recordTraversal(nodesVisited, trianglesTested, rayCount);
+		return hitMask;
+	}
+
+	size_t BoundingVolumeHierarchy::getMemoryFootprint() const
+	{
+		return
+			sizeof(BoundingVolumeHierarchy) +
+			this->nodes.capacity() * sizeof(BvhNode) +
+			this->triangleIndices.capacity() * sizeof(uint32_t) +
+			this->trianglePackets.capacity() * sizeof(TrianglePacket) +
+			this->triangles.capacity() * sizeof(KdTriangle);
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	bool BoundingVolumeHierarchy::intersectSubtree(
+		const uint32_t rootIndex,
+		const aiRay& ray,
+		IntersectionInformation* outIntersection,
+		uint64_t* nodesVisited,
+		uint64_t* trianglesTested) const
+	{
+		// Hit distances are measured in world space, the traversal works with the ray parameter
+		const float directionLength = ray.dir.Length();
+		const aiVector3D inverseDirection(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+		uint32_t stack[MAX_DEPTH];
+		uint32_t stackSize{ 0 };
+		uint32_t nodeIndex{ rootIndex };
+		bool intersects{ false };
+
+		while (true)
+		{
+			const BvhNode& node = this->nodes[nodeIndex];
+			(*nodesVisited)++;
+
+			// Nodes behind the closest hit found so far are culled by the box test
+			if (intersectsNode(node, ray, inverseDirection, outIntersection->intersectionDistance / directionLength))
+			{
+				if (!node.isLeaf())
+				{
+					// Visit the child on the side the ray comes from first
+					if (ray.dir[node.axis] < 0.f)
+					{
+						stack[stackSize++] = nodeIndex + 1;
+						nodeIndex = node.offset;
+					}
+					else
+					{
+						stack[stackSize++] = node.offset;
+						nodeIndex = nodeIndex + 1;
+					}
+					continue;
+				}
+
+				*trianglesTested += node.triangleCount;
+				if (this->intersectTriangles(
+					this->triangles,
+					this->trianglePackets.data() + node.offset,
+					node.triangleCount,
+					ray,
+					outIntersection))
+				{
+					intersects = true;
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+		}
+
+		return intersects;
+	}
+
+	void BoundingVolumeHierarchy::buildNodes(const std::vector<BoundingBox>& primitiveBounds)
+	{
+		// Centroids are used throughout the whole build
+		std::vector<aiVector3D> centroids;
+		centroids.reserve(primitiveBounds.size());
+		for (const BoundingBox& bounds : primitiveBounds)
+		{
+			centroids.push_back(bounds.getCenter());
+		}
+
+		this->triangleIndices.resize(primitiveBounds.size());
+		for (uint32_t i = 0; i < primitiveBounds.size(); i++)
+		{
+			this->triangleIndices[i] = i;
+		}
+
+		// A binary tree with at most one primitive per leaf has less than 2N nodes
+		this->nodes.reserve(2 * primitiveBounds.size() - 1);
+		this->buildRecursive(primitiveBounds, centroids, 0, static_cast<uint32_t>(primitiveBounds.size()), 0);
+		this->nodes.shrink_to_fit();
+	}
+
+	void BoundingVolumeHierarchy::packLeaves()
+	{
+		// Let leaves reference their triangle packets, the indices are not needed anymore
+		for (BvhNode& node : this->nodes)
+		{
+			if (node.isLeaf())
+			{
+				const uint32_t packetOffset = static_cast<uint32_t>(this->trianglePackets.size());
+				appendTrianglePackets(this->triangles, this->triangleIndices.data() + node.offset, node.triangleCount, &this->trianglePackets);
+				node.offset = packetOffset;
+			}
+		}
+		this->trianglePackets.shrink_to_fit();
+		std::vector<uint32_t>().swap(this->triangleIndices);
+	}
+
+	void BoundingVolumeHierarchy::buildRecursive(
+		const std::vector<BoundingBox>& triangleBounds,
+		const std::vector<aiVector3D>& centroids,
+		const uint32_t begin,
+		const uint32_t end,
+		const unsigned int depth)
+	{
+		const uint32_t nodeIndex = static_cast<uint32_t>(this->nodes.size());
+		this->nodes.emplace_back();
+
+		BoundingBox bounds;
+		BoundingBox centroidBounds;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			bounds.extend(triangleBounds[this->triangleIndices[i]]);
+			centroidBounds.extend(centroids[this->triangleIndices[i]]);
+		}
+		this->nodes[nodeIndex].min = bounds.getMin();
+		this->nodes[nodeIndex].max = bounds.getMax();
+
+		const uint32_t triangleCount = end - begin;
+		uint32_t* first = this->triangleIndices.data() + begin;
+		uint32_t* last = this->triangleIndices.data() + end;
+		uint32_t* middle{ nullptr };
+		Axis axis{ Axis::X };
+
+		if ((triangleCount > 1) && (depth + 1 < MAX_DEPTH))
+		{
+			uint32_t bin{ 0 };
+			const float splitCost = findSplit(triangleBounds, centroids, centroidBounds, bounds.getSurfaceArea(), first, triangleCount, &axis, &bin);
+			// Leaves are intersected a whole triangle packet at a time
+			const float leafCost = INTERSECTION_COST * TrianglePacket::getPacketCount(triangleCount);
+
+			if ((splitCost < leafCost) || ((triangleCount > MAX_TRIANGLES_PER_LEAF) && (splitCost < std::numeric_limits<float>::infinity())))
+			{
+				middle = std::partition(first, last, [&](const uint32_t triangle)
+				{
+					return getBin(centroids[triangle], centroidBounds, axis) < bin;
+				});
+			}
+			else if (triangleCount > MAX_TRIANGLES_PER_LEAF)
+			{
+				// All centroids coincide. Split in halves to bound the leaf size
+				axis = centroidBounds.getLongestAxis();
+				middle = first + triangleCount / 2;
+				std::nth_element(first, middle, last, [&](const uint32_t a, const uint32_t b)
+				{
+					return centroids[a][axis] < centroids[b][axis];
+				});
+			}
+		}
+
+		if (!middle)
+		{
+			if (triangleCount > UINT16_MAX)
+			{
+				throw AccStructure("Bounding volume hierarchy exceeds the capacity of the flattened node layout");
+			}
+			this->nodes[nodeIndex].offset = begin;
+			this->nodes[nodeIndex].triangleCount = static_cast<uint16_t>(triangleCount);
+			return;
+		}
+
+		// Left child directly follows its parent
+		const uint32_t split = static_cast<uint32_t>(middle - this->triangleIndices.data());
+		this->buildRecursive(triangleBounds, centroids, begin, split, depth + 1);
+		const uint32_t rightChild = static_cast<uint32_t>(this->nodes.size());
+		this->buildRecursive(triangleBounds, centroids, split, end, depth + 1);
+
+		this->nodes[nodeIndex].offset = rightChild;
+		this->nodes[nodeIndex].triangleCount = 0;
+		this->nodes[nodeIndex].axis = static_cast<uint8_t>(axis);
+	}
+
+	void BoundingVolumeHierarchy::buildSpatialRecursive(
+		BvhSpatialBuildState* state,
+		std::vector<uint32_t>* references,
+		const unsigned int depth)
+	{
+		const uint32_t nodeIndex = static_cast<uint32_t>(this->nodes.size());
+		this->nodes.emplace_back();
+
+		BoundingBox bounds;
+		BoundingBox centroidBounds;
+		for (const uint32_t reference : *references)
+		{
+			bounds.extend(state->referenceBounds[reference]);
+			centroidBounds.extend(state->referenceCentroids[reference]);
+		}
+		this->nodes[nodeIndex].min = bounds.getMin();
+		this->nodes[nodeIndex].max = bounds.getMax();
+
+		const uint32_t referenceCount = static_cast<uint32_t>(references->size());
+		std::vector<uint32_t> leftReferences;
+		std::vector<uint32_t> rightReferences;
+		Axis axis{ Axis::X };
+
+		if ((referenceCount > 1) && (depth + 1 < MAX_DEPTH))
+		{
+			const float nodeArea = bounds.getSurfaceArea();
+			uint32_t objectBin{ 0 };
+			Axis objectAxis{ Axis::X };
+			const float objectCost = findSplit(
+				state->referenceBounds, state->referenceCentroids, centroidBounds, nodeArea,
+				references->data(), referenceCount, &objectAxis, &objectBin);
+
+			// Spatial splits only pay off where the children of the object split overlap a lot
+			// compared to the whole scene. Elsewhere the additional search is skipped.
+			float spatialCost{ std::numeric_limits<float>::infinity() };
+			Axis spatialAxis{ Axis::X };
+			float spatialPosition{ 0.f };
+			if (state->remainingDuplicates > 0)
+			{
+				float overlapArea{ 0.f };
+				if (objectCost < std::numeric_limits<float>::infinity())
+				{
+					BoundingBox objectLeft;
+					BoundingBox objectRight;
+					for (const uint32_t reference : *references)
+					{
+						const bool left = getBin(state->referenceCentroids[reference], centroidBounds, objectAxis) < objectBin;
+						(left ? objectLeft : objectRight).extend(state->referenceBounds[reference]);
+					}
+					objectLeft.clipToBox(objectRight);
+					const aiVector3D& overlapMin = objectLeft.getMin();
+					const aiVector3D& overlapMax = objectLeft.getMax();
+					if ((overlapMin.x <= overlapMax.x) && (overlapMin.y <= overlapMax.y) && (overlapMin.z <= overlapMax.z))
+					{
+						overlapArea = objectLeft.getSurfaceArea();
+					}
+				}
+				if ((objectCost == std::numeric_limits<float>::infinity()) || (overlapArea > SPATIAL_SPLIT_OVERLAP * state->rootArea))
+				{
+					spatialCost = this->findSpatialSplit(*state, *references, bounds, nodeArea, &spatialAxis, &spatialPosition);
+				}
+			}
+
+			// Leaves are intersected a whole triangle packet at a time
+			const float leafCost = INTERSECTION_COST * TrianglePacket::getPacketCount(referenceCount);
+			const float splitCost = std::min(objectCost, spatialCost);
+			const bool mustSplit = referenceCount > MAX_TRIANGLES_PER_LEAF;
+
+			if ((spatialCost < objectCost) && ((spatialCost < leafCost) || mustSplit))
+			{
+				axis = spatialAxis;
+				this->splitReferences(state, *references, spatialAxis, spatialPosition, &leftReferences, &rightReferences);
+			}
+			else if ((splitCost < leafCost) || (mustSplit && (splitCost < std::numeric_limits<float>::infinity())))
+			{
+				axis = objectAxis;
+				for (const uint32_t reference : *references)
+				{
+					const bool left = getBin(state->referenceCentroids[reference], centroidBounds, objectAxis) < objectBin;
+					(left ? leftReferences : rightReferences).push_back(reference);
+				}
+			}
+			else if (mustSplit)
+			{
+				// All centroids coincide. Split in halves to bound the leaf size
+				axis = centroidBounds.getLongestAxis();
+				std::vector<uint32_t>::iterator middle = references->begin() + referenceCount / 2;
+				std::nth_element(references->begin(), middle, references->end(), [&](const uint32_t a, const uint32_t b)
+				{
+					return state->referenceCentroids[a][axis] < state->referenceCentroids[b][axis];
+				});
+				leftReferences.assign(references->begin(), middle);
+				rightReferences.assign(middle, references->end());
+			}
+		}
+
+		if (leftReferences.empty() || rightReferences.empty())
+		{
+			if (referenceCount > UINT16_MAX)
+			{
+				throw AccStructure("Bounding volume hierarchy exceeds the capacity of the flattened node layout");
+			}
+			this->nodes[nodeIndex].offset = static_cast<uint32_t>(this->triangleIndices.size());
+			this->nodes[nodeIndex].triangleCount = static_cast<uint16_t>(referenceCount);
+			for (const uint32_t reference : *references)
+			{
+				this->triangleIndices.push_back(state->referenceTriangles[reference]);
+			}
+			return;
+		}
+
+		// References of this node are not needed while the children are built
+		std::vector<uint32_t>().swap(*references);
+
+		// Left child directly follows its parent
+		this->buildSpatialRecursive(state, &leftReferences, depth + 1);
+		const uint32_t rightChild = static_cast<uint32_t>(this->nodes.size());
+		this->buildSpatialRecursive(state, &rightReferences, depth + 1);
+
+		this->nodes[nodeIndex].offset = rightChild;
+		this->nodes[nodeIndex].triangleCount = 0;
+		this->nodes[nodeIndex].axis = static_cast<uint8_t>(axis);
+	}
+
+	float BoundingVolumeHierarchy::findSpatialSplit(
+		const BvhSpatialBuildState& state,
+		const std::vector<uint32_t>& references,
+		const BoundingBox& nodeBounds,
+		const float nodeArea,
+		Axis* outAxis,
+		float* outPosition) const
+	{
+		float bestCost{ std::numeric_limits<float>::infinity() };
+
+		// Flat nodes of axis aligned triangles have no surface area
+		const float inverseArea = (nodeArea > 0.f) ? 1.f / nodeArea : 0.f;
+
+		for (uint8_t k = 0; k < 3; k++)
+		{
+			const Axis axis = static_cast<Axis>(k);
+			const float origin = nodeBounds.getMin()[axis];
+			const float binWidth = nodeBounds.length(axis) / BIN_COUNT;
+			if (binWidth <= 0.f)
+			{
+				continue;
+			}
+
+			// References are counted in the bin they start and in the bin they end in, while
+			// their clipped parts extend the bounds of every bin they overlap
+			uint32_t entryCounts[BIN_COUNT] = {};
+			uint32_t exitCounts[BIN_COUNT] = {};
+			BoundingBox binBounds[BIN_COUNT];
+			for (const uint32_t reference : references)
+			{
+				const BoundingBox& referenceBounds = state.referenceBounds[reference];
+				const uint32_t firstBin = std::min(static_cast<uint32_t>(std::max((referenceBounds.getMin()[axis] - origin) / binWidth, 0.f)), BIN_COUNT - 1);
+				const uint32_t lastBin = std::min(static_cast<uint32_t>(std::max((referenceBounds.getMax()[axis] - origin) / binWidth, 0.f)), BIN_COUNT - 1);
+				entryCounts[firstBin]++;
+				exitCounts[lastBin]++;
+				if (firstBin == lastBin)
+				{
+					binBounds[firstBin].extend(referenceBounds);
+					continue;
+				}
+				for (uint32_t bin = firstBin; bin <= lastBin; bin++)
+				{
+					const float low = origin + bin * binWidth;
+					const float high = (bin == BIN_COUNT - 1) ? nodeBounds.getMax()[axis] : origin + (bin + 1) * binWidth;
+					BoundingBox part = clipTriangle(this->triangles[state.referenceTriangles[reference]], axis, low, high);
+					part.clipToBox(referenceBounds);
+					binBounds[bin].extend(part);
+				}
+			}
+
+			// Sweep from the right to get area and count right of every bin border
+			float rightAreas[BIN_COUNT];
+			uint32_t rightCounts[BIN_COUNT];
+			BoundingBox rightBounds;
+			uint32_t rightCount{ 0 };
+			for (uint32_t bin = BIN_COUNT - 1; bin > 0; bin--)
+			{
+				rightCount += exitCounts[bin];
+				rightBounds.extend(binBounds[bin]);
+				rightCounts[bin] = rightCount;
+				rightAreas[bin] = (rightCount > 0) ? rightBounds.getSurfaceArea() : 0.f;
+			}
+
+			// Sweep from the left and evaluate the border left of every bin
+			BoundingBox leftBounds;
+			uint32_t leftCount{ 0 };
+			for (uint32_t bin = 1; bin < BIN_COUNT; bin++)
+			{
+				leftCount += entryCounts[bin - 1];
+				leftBounds.extend(binBounds[bin - 1]);
+				if ((leftCount == 0) || (rightCounts[bin] == 0))
+				{
+					continue;
+				}
+
+				const float cost = TRAVERSAL_COST + INTERSECTION_COST *
+					(leftBounds.getSurfaceArea() * TrianglePacket::getPacketCount(leftCount) + rightAreas[bin] * TrianglePacket::getPacketCount(rightCounts[bin])) * inverseArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					*outAxis = axis;
+					*outPosition = origin + bin * binWidth;
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	void BoundingVolumeHierarchy::splitReferences(
+		BvhSpatialBuildState* state,
+		const std::vector<uint32_t>& references,
+		const Axis axis,
+		const float position,
+		std::vector<uint32_t>* outLeft,
+		std::vector<uint32_t>* outRight) const
+	{
+		for (const uint32_t reference : references)
+		{
+			const BoundingBox referenceBounds = state->referenceBounds[reference];
+			if (referenceBounds.getMax()[axis] <= position)
+			{
+				outLeft->push_back(reference);
+				continue;
+			}
+			if (referenceBounds.getMin()[axis] >= position)
+			{
+				outRight->push_back(reference);
+				continue;
+			}
+
+			// Straddling references are clipped into both children while the budget lasts
+			const KdTriangle& triangle = this->triangles[state->referenceTriangles[reference]];
+			BoundingBox leftPart = clipTriangle(triangle, axis, referenceBounds.getMin()[axis], position);
+			BoundingBox rightPart = clipTriangle(triangle, axis, position, referenceBounds.getMax()[axis]);
+			leftPart.clipToBox(referenceBounds);
+			rightPart.clipToBox(referenceBounds);
+			const bool leftEmpty = leftPart.getMin()[axis] > leftPart.getMax()[axis];
+			const bool rightEmpty = rightPart.getMin()[axis] > rightPart.getMax()[axis];
+			if ((state->remainingDuplicates == 0) || leftEmpty || rightEmpty)
+			{
+				// Keep the whole reference on the side of its centroid
+				const bool left = state->referenceCentroids[reference][axis] < position;
+				(left ? outLeft : outRight)->push_back(reference);
+				continue;
+			}
+
+			state->remainingDuplicates--;
+			state->referenceBounds[reference] = leftPart;
+			state->referenceCentroids[reference] = leftPart.getCenter();
+			outLeft->push_back(reference);
+
+			outRight->push_back(static_cast<uint32_t>(state->referenceBounds.size()));
+			state->referenceBounds.push_back(rightPart);
+			state->referenceCentroids.push_back(rightPart.getCenter());
+			state->referenceTriangles.push_back(state->referenceTriangles[reference]);
+		}
+	}
+
+	/*static*/ BoundingBox BoundingVolumeHierarchy::clipTriangle(const KdTriangle& triangle, const Axis axis, const float low, const float high)
+	{
+		const aiVector3D vertices[3] = {
+			triangle.getVertex(0),
+			triangle.getVertex(1),
+			triangle.getVertex(2) };
+
+		// The clipped polygon is spanned by the vertices inside the slab and the points where
+		// the edges cross its planes
+		BoundingBox bounds;
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			const aiVector3D& start = vertices[i];
+			const aiVector3D& end = vertices[(i + 1) % 3];
+			if ((start[axis] >= low) && (start[axis] <= high))
+			{
+				bounds.extend(start);
+			}
+			for (const float plane : { low, high })
+			{
+				if (((start[axis] < plane) && (end[axis] > plane)) || ((start[axis] > plane) && (end[axis] < plane)))
+				{
+					aiVector3D crossing = start + (end - start) * ((plane - start[axis]) / (end[axis] - start[axis]));
+					crossing[axis] = plane;
+					bounds.extend(crossing);
+				}
+			}
+		}
+		return bounds;
+	}
+
+	/*static*/ float BoundingVolumeHierarchy::findSplit(
+		const std::vector<BoundingBox>& triangleBounds,
+		const std::vector<aiVector3D>& centroids,
+		const BoundingBox& centroidBounds,
+		const float nodeArea,
+		const uint32_t* triangleIds,
+		const uint32_t triangleCount,
+		Axis* outAxis,
+		uint32_t* outBin)
+	{
+		float bestCost{ std::numeric_limits<float>::infinity() };
+
+		// Flat nodes of axis aligned triangles have no surface area
+		const float inverseArea = (nodeArea > 0.f) ? 1.f / nodeArea : 0.f;
+
+		for (uint8_t k = 0; k < 3; k++)
+		{
+			const Axis axis = static_cast<Axis>(k);
+			if (centroidBounds.length(axis) <= 0.f)
+			{
+				// All centroids lie in the same bin
+				continue;
+			}
+
+			uint32_t binCounts[BIN_COUNT] = {};
+			BoundingBox binBounds[BIN_COUNT];
+			for (uint32_t i = 0; i < triangleCount; i++)
+			{
+				const uint32_t triangle = triangleIds[i];
+				const uint32_t bin = getBin(centroids[triangle], centroidBounds, axis);
+				binCounts[bin]++;
+				binBounds[bin].extend(triangleBounds[triangle]);
+			}
+
+			// Sweep from the right to get area and count right of every bin border
+			float rightAreas[BIN_COUNT];
+			uint32_t rightCounts[BIN_COUNT];
+			BoundingBox rightBounds;
+			uint32_t rightCount{ 0 };
+			for (uint32_t bin = BIN_COUNT - 1; bin > 0; bin--)
+			{
+				rightCount += binCounts[bin];
+				if (binCounts[bin] > 0)
+				{
+					rightBounds.extend(binBounds[bin]);
+				}
+				rightCounts[bin] = rightCount;
+				rightAreas[bin] = (rightCount > 0) ? rightBounds.getSurfaceArea() : 0.f;
+			}
+
+			// Sweep from the left and evaluate the border left of every bin
+			BoundingBox leftBounds;
+			uint32_t leftCount{ 0 };
+			for (uint32_t bin = 1; bin < BIN_COUNT; bin++)
+			{
+				leftCount += binCounts[bin - 1];
+				if (binCounts[bin - 1] > 0)
+				{
+					leftBounds.extend(binBounds[bin - 1]);
+				}
+				if ((leftCount == 0) || (rightCounts[bin] == 0))
+				{
+					continue;
+				}
+
+				const float cost = TRAVERSAL_COST + INTERSECTION_COST *
+					(leftBounds.getSurfaceArea() * TrianglePacket::getPacketCount(leftCount) + rightAreas[bin] * TrianglePacket::getPacketCount(rightCounts[bin])) * inverseArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					*outAxis = axis;
+					*outBin = bin;
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	/*static*/ uint32_t BoundingVolumeHierarchy::getBin(const aiVector3D& centroid, const BoundingBox& centroidBounds, const Axis axis)
+	{
+		const float relative = (centroid[axis] - centroidBounds.getMin()[axis]) / centroidBounds.length(axis);
+		const uint32_t bin = static_cast<uint32_t>(relative * BIN_COUNT);
+		return std::min(bin, BIN_COUNT - 1);
+	}
+
+	/*static*/ bool BoundingVolumeHierarchy::intersectsNode(const BvhNode& node, const aiRay& ray, const aiVector3D& inverseDirection, const float tMax)
+	{
+		float tEntry{ 0.f };
+		float tExit{ tMax };
+		for (int k = 0; k < 3; k++)
+		{
+			float tNear = (node.min[k] - ray.pos[k]) * inverseDirection[k];
+			float tFar = (node.max[k] - ray.pos[k]) * inverseDirection[k];
+			if (tNear > tFar)
+			{
+				std::swap(tNear, tFar);
+			}
+			tEntry = tNear > tEntry ? tNear : tEntry;
+			tExit = tFar < tExit ? tFar : tExit;
+			if (tEntry > tExit)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*static*/ uint32_t BoundingVolumeHierarchy::intersectsNode(const BvhNode& node, const RayPacket& packet)
+	{
+		// Directions have no zero components in a packet, so the slab distances are never NaN
+		const SimdFloat originX = SimdFloat::load(packet.originX);
+		const SimdFloat originY = SimdFloat::load(packet.originY);
+		const SimdFloat originZ = SimdFloat::load(packet.originZ);
+		const SimdFloat inverseDirectionX = SimdFloat::load(packet.inverseDirectionX);
+		const SimdFloat inverseDirectionY = SimdFloat::load(packet.inverseDirectionY);
+		const SimdFloat inverseDirectionZ = SimdFloat::load(packet.inverseDirectionZ);
+
+		const SimdFloat tMinX = (SimdFloat::broadcast(node.min.x) - originX) * inverseDirectionX;
+		const SimdFloat tMaxX = (SimdFloat::broadcast(node.max.x) - originX) * inverseDirectionX;
+		const SimdFloat tMinY = (SimdFloat::broadcast(node.min.y) - originY) * inverseDirectionY;
+		const SimdFloat tMaxY = (SimdFloat::broadcast(node.max.y) - originY) * inverseDirectionY;
+		const SimdFloat tMinZ = (SimdFloat::broadcast(node.min.z) - originZ) * inverseDirectionZ;
+		const SimdFloat tMaxZ = (SimdFloat::broadcast(node.max.z) - originZ) * inverseDirectionZ;
+
+		const SimdFloat tEntry = SimdFloat::max(
+			SimdFloat::max(SimdFloat::min(tMinX, tMaxX), SimdFloat::min(tMinY, tMaxY)),
+			SimdFloat::max(SimdFloat::min(tMinZ, tMaxZ), SimdFloat::broadcast(0.f)));
+		const SimdFloat tExit = SimdFloat::min(
+			SimdFloat::min(SimdFloat::max(tMinX, tMaxX), SimdFloat::max(tMinY, tMaxY)),
+			SimdFloat::min(SimdFloat::max(tMinZ, tMaxZ), SimdFloat::load(packet.tMax)));
+		return (tEntry <= tExit) & packet.activeMask;
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
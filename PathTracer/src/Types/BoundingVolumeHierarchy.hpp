@@ -0,0 +1,292 @@
+/*
+ * BoundingVolumeHierarchy.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <vector>
+
+#include "assimp/types.h"
+#include "assimp/mesh.h"
+
+#include "raytracing.hpp"
+#include "AccelerationStructure.hpp"
+#include "BoundingBox.hpp"
+#include "Utility/AlignedAllocator.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Node of the flattened hierarchy. The left child of an interior node is always stored
+	// directly after its parent, the index of the right child is stored explicitly.
+	// Two nodes share a cache line.
+	struct BvhNode
+	{
+		inline bool isLeaf() const
+		{
+			return this->triangleCount > 0;
+		}
+
+		aiVector3D min;
+
+		// First triangle packet of leaves, index of the right child otherwise
+		uint32_t offset;
+
+		aiVector3D max;
+
+		uint16_t triangleCount;
+
+		// Axis the children were split along. Used to visit the nearer child first
+		uint8_t axis;
+
+		uint8_t padding;
+	};
+
+	static_assert(sizeof(BvhNode) == 32, "Flattened BVH nodes are expected to be 32 bytes");
+
+	// Triangle references of the spatial split build. A reference covers the part of its triangle
+	// inside the node holding it, so its bounds shrink with every spatial split it straddles.
+	struct BvhSpatialBuildState
+	{
+		std::vector<BoundingBox> referenceBounds;
+
+		std::vector<aiVector3D> referenceCentroids;
+
+		std::vector<uint32_t> referenceTriangles;
+
+		// Surface area of the scene bounds
+		float rootArea{ 0.f };
+
+		// Additional references spatial splits may still create
+		uint32_t remainingDuplicates{ 0 };
+	};
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Bounding volume hierarchy over single triangles built with the binned surface area
+	// heuristic. With object splits only, every triangle is referenced by exactly one leaf, so the
+	// hierarchy never holds more than 2N - 1 nodes. Spatial splits add a bounded number of
+	// references to triangles crossing their split planes.
+	class BoundingVolumeHierarchy : public AccelerationStructure
+	{
+
+	// Collapses the binary hierarchy into its wide node layout
+	friend class WideBoundingVolumeHierarchy;
+
+	// Collapses the binary hierarchy into its quantized wide node layout
+	friend class CompressedBoundingVolumeHierarchy;
+
+	// Builds its top level hierarchy over instance bounds
+	friend class TwoLevelAccelerationStructure;
+
+	// Builds its top level hierarchy over mesh bounds
+	friend class BoundingVolume;
+
+	static constexpr uint32_t BIN_COUNT = 16;
+
+	static constexpr uint32_t MAX_TRIANGLES_PER_LEAF = 8;
+
+	// Every interior node on the way to a leaf pushes at most one child
+	static constexpr uint32_t MAX_DEPTH = 64;
+
+	static constexpr float TRAVERSAL_COST = 1.f;
+
+	static constexpr float INTERSECTION_COST = 2.f;
+
+	// Spatial splits are only searched where the children of the best object split overlap by
+	// more than this fraction of the scene surface area
+	static constexpr float SPATIAL_SPLIT_OVERLAP = 1e-5f;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		static BoundingVolumeHierarchy* build(const std::vector<KdTriangle>& triangles);
+
+		// Builds a spatial split BVH. Nodes choose between object splits and splits of space,
+		// which clip the triangles crossing the split plane into both children. At most
+		// duplicationBudget times the triangle count additional references are created.
+		static BoundingVolumeHierarchy* buildSpatial(const std::vector<KdTriangle>& triangles, const float duplicationBudget);
+
+		virtual bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) override;
+
+		virtual bool occluded(const aiRay& ray, const float tMax) override;
+
+		// Traverses the rays together as long as more than one of them enters a node
+		virtual uint32_t intersectPacket(const aiRay* rays, const uint32_t rayCount, IntersectionInformation* outIntersections) override;
+
+		virtual size_t getMemoryFootprint() const override;
+
+		// Recomputes all bounds bottom up. The tree quality degrades with large deformations.
+		virtual bool refit() override;
+
+		inline size_t getNodeCount() const
+		{
+			return this->nodes.size();
+		}
+
+		size_t getTriangleReferenceCount() const;
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		BoundingVolumeHierarchy(const std::vector<KdTriangle>& triangles) :
+			triangles(triangles)
+		{};
+
+		// Builds the nodes over the given bounds. Leaves reference ranges of triangleIndices,
+		// which hold indices into primitiveBounds.
+		void buildNodes(const std::vector<BoundingBox>& primitiveBounds);
+
+		// Closest hit traversal of the subtree below rootIndex
+		bool intersectSubtree(
+			const uint32_t rootIndex,
+			const aiRay& ray,
+			IntersectionInformation* outIntersection,
+			uint64_t* nodesVisited,
+			uint64_t* trianglesTested) const;
+
+		// Replaces the index ranges of the leaves by their triangle packets
+		void packLeaves();
+
+		// Builds the subtree over triangleIndices[begin, end) and appends it in depth first order
+		void buildRecursive(
+			const std::vector<BoundingBox>& triangleBounds,
+			const std::vector<aiVector3D>& centroids,
+			const uint32_t begin,
+			const uint32_t end,
+			const unsigned int depth);
+
+		// Builds the subtree over the references and appends it in depth first order. Leaves append
+		// the triangles of their references to triangleIndices.
+		void buildSpatialRecursive(
+			BvhSpatialBuildState* state,
+			std::vector<uint32_t>* references,
+			const unsigned int depth);
+
+		// Finds the cheapest split among the bin borders of all dimensions. Returns the cost
+		// of the split, which is infinite if all centroids fall into the same bin.
+		static float findSplit(
+			const std::vector<BoundingBox>& triangleBounds,
+			const std::vector<aiVector3D>& centroids,
+			const BoundingBox& centroidBounds,
+			const float nodeArea,
+			const uint32_t* triangleIds,
+			const uint32_t triangleCount,
+			Axis* outAxis,
+			uint32_t* outBin);
+
+		// Finds the cheapest plane among equally spaced bin borders of the node, counting references
+		// that straddle the plane on both sides. Returns the cost of the split.
+		float findSpatialSplit(
+			const BvhSpatialBuildState& state,
+			const std::vector<uint32_t>& references,
+			const BoundingBox& nodeBounds,
+			const float nodeArea,
+			Axis* outAxis,
+			float* outPosition) const;
+
+		// Distributes the references to the sides of the plane and clips those straddling it
+		void splitReferences(
+			BvhSpatialBuildState* state,
+			const std::vector<uint32_t>& references,
+			const Axis axis,
+			const float position,
+			std::vector<uint32_t>* outLeft,
+			std::vector<uint32_t>* outRight) const;
+
+		// Bounds of the part of the triangle between low and high along the axis
+		static BoundingBox clipTriangle(const KdTriangle& triangle, const Axis axis, const float low, const float high);
+
+		static uint32_t getBin(const aiVector3D& centroid, const BoundingBox& centroidBounds, const Axis axis);
+
+		// Clips the ray against the node bounds, limited to the parametric range [0, tMax]
+		static bool intersectsNode(const BvhNode& node, const aiRay& ray, const aiVector3D& inverseDirection, const float tMax);
+
+		// Clips all active rays of the packet against the node bounds, each limited to its closest
+		// hit. Returns the mask of the rays entering the node.
+		static uint32_t intersectsNode(const BvhNode& node, const RayPacket& packet);
+
+		// Walks the leaves entered by the ray front to back and calls visit(primitive, &tMax) for
+		// every primitive they reference, as the top level of a structure over meshes or instances
+		// does. visit may lower tMax to skip farther nodes and returns true to stop the traversal.
+		// Returns the number of nodes visited.
+		template<typename PrimitiveVisitor>
+		uint64_t traverseLeaves(const aiRay& ray, float tMax, PrimitiveVisitor&& visit) const
+		{
+			const aiVector3D inverseDirection(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+			uint32_t stack[MAX_DEPTH];
+			uint32_t stackSize{ 0 };
+			uint32_t nodeIndex{ 0 };
+			uint64_t nodesVisited{ 0 };
+
+			while (true)
+			{
+				const BvhNode& node = this->nodes[nodeIndex];
+				nodesVisited++;
+
+				if (intersectsNode(node, ray, inverseDirection, tMax))
+				{
+					if (!node.isLeaf())
+					{
+						if (ray.dir[node.axis] < 0.f)
+						{
+							stack[stackSize++] = nodeIndex + 1;
+							nodeIndex = node.offset;
+						}
+						else
+						{
+							stack[stackSize++] = node.offset;
+							nodeIndex = nodeIndex + 1;
+						}
+						continue;
+					}
+
+					for (uint32_t i = 0; i < node.triangleCount; i++)
+					{
+						if (visit(this->triangleIndices[node.offset + i], &tMax))
+						{
+							return nodesVisited;
+						}
+					}
+				}
+
+				if (stackSize == 0)
+				{
+					return nodesVisited;
+				}
+				nodeIndex = stack[--stackSize];
+			}
+		}
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		// All nodes in depth first order, starting with the root node
+		std::vector<BvhNode, utility::AlignedAllocator<BvhNode>> nodes;
+
+		// Indices into triangles, partitioned into leaf ranges during the build
+		std::vector<uint32_t> triangleIndices;
+
+		// Packed triangles, stored consecutively for every leaf
+		TrianglePacketArray trianglePackets;
+
+		// Every triangle of the scene exactly once
+		std::vector<KdTriangle> triangles;
+
+	};
+
+} // end of namespace raytracer
\ No newline at end of file
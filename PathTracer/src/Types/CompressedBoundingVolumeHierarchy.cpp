@@ -0,0 +1,281 @@
+/*
+ * CompressedBoundingVolumeHierarchy.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include "CompressedBoundingVolumeHierarchy.hpp"
+#include "exceptions.hpp"
+
+/*--------------------------------< Defines >--------------------------------------------*/
+
+// Four grid coordinates fit into one register, wider nodes use the scalar loop
+#if (WIDE_BVH_WIDTH == 4) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define COMPRESSED_BVH_SSE 1
+#include <emmintrin.h>
+#endif
+
+
+namespace raytracing
+{
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	// Grid spacings are built from the exponent bits, so they have to be normal floats
+	static constexpr int MIN_GRID_EXPONENT = -126;
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	/*static*/ CompressedBoundingVolumeHierarchy* CompressedBoundingVolumeHierarchy::build(const std::vector<KdTriangle>& triangles)
+	{
+		std::unique_ptr<BoundingVolumeHierarchy> bvh(BoundingVolumeHierarchy::build(triangles));
+
+		std::unique_ptr<CompressedBoundingVolumeHierarchy> compressedBvh(new CompressedBoundingVolumeHierarchy());
+		compressedBvh->nodes.reserve(bvh->nodes.size() / (CompressedBvhNode::WIDTH - 1) + 1);
+		compressedBvh->trianglePackets.reserve(bvh->trianglePackets.size());
+		compressedBvh->nodes.emplace_back();
+		compressedBvh->compress(*bvh, 0, 0);
+		compressedBvh->nodes.shrink_to_fit();
+
+		compressedBvh->triangles = std::move(bvh->triangles);
+
+		return compressedBvh.release();
+	}
+
+	bool CompressedBoundingVolumeHierarchy::calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection)
+	{
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		WideBvhNode decoded;
+		const bool intersects = WideBoundingVolumeHierarchy::intersectClosest(ray, *outIntersection,
+			[this, &decoded](const uint32_t nodeIndex) -> const WideBvhNode&
+			{
+				decode(this->nodes[nodeIndex], &decoded);
+				return decoded;
+			},
+			[this, &ray, outIntersection](const uint32_t packet, const uint32_t triangleCount)
+			{
+				return this->intersectTriangles(this->triangles, this->trianglePackets.data() + packet, triangleCount, ray, outIntersection);
+			},
+			&nodesVisited,
+			&trianglesTested);
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return intersects;
+	}
+
+	bool CompressedBoundingVolumeHierarchy::occluded(const aiRay& ray, const float tMax)
+	{
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		WideBvhNode decoded;
+		const bool occluded = WideBoundingVolumeHierarchy::intersectAny(ray, tMax,
+			[this, &decoded](const uint32_t nodeIndex) -> const WideBvhNode&
+			{
+				decode(this->nodes[nodeIndex], &decoded);
+				return decoded;
+			},
+			[this, &ray, tMax](const uint32_t packet, const uint32_t triangleCount)
+			{
+				return this->occludedTriangles(this->trianglePackets.data() + packet, triangleCount, ray, tMax);
+			},
+			&nodesVisited,
+			&trianglesTested);
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return occluded;
+	}
+
+	size_t CompressedBoundingVolumeHierarchy::getMemoryFootprint() const
+	{
+		return
+			sizeof(CompressedBoundingVolumeHierarchy) +
+			this->nodes.capacity() * sizeof(CompressedBvhNode) +
+			this->trianglePackets.capacity() * sizeof(TrianglePacket) +
+			this->triangles.capacity() * sizeof(KdTriangle);
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	void CompressedBoundingVolumeHierarchy::compress(const BoundingVolumeHierarchy& bvh, const uint32_t binaryIndex, const uint32_t nodeIndex)
+	{
+		uint32_t children[CompressedBvhNode::WIDTH];
+		const uint32_t childCount = WideBoundingVolumeHierarchy::selectChildren(bvh, binaryIndex, children);
+
+		// Reserve the interior children next to each other. Appending nodes invalidates references
+		const uint32_t childBase = static_cast<uint32_t>(this->nodes.size());
+		uint32_t interiorCount{ 0 };
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			interiorCount += bvh.nodes[children[i]].isLeaf() ? 0 : 1;
+		}
+		this->nodes.resize(this->nodes.size() + interiorCount);
+
+		const BvhNode& binaryNode = bvh.nodes[binaryIndex];
+		CompressedBvhNode& node = this->nodes[nodeIndex];
+		node.childBase = childBase;
+		node.packetBase = static_cast<uint32_t>(this->trianglePackets.size());
+		node.interiorMask = 0;
+
+		// Grid over the bounds of the binary node, which enclose all children
+		float spacing[3];
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			node.origin[axis] = binaryNode.min[axis];
+			node.exponent[axis] = getGridExponent(binaryNode.min[axis], binaryNode.max[axis]);
+			spacing[axis] = getGridSpacing(node.exponent[axis]);
+		}
+
+		uint8_t* lowerPlanes[3] = { node.minX, node.minY, node.minZ };
+		uint8_t* upperPlanes[3] = { node.maxX, node.maxY, node.maxZ };
+		for (uint32_t i = 0; i < CompressedBvhNode::WIDTH; i++)
+		{
+			if (i >= childCount)
+			{
+				// Inverted box, rejected by the slab test for every ray direction
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					lowerPlanes[axis][i] = GRID_MAX;
+					upperPlanes[axis][i] = 0;
+				}
+				node.triangleCount[i] = 0;
+				continue;
+			}
+
+			const BvhNode& binaryChild = bvh.nodes[children[i]];
+			if (binaryChild.isLeaf())
+			{
+				if (binaryChild.triangleCount > UINT8_MAX)
+				{
+					throw AccStructure("Leaf holds too many triangles for a compressed node");
+				}
+				const uint32_t packetCount = TrianglePacket::getPacketCount(binaryChild.triangleCount);
+				this->trianglePackets.insert(
+					this->trianglePackets.end(),
+					bvh.trianglePackets.begin() + binaryChild.offset,
+					bvh.trianglePackets.begin() + binaryChild.offset + packetCount);
+				node.triangleCount[i] = static_cast<uint8_t>(binaryChild.triangleCount);
+			}
+			else
+			{
+				node.interiorMask |= static_cast<uint8_t>(1U << i);
+				node.triangleCount[i] = 0;
+			}
+
+			// Round outwards, so the decoded box always encloses the child. The planes are
+			// checked with the same arithmetic as the decoding
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				const float origin = node.origin[axis];
+				int32_t lower = static_cast<int32_t>(std::floor((binaryChild.min[axis] - origin) / spacing[axis]));
+				lower = std::max(0, std::min(static_cast<int32_t>(GRID_MAX), lower));
+				while ((lower > 0) && (origin + lower * spacing[axis] > binaryChild.min[axis]))
+				{
+					lower--;
+				}
+
+				int32_t upper = static_cast<int32_t>(std::ceil((binaryChild.max[axis] - origin) / spacing[axis]));
+				upper = std::max(0, std::min(static_cast<int32_t>(GRID_MAX), upper));
+				while ((upper < static_cast<int32_t>(GRID_MAX)) && (origin + upper * spacing[axis] < binaryChild.max[axis]))
+				{
+					upper++;
+				}
+
+				lowerPlanes[axis][i] = static_cast<uint8_t>(lower);
+				upperPlanes[axis][i] = static_cast<uint8_t>(upper);
+			}
+		}
+
+		uint32_t interiorChild = childBase;
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			if (!bvh.nodes[children[i]].isLeaf())
+			{
+				this->compress(bvh, children[i], interiorChild++);
+			}
+		}
+	}
+
+	/*static*/ void CompressedBoundingVolumeHierarchy::decode(const CompressedBvhNode& node, WideBvhNode* outNode)
+	{
+		const float spacingX = getGridSpacing(node.exponent[0]);
+		const float spacingY = getGridSpacing(node.exponent[1]);
+		const float spacingZ = getGridSpacing(node.exponent[2]);
+
+		// Products of a grid coordinate and a power of two are exact, only the sum is rounded
+#if COMPRESSED_BVH_SSE
+		const auto decodePlanes = [](const uint8_t* coordinates, const float origin, const float spacing, float* outPlanes)
+		{
+			int32_t packed;
+			std::memcpy(&packed, coordinates, sizeof(packed));
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i widened = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+			_mm_store_ps(outPlanes, _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_set1_ps(spacing))));
+		};
+		decodePlanes(node.minX, node.origin[0], spacingX, outNode->minX);
+		decodePlanes(node.minY, node.origin[1], spacingY, outNode->minY);
+		decodePlanes(node.minZ, node.origin[2], spacingZ, outNode->minZ);
+		decodePlanes(node.maxX, node.origin[0], spacingX, outNode->maxX);
+		decodePlanes(node.maxY, node.origin[1], spacingY, outNode->maxY);
+		decodePlanes(node.maxZ, node.origin[2], spacingZ, outNode->maxZ);
+#else
+		for (uint32_t i = 0; i < CompressedBvhNode::WIDTH; i++)
+		{
+			outNode->minX[i] = node.origin[0] + node.minX[i] * spacingX;
+			outNode->minY[i] = node.origin[1] + node.minY[i] * spacingY;
+			outNode->minZ[i] = node.origin[2] + node.minZ[i] * spacingZ;
+			outNode->maxX[i] = node.origin[0] + node.maxX[i] * spacingX;
+			outNode->maxY[i] = node.origin[1] + node.maxY[i] * spacingY;
+			outNode->maxZ[i] = node.origin[2] + node.maxZ[i] * spacingZ;
+		}
+#endif
+
+		// Interior children and leaf packets follow each other in slot order
+		uint32_t childIndex = node.childBase;
+		uint32_t packetIndex = node.packetBase;
+		for (uint32_t i = 0; i < CompressedBvhNode::WIDTH; i++)
+		{
+			outNode->triangleCount[i] = node.triangleCount[i];
+			if (node.interiorMask & (1U << i))
+			{
+				outNode->child[i] = childIndex++;
+			}
+			else
+			{
+				outNode->child[i] = packetIndex;
+				packetIndex += TrianglePacket::getPacketCount(node.triangleCount[i]);
+			}
+		}
+	}
+
+	/*static*/ int8_t CompressedBoundingVolumeHierarchy::getGridExponent(const float lower, const float upper)
+	{
+		int exponent{ 0 };
+		std::frexp((upper - lower) / GRID_MAX, &exponent);
+		exponent = std::max(MIN_GRID_EXPONENT, exponent);
+
+		// The division and the sum round, so make sure the last plane is not below the upper bound
+		while (lower + GRID_MAX * getGridSpacing(static_cast<int8_t>(exponent)) < upper)
+		{
+			exponent++;
+		}
+		return static_cast<int8_t>(exponent);
+	}
+
+	/*static*/ float CompressedBoundingVolumeHierarchy::getGridSpacing(const int8_t exponent)
+	{
+		// Powers of two only need the exponent bits
+		const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+		float spacing;
+		std::memcpy(&spacing, &bits, sizeof(float));
+		return spacing;
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
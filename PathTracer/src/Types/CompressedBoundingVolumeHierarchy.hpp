@@ -0,0 +1,136 @@
+/*
+ * CompressedBoundingVolumeHierarchy.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <vector>
+
+#include "assimp/types.h"
+#include "assimp/mesh.h"
+
+#include "raytracing.hpp"
+#include "settings.hpp"
+#include "AccelerationStructure.hpp"
+#include "BoundingVolumeHierarchy.hpp"
+#include "WideBoundingVolumeHierarchy.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Wide node with the child bounds quantized to 8 bits per plane. The planes lie on a grid
+	// starting at the lower corner of the node, spaced by a power of two per axis, so decoding
+	// is exact. Interior children and the triangle packets of leaf children are stored
+	// consecutively in slot order, so the node only needs the first index of each.
+	struct CompressedBvhNode
+	{
+		static constexpr uint32_t WIDTH = WIDE_BVH_WIDTH;
+
+		// Lower corner of the node bounds, origin of the grid
+		float origin[3];
+
+		// Grid spacing of every axis as exponent of two
+		int8_t exponent[3];
+
+		// One bit per slot holding an interior child
+		uint8_t interiorMask;
+
+		// Index of the first interior child
+		uint32_t childBase;
+
+		// First triangle packet of the leaf children
+		uint32_t packetBase;
+
+		// Number of triangles of leaf children, zero for interior children and unused slots
+		uint8_t triangleCount[WIDTH];
+
+		// Child bounds in grid cells. Unused slots hold an inverted box, which is never hit
+		uint8_t minX[WIDTH];
+
+		uint8_t minY[WIDTH];
+
+		uint8_t minZ[WIDTH];
+
+		uint8_t maxX[WIDTH];
+
+		uint8_t maxY[WIDTH];
+
+		uint8_t maxZ[WIDTH];
+	};
+
+	static_assert(sizeof(CompressedBvhNode) == 24 + 7 * WIDE_BVH_WIDTH, "Compressed BVH nodes are expected to be tightly packed");
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Wide bounding volume hierarchy with quantized nodes. Built like the wide BVH by collapsing
+	// the binary binned SAH hierarchy, but each node takes 2.5 (4-wide) to 3.2 (8-wide) times
+	// less memory. Bounds are decoded during traversal and are slightly conservative, so rays
+	// visit a few more nodes than in the uncompressed hierarchy.
+	class CompressedBoundingVolumeHierarchy : public AccelerationStructure
+	{
+
+	// Largest coordinate of the quantization grid
+	static constexpr uint32_t GRID_MAX = UINT8_MAX;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		static CompressedBoundingVolumeHierarchy* build(const std::vector<KdTriangle>& triangles);
+
+		virtual bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) override;
+
+		virtual bool occluded(const aiRay& ray, const float tMax) override;
+
+		virtual size_t getMemoryFootprint() const override;
+
+		inline size_t getNodeCount() const
+		{
+			return this->nodes.size();
+		}
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		CompressedBoundingVolumeHierarchy() = default;
+
+		// Fills the node at nodeIndex with the binary subtree below binaryIndex, cut off at the
+		// WIDTH nodes with the largest surface area, and compresses its children recursively
+		void compress(const BoundingVolumeHierarchy& bvh, const uint32_t binaryIndex, const uint32_t nodeIndex);
+
+		// Decodes the child bounds and references into the layout of an uncompressed node, so
+		// the children are tested with the slab test of the wide hierarchy
+		static void decode(const CompressedBvhNode& node, WideBvhNode* outNode);
+
+		// Smallest power of two grid spanning [lower, upper] with GRID_MAX cells
+		static int8_t getGridExponent(const float lower, const float upper);
+
+		static float getGridSpacing(const int8_t exponent);
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		// All nodes, starting with the root node. Siblings are stored consecutively
+		std::vector<CompressedBvhNode, utility::AlignedAllocator<CompressedBvhNode>> nodes;
+
+		// Packed triangles, stored consecutively for the leaves of every node
+		TrianglePacketArray trianglePackets;
+
+		// Every triangle of the scene exactly once
+		std::vector<KdTriangle> triangles;
+
+	};
+
+} // end of namespace raytracer
\ No newline at end of file
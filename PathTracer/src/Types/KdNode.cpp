@@ -5,8 +5,10 @@
 /*--------------------------------< Includes >-------------------------------------------*/
 #include <algorithm>
 #include <iostream>
+#include <future>
 
 #include "KdNode.hpp"
+#include "SceneDatabase.hpp"
 #include "Utility/mathUtility.hpp"
 #include "exceptions.hpp"
 
@@ -23,140 +25,100 @@ namespace raytracing
 		
 	/*--------------------------------< Public members >-------------------------------------*/
 
-	/*static*/ KdNode* KdNode::buildTree(std::vector<KdTriangle>& triangles)
+	/*static*/ KdNode* KdNode::buildTree(const std::vector<KdTriangle>& triangles, MemoryArena& arena)
 	{
 		// Create BBox of full scene
 		BoundingBox rootBox(triangles);
 
+		std::vector<uint32_t> triangleIndices(triangles.size());
+		for (uint32_t index = 0; index < triangles.size(); index++)
+		{
+			triangleIndices[index] = index;
+		}
+
 		// Start recursive build of tree
-		return build(triangles, rootBox);
+		return build(triangles, triangleIndices, rootBox, arena);
 	}
 
-	/*static*/ KdNode* KdNode::buildTreeSAH(std::vector<KdTriangle>& triangles)
+	/*static*/ KdNode* KdNode::buildTreeSAH(
+		const std::vector<KdTriangle>& triangles,
+		std::vector<MemoryArena>& arenas,
+		const unsigned int deferDepth/* = MAX_DEPTH*/,
+		const BoundingBox* region/* = nullptr*/)
 	{
 		// Create BBox of full scene
 		BoundingBox rootBox(triangles);
 
-		// Start recursive build of tree using surface area heuristic
-		return buildSAH(triangles, rootBox);
-	}
-
-	bool KdNode::calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection)
-	{
-		if (!this->boundingBox.intersects(ray))
+		// Bounds of every triangle are computed once and shared by all nodes
+		std::vector<BoundingBox> triangleBounds;
+		triangleBounds.reserve(triangles.size());
+		for (const KdTriangle& triangle : triangles)
 		{
-			// Ray does not intersect with this trees bounding box 
-			// and therefore neither with a bounding box of a subtree
-			return false;
+			triangleBounds.emplace_back(triangle);
 		}
 
-		bool leftHit{ false }, rightHit{ false };
-		// If a node is no leaf node, it always has two subtrees
-		if (this->left && this->right)
+		// Triangles of a region reach into neighbouring ones. Only the part inside is split,
+		// like the clipped triangles of a node split by the full build.
+		if (region)
 		{
-			// This node has subtrees
-			leftHit = this->left->calculateIntersection(ray, outIntersection);
-			rightHit = this->right->calculateIntersection(ray, outIntersection);
-			return leftHit || rightHit;
+			rootBox.clipToBox(*region);
+			for (BoundingBox& bounds : triangleBounds)
+			{
+				bounds.clipToBox(*region);
+			}
 		}
 
-		bool intersects{ false };
-		std::vector<aiVector3D*> nearestIntersectedTriangle;
-		std::vector<aiVector3D*> triangleVertexNormals;
-		std::vector<aiVector3D*> textureCoordinates;
-		aiVector3D intersectionPoint;
-		aiVector2D uvCoordinates;
-
-		if (!this->left && !this->right)
+		// Events of all dimensions are sorted only once. Splitting them preserves the order.
+		std::vector<Event> events;
+		events.reserve(triangles.size() * 2 * MAX_TREE_DIMENSION);
+		for (uint32_t index = 0; index < triangles.size(); index++)
 		{
-			// This is a leaf node
-			// Check triangles for intersection
-			for (KdTriangle& currentPair : this->containedTriangles)
-			{
-				aiFace* currentFace{ currentPair.faceMeshPair.first };
-				aiMesh* associatedMesh{ currentPair.faceMeshPair.second };
-
-				for (unsigned int currentIndex = 0; currentIndex < currentFace->mNumIndices; currentIndex++)
-				{
-					nearestIntersectedTriangle.push_back(&(associatedMesh->mVertices[currentFace->mIndices[currentIndex]]));
-					triangleVertexNormals.push_back(&(associatedMesh->mNormals[currentFace->mIndices[currentIndex]]));
-					// Always use first texture channel
-					textureCoordinates.push_back(&(associatedMesh->mTextureCoords[0][currentFace->mIndices[currentIndex]]));
-				}
-				bool intersectsCurrentTriangle = mathUtility::rayTriangleIntersection(ray, nearestIntersectedTriangle, &intersectionPoint, &uvCoordinates);
-				// We can immediately return if the cast ray is a shadow ray
-				if (intersectsCurrentTriangle && (ray.type == RayType::SHADOW))
-				{
-					return true;
-				}
-				float distanceToIntersectionPoint = (intersectionPoint - ray.pos).Length();
-				if (intersectsCurrentTriangle && (distanceToIntersectionPoint < outIntersection->intersectionDistance))
-				{
-					outIntersection->intersectionDistance = distanceToIntersectionPoint;
-					outIntersection->hitMesh = associatedMesh;
-					outIntersection->hitTriangle = nearestIntersectedTriangle;
-					outIntersection->hitPoint = intersectionPoint;
-					outIntersection->ray = ray;
-					outIntersection->uv = uvCoordinates;
-					// Always use first texture channel
-					if (associatedMesh->HasTextureCoords(0))
-					{
-						outIntersection->uvTextureCoords =
-							(1 - uvCoordinates.x - uvCoordinates.y) * 
-							*(textureCoordinates[0]) + uvCoordinates.x *
-							*(textureCoordinates[1]) + uvCoordinates.y *
-							*(textureCoordinates[2]);
-					}
-					outIntersection->vertexNormals = triangleVertexNormals;
-					outIntersection->textureCoordinates = textureCoordinates;
-					intersects = true;
-				}
-				nearestIntersectedTriangle.clear();
-				triangleVertexNormals.clear();
-				textureCoordinates.clear();
-			}
-			return intersects;
+			createEvents(index, triangleBounds[index], &events);
 		}
-		return leftHit || rightHit || intersects; // This case may not occur
+		std::sort(events.begin(), events.end(), compareEvents);
+
+		KdBuildContext context(triangleBounds, arenas, deferDepth);
+
+		// Start recursive build of tree using surface area heuristic
+		return buildSAH(events, context, 0, rootBox);
 	}
 
 	/*--------------------------------< Protected members >----------------------------------*/
 		
 	/*--------------------------------< Private members >------------------------------------*/
 
-	/*static*/ KdNode* KdNode::build(std::vector<KdTriangle>& triangles, BoundingBox& bBox, unsigned int depth/* = 1*/)
+	/*static*/ KdNode* KdNode::build(
+		const std::vector<KdTriangle>& triangles,
+		std::vector<uint32_t>& triangleIndices,
+		BoundingBox& bBox,
+		MemoryArena& arena,
+		unsigned int depth/* = 1*/)
 	{
 		const float EPSILON = 1e-3f;
 
-		if ((triangles.size() <= MAX_TRIANGLES_PER_LEAF) || (depth == MAX_DEPTH))
+		if ((triangleIndices.size() <= MAX_TRIANGLES_PER_LEAF) || (depth == MAX_DEPTH))
 		{
 			// Return leaf node
-			return new KdNode(triangles, bBox);
+			return createLeaf(triangleIndices, bBox, arena);
 		}
 
 		// Find plane to split
 		Axis longestAxis = bBox.getLongestAxis();
 
 		// Sort triangles
-		auto compareTriangles = [longestAxis](const KdTriangle& t1, const KdTriangle& t2) -> bool
+		auto compareTriangles = [&triangles, longestAxis](const uint32_t i1, const uint32_t i2) -> bool
 		{
-			aiFace* t1Face = t1.faceMeshPair.first;
-			aiMesh* t1Mesh = t1.faceMeshPair.second;
-			aiFace* t2Face = t2.faceMeshPair.first;
-			aiMesh* t2Mesh = t2.faceMeshPair.second;
+			const KdTriangle& t1 = triangles[i1];
+			const KdTriangle& t2 = triangles[i2];
 			return
-				((t1Mesh->mVertices[t1Face->mIndices[0]][longestAxis] +
-					t1Mesh->mVertices[t1Face->mIndices[1]][longestAxis] +
-					t1Mesh->mVertices[t1Face->mIndices[2]][longestAxis]) / 3.f) <
-					((t2Mesh->mVertices[t2Face->mIndices[0]][longestAxis] +
-						t2Mesh->mVertices[t2Face->mIndices[1]][longestAxis] +
-						t2Mesh->mVertices[t2Face->mIndices[2]][longestAxis]) / 3.f);
+				((t1.getVertex(0)[longestAxis] + t1.getVertex(1)[longestAxis] + t1.getVertex(2)[longestAxis]) / 3.f) <
+				((t2.getVertex(0)[longestAxis] + t2.getVertex(1)[longestAxis] + t2.getVertex(2)[longestAxis]) / 3.f);
 		};
-		sort(triangles.begin(), triangles.end(), compareTriangles);
+		sort(triangleIndices.begin(), triangleIndices.end(), compareTriangles);
 
 		// Find median to split
 		const float WEIGHT = 0.1f;
-		BoundingBox medianTriBox{ triangles[triangles.size() / 2].faceMeshPair };
+		BoundingBox medianTriBox{ triangles[triangleIndices[triangleIndices.size() / 2]] };
 		aiVector3D center = bBox.getCenter();
 		aiVector3D medianCenter = medianTriBox.getCenter();
 		float planePosition = center[longestAxis] - ((center[longestAxis] - medianCenter[longestAxis]) * WEIGHT);
@@ -169,12 +131,12 @@ namespace raytracing
 
 		// Add left and overlapping tris to left
 		// Add right and overlapping tris to right
-		std::vector<KdTriangle> trianglesLeft;
-		std::vector<KdTriangle> trianglesRight;
+		std::vector<uint32_t> trianglesLeft;
+		std::vector<uint32_t> trianglesRight;
 
-		for (KdTriangle& triangle : triangles)
+		for (const uint32_t triangle : triangleIndices)
 		{
-			BoundingBox triangleBounds{ triangle };
+			BoundingBox triangleBounds{ triangles[triangle] };
 
 			if (triangleBounds.getMin()[longestAxis] < (splittingPlane.getPosition() + EPSILON))
 			{
@@ -187,39 +149,62 @@ namespace raytracing
 		}
 
 		// To avoid endless recursion for some cases
-		bool leftIndivisible = trianglesLeft.size() == triangles.size();
-		bool rightIndivisible = trianglesRight.size() == triangles.size();
+		bool leftIndivisible = trianglesLeft.size() == triangleIndices.size();
+		bool rightIndivisible = trianglesRight.size() == triangleIndices.size();
 		if ((leftIndivisible && rightIndivisible) && (depth >= MIN_DEPTH))
 		{
 			// No further division of both branches possible
-			return new KdNode(splittingPlane, new KdNode(trianglesLeft, leftBox), new KdNode(trianglesRight, rightBox), bBox);
+			return arena.create<KdNode>(splittingPlane, createLeaf(trianglesLeft, leftBox, arena), createLeaf(trianglesRight, rightBox, arena), bBox);
 		}
 		else if (leftIndivisible && (depth >= MIN_DEPTH))
 		{
 			// No further division of left branch possible
-			return new KdNode(splittingPlane, new KdNode(trianglesLeft, leftBox), build(trianglesRight, rightBox, depth + 1), bBox);
+			return arena.create<KdNode>(splittingPlane, createLeaf(trianglesLeft, leftBox, arena), build(triangles, trianglesRight, rightBox, arena, depth + 1), bBox);
 		}
 		else if (rightIndivisible && (depth >= MIN_DEPTH))
 		{
 			// No further division of right branch possible
-			return new KdNode(splittingPlane, build(trianglesLeft, leftBox, depth + 1), new KdNode(trianglesRight, rightBox), bBox);
+			return arena.create<KdNode>(splittingPlane, build(triangles, trianglesLeft, leftBox, arena, depth + 1), createLeaf(trianglesRight, rightBox, arena), bBox);
 		}
 
-		return new KdNode(splittingPlane, build(trianglesLeft, leftBox, depth + 1), build(trianglesRight, rightBox, depth + 1), bBox);
+		return arena.create<KdNode>(splittingPlane, build(triangles, trianglesLeft, leftBox, arena, depth + 1), build(triangles, trianglesRight, rightBox, arena, depth + 1), bBox);
 	}
 
 	/*static*/ KdNode* KdNode::buildSAH(
-		std::vector<KdTriangle>& triangles,
-		BoundingBox bBox,
+		const std::vector<Event>& events,
+		KdBuildContext& context,
+		const uint32_t worker,
+		const BoundingBox& bBox,
 		unsigned int depth/* = 0*/)
 	{
+		MemoryArena& arena = context.arenas[worker];
+		if (depth >= MAX_DEPTH)
+		{
+			// Bound the depth to keep the traversal stack of the flattened tree finite
+			return createLeaf(events, bBox, arena);
+		}
+
+		if (depth >= context.deferDepth)
+		{
+			// Split later by the traversal once a ray reaches the node
+			KdNode* leaf = createLeaf(events, bBox, arena);
+			leaf->deferred = true;
+			return leaf;
+		}
+
+		// Every triangle has either a start or a planar event in each dimension
+		const int64_t triangleCount = std::count_if(events.begin(), events.end(), [](const Event& event)
+		{
+			return (event.dimension == Axis::X) && (event.type != EventType::END);
+		});
+
 		// Find plane to split
 		float minCost;
-		std::pair<Plane, ChildSide> bestPlane = findPlane(triangles, bBox, &minCost);
+		std::pair<Plane, ChildSide> bestPlane = findPlane(events, triangleCount, bBox, context, &minCost);
 
-		if ((terminate(triangles.size(), minCost)))
+		if (terminate(static_cast<unsigned int>(triangleCount), minCost))
 		{
-			return new KdNode(triangles, bBox);
+			return createLeaf(events, bBox, arena);
 		}
 
 		// Split root box
@@ -227,16 +212,62 @@ namespace raytracing
 		BoundingBox rightBox;
 		bBox.split(leftBox, rightBox, bestPlane.first);
 
-		// Classify triangles corresponding to splitting plane
-		std::vector<KdTriangle> trianglesLeft;
-		std::vector<KdTriangle> trianglesRight;
-		classifyTriangles(triangles, bestPlane, &trianglesLeft, &trianglesRight);
-
-		return new KdNode(
-			bestPlane.first, 
-			buildSAH(trianglesLeft, leftBox, depth + 1),
-			buildSAH(trianglesRight, rightBox, depth + 1),
-			bBox);
+		// Classify triangles corresponding to splitting plane and split the sorted events into the
+		// buffers of this depth. They keep their capacity from previous nodes at the same depth, so
+		// the build only allocates when a depth holds more events than ever before.
+		KdBuildScratch& scratch = context.scratches[worker];
+		while (scratch.childEventsLeft.size() <= depth)
+		{
+			scratch.childEventsLeft.emplace_back();
+			scratch.childEventsRight.emplace_back();
+		}
+		std::vector<Event>& eventsLeft = scratch.childEventsLeft[depth];
+		std::vector<Event>& eventsRight = scratch.childEventsRight[depth];
+		classifyTriangles(events, bestPlane, context.triangleBounds, scratch, leftBox, rightBox, &eventsLeft, &eventsRight);
+		const size_t eventCount = events.size();
+
+		KdNode* leftChild{ nullptr };
+		KdNode* rightChild{ nullptr };
+		uint32_t taskWorker{ 0 };
+		if ((eventCount >= PARALLEL_BUILD_CUTOFF) && context.acquireWorker(&taskWorker))
+		{
+			// Build the left subtree as parallel task in another worker slot. It needs its own
+			// classification and depth buffers since both subtrees contain the same depths and may
+			// contain the same triangles.
+			std::future<KdNode*> leftTask = std::async(std::launch::async, [&]() -> KdNode*
+			{
+				KdNode* node{ nullptr };
+				try
+				{
+					node = buildSAH(eventsLeft, context, taskWorker, leftBox, depth + 1);
+				}
+				catch (...)
+				{
+					context.releaseWorker(taskWorker);
+					throw;
+				}
+				context.releaseWorker(taskWorker);
+				return node;
+			});
+			try
+			{
+				rightChild = buildSAH(eventsRight, context, worker, rightBox, depth + 1);
+			}
+			catch (...)
+			{
+				// Wait for the task before its captured references go out of scope. Its nodes
+				// are freed with the arenas.
+				leftTask.wait();
+				throw;
+			}
+			leftChild = leftTask.get();
+		}
+		else
+		{
+			leftChild = buildSAH(eventsLeft, context, worker, leftBox, depth + 1);
+			rightChild = buildSAH(eventsRight, context, worker, rightBox, depth + 1);
+		}
+		return arena.create<KdNode>(bestPlane.first, leftChild, rightChild, bBox);
 	}
 
 	std::pair<float, ChildSide> KdNode::SAH(
@@ -257,7 +288,9 @@ namespace raytracing
 		const float probabilityRight = rightBox.getSurfaceArea() / box.getSurfaceArea();
 		const float costLeft = costHeuristic(probabilityLeft, probabilityRight, triangleCountLeft + triangleCountOverlap, triangleCountRight);
 		const float costRight = costHeuristic(probabilityLeft, probabilityRight, triangleCountLeft, triangleCountRight + triangleCountOverlap);
-		return std::make_pair<float, ChildSide>(costLeft < costRight ? costLeft, ChildSide::LEFT : costRight, ChildSide::RIGHT);
+		return costLeft < costRight ?
+			std::make_pair(costLeft, ChildSide::LEFT) :
+			std::make_pair(costRight, ChildSide::RIGHT);
 	}
 
 	float KdNode::costHeuristic(
@@ -278,135 +311,291 @@ namespace raytracing
 	}
 
 	std::pair<Plane, ChildSide> KdNode::findPlane(
-		std::vector<KdTriangle>& triangles,
+		const std::vector<Event>& events,
+		const int64_t triangleCount,
 		const BoundingBox& bBox,
+		KdBuildContext& context,
 		float* outCost)
 	{
-		*outCost = std::numeric_limits<float>::infinity();
-		Plane bestPlane;
-		ChildSide childSide{ ChildSide::UNDEFINED };
+		SplitCandidate candidates[MAX_TREE_DIMENSION];
 
-		for (unsigned int k = 0; k < MAX_TREE_DIMENSION; k++)
+		uint32_t sweepWorker{ 0 };
+		if ((events.size() >= PARALLEL_SWEEP_CUTOFF) && context.acquireWorker(&sweepWorker))
 		{
-			Axis axis = static_cast<Axis>(k);
-			std::vector<Event> eventlist;
-			for (KdTriangle& triangle : triangles)
+			// Sweep the second dimension in parallel and the other two in one pass on this
+			// thread. Only happens for the few huge nodes near the root.
+			std::future<void> task = std::async(std::launch::async, [&]()
 			{
-				BoundingBox triBox(triangle);
-				triBox.clipToBox(bBox);
-				if (triBox.isPlanar(axis))
-				{
-					eventlist.push_back({ triBox.getMin()[k], axis, EventType::PLANAR, triangle});
-				}
-				else
-				{
-					eventlist.push_back({ triBox.getMin()[k], axis, EventType::START, triangle });
-					eventlist.push_back({ triBox.getMax()[k], axis, EventType::END, triangle });
-				}
+				sweep(events, 1U << Axis::Y, triangleCount, bBox, candidates);
+				context.releaseWorker(sweepWorker);
+			});
+			sweep(events, (1U << Axis::X) | (1U << Axis::Z), triangleCount, bBox, candidates);
+			task.get();
+		}
+		else
+		{
+			sweep(events, ALL_DIMENSIONS, triangleCount, bBox, candidates);
+		}
+
+		// Combine in fixed order to select the same plane regardless of parallel execution
+		SplitCandidate* best = &candidates[Axis::X];
+		for (uint8_t k = 1; k < MAX_TREE_DIMENSION; k++)
+		{
+			if (candidates[k].cost < best->cost)
+			{
+				best = &candidates[k];
 			}
-			sort(eventlist.begin(), eventlist.end(), compareEvents);
+		}
 
-			// iteratively "sweep" plane over all split candidates
-			uint64_t triangleCountLeft = 0;
-			uint64_t triangleCountOverlap = 0;
-			uint64_t triangleCountRight = triangles.size(); // start with all tris on right
+		*outCost = best->cost;
+		return std::make_pair(best->plane, best->side);
+	}
 
-			for (unsigned int i = 0; i < eventlist.size();)
+	/*static*/ void KdNode::sweep(
+		const std::vector<Event>& events,
+		const uint32_t dimensions,
+		const int64_t triangleCount,
+		const BoundingBox& bBox,
+		SplitCandidate* outCandidates)
+	{
+		// iteratively "sweep" plane over all split candidates, counting separately per dimension
+		int64_t triangleCountLeft[MAX_TREE_DIMENSION] = { 0, 0, 0 };
+		int64_t triangleCountRight[MAX_TREE_DIMENSION] = { triangleCount, triangleCount, triangleCount }; // start with all tris on right
+
+		for (size_t i = 0; i < events.size();)
+		{
+			const Axis axis = events[i].dimension;
+			if ((dimensions & (1U << axis)) == 0)
 			{
-				Plane p(eventlist.at(i).position, eventlist.at(i).dimension);
-				int64_t start{ 0 };
-				int64_t end{ 0 };
-				int64_t inPlane{ 0 };
+				// Swept by another call
+				i++;
+				continue;
+			}
 
-				while ((i < eventlist.size()) && (eventlist.at(i).position == p.getPosition()) && (eventlist.at(i).type == EventType::END))
-				{
-					end++;
-					i++;
-				}
+			// Events of one plane are adjacent, as they are sorted by position and dimension first
+			Plane p(events[i].position, axis);
+			int64_t start{ 0 };
+			int64_t end{ 0 };
+			int64_t inPlane{ 0 };
 
-				while ((i < eventlist.size()) && (eventlist.at(i).position == p.getPosition()) && (eventlist.at(i).type == EventType::PLANAR))
-				{
-					inPlane++;
-					i++;
-				}
+			auto onPlane = [&events, &p, &i](const EventType type) -> bool
+			{
+				return
+					(i < events.size()) &&
+					(events[i].dimension == p.getAxis()) &&
+					(events[i].position == p.getPosition()) &&
+					(events[i].type == type);
+			};
+
+			while (onPlane(EventType::END))
+			{
+				end++;
+				i++;
+			}
 
-				while ((i < eventlist.size()) && (eventlist.at(i).position == p.getPosition()) && (eventlist.at(i).type == EventType::START))
-				{
-					start++;
-					i++;
-				}
+			while (onPlane(EventType::PLANAR))
+			{
+				inPlane++;
+				i++;
+			}
 
-				// Now the next plane p is found with start, end and inPlane
-				// move plane onto p
-				triangleCountOverlap = inPlane;
-				triangleCountRight -= inPlane;
-				triangleCountRight -= end;
-				std::pair<float, ChildSide> result = SAH(p, bBox, triangleCountLeft, triangleCountRight, triangleCountOverlap);
-				if (result.first < *outCost)
-				{
-					*outCost = result.first;
-					bestPlane = p;
-					childSide = result.second;
-				}
-				triangleCountLeft += start;
-				triangleCountLeft += inPlane;
-				triangleCountOverlap = 0; // move plane over p
+			while (onPlane(EventType::START))
+			{
+				start++;
+				i++;
 			}
-		}
 
-		return std::make_pair(bestPlane, childSide);
+			// Now the next plane p is found with start, end and inPlane
+			// move plane onto p, the planar triangles overlap it
+			triangleCountRight[axis] -= inPlane;
+			triangleCountRight[axis] -= end;
+			std::pair<float, ChildSide> result = SAH(p, bBox, triangleCountLeft[axis], triangleCountRight[axis], inPlane);
+			SplitCandidate& best = outCandidates[axis];
+			if (result.first < best.cost)
+			{
+				best.cost = result.first;
+				best.plane = p;
+				best.side = result.second;
+			}
+			triangleCountLeft[axis] += start;
+			triangleCountLeft[axis] += inPlane; // move plane over p
+		}
 	}
 
 	/*static*/ void KdNode::classifyTriangles(
-		std::vector<KdTriangle>& triangles,
-		std::pair<Plane, ChildSide>& splittingPlane,
-		std::vector<KdTriangle>* outTrianglesLeft,
-		std::vector<KdTriangle>* outTrianglesRight)
+		const std::vector<Event>& events,
+		const std::pair<Plane, ChildSide>& splittingPlane,
+		const std::vector<BoundingBox>& triangleBounds,
+		KdBuildScratch& scratch,
+		const BoundingBox& leftBox,
+		const BoundingBox& rightBox,
+		std::vector<Event>* outEventsLeft,
+		std::vector<Event>* outEventsRight)
 	{
-		Plane& plane{ splittingPlane.first };
-		ChildSide planeSide{ splittingPlane.second };
+		const Plane& plane{ splittingPlane.first };
+		const ChildSide planeSide{ splittingPlane.second };
+
+		if ((planeSide != ChildSide::LEFT) && (planeSide != ChildSide::RIGHT))
+		{
+			// This case should not occur!
+			throw AccStructure("Error classifying triangles");
+		}
+
+		std::vector<ChildSide>& triangleSides = scratch.triangleSides;
 
-		for (KdTriangle& tri : triangles)
+		// Every triangle overlaps both children until proven otherwise
+		for (const Event& event : events)
 		{
-			BoundingBox triBox(tri);
-			if ((triBox.getMin()[plane.getAxis()] == plane.getPosition()) &&
-				(triBox.getMax()[plane.getAxis()] == plane.getPosition()))
+			triangleSides[event.triangle] = ChildSide::BOTH;
+		}
+
+		// Only events in the dimension of the plane decide the side of a triangle
+		for (const Event& event : events)
+		{
+			if (event.dimension != plane.getAxis())
 			{
-				if (planeSide == ChildSide::LEFT)
+				continue;
+			}
+
+			if ((event.type == EventType::END) && (event.position <= plane.getPosition()))
+			{
+				triangleSides[event.triangle] = ChildSide::LEFT;
+			}
+			else if ((event.type == EventType::START) && (event.position >= plane.getPosition()))
+			{
+				triangleSides[event.triangle] = ChildSide::RIGHT;
+			}
+			else if (event.type == EventType::PLANAR)
+			{
+				if (event.position < plane.getPosition())
 				{
-					outTrianglesLeft->push_back(tri);
+					triangleSides[event.triangle] = ChildSide::LEFT;
 				}
-				else if (planeSide == ChildSide::RIGHT)
+				else if (event.position > plane.getPosition())
 				{
-					outTrianglesRight->push_back(tri);
+					triangleSides[event.triangle] = ChildSide::RIGHT;
 				}
 				else
 				{
-					// This case should not occur!
-					throw AccStructure("Error classifying triangles");
+					triangleSides[event.triangle] = planeSide;
 				}
 			}
+		}
+
+		// Events of triangles on one side only are moved to that side in sorted order.
+		// Triangles overlapping both sides are clipped to the child boxes and get new events.
+		// The buffers keep their capacity from previous nodes.
+		std::vector<Event>& eventsLeftOnly = scratch.eventsLeftOnly;
+		std::vector<Event>& eventsRightOnly = scratch.eventsRightOnly;
+		std::vector<Event>& eventsBothLeft = scratch.eventsBothLeft;
+		std::vector<Event>& eventsBothRight = scratch.eventsBothRight;
+		eventsLeftOnly.clear();
+		eventsRightOnly.clear();
+		eventsBothLeft.clear();
+		eventsBothRight.clear();
+
+		for (const Event& event : events)
+		{
+			const ChildSide side = triangleSides[event.triangle];
+			if (side == ChildSide::LEFT)
+			{
+				eventsLeftOnly.push_back(event);
+			}
+			else if (side == ChildSide::RIGHT)
+			{
+				eventsRightOnly.push_back(event);
+			}
+			else if ((event.dimension == Axis::X) && (event.type != EventType::END))
+			{
+				BoundingBox clippedLeft{ triangleBounds[event.triangle] };
+				clippedLeft.clipToBox(leftBox);
+				createEvents(event.triangle, clippedLeft, &eventsBothLeft);
+
+				BoundingBox clippedRight{ triangleBounds[event.triangle] };
+				clippedRight.clipToBox(rightBox);
+				createEvents(event.triangle, clippedRight, &eventsBothRight);
+			}
+		}
+
+		// Only the few new events need sorting, merging keeps the whole operation linear
+		std::sort(eventsBothLeft.begin(), eventsBothLeft.end(), compareEvents);
+		std::sort(eventsBothRight.begin(), eventsBothRight.end(), compareEvents);
+
+		outEventsLeft->resize(eventsLeftOnly.size() + eventsBothLeft.size());
+		std::merge(
+			eventsLeftOnly.begin(), eventsLeftOnly.end(),
+			eventsBothLeft.begin(), eventsBothLeft.end(),
+			outEventsLeft->begin(), compareEvents);
+
+		outEventsRight->resize(eventsRightOnly.size() + eventsBothRight.size());
+		std::merge(
+			eventsRightOnly.begin(), eventsRightOnly.end(),
+			eventsBothRight.begin(), eventsBothRight.end(),
+			outEventsRight->begin(), compareEvents);
+	}
+
+	/*static*/ void KdNode::createEvents(const uint32_t triangle, const BoundingBox& triangleBox, std::vector<Event>* outEvents)
+	{
+		for (uint8_t k = 0; k < MAX_TREE_DIMENSION; k++)
+		{
+			Axis axis = static_cast<Axis>(k);
+			if (triangleBox.isPlanar(axis))
+			{
+				outEvents->push_back({ triangleBox.getMin()[k], triangle, axis, EventType::PLANAR });
+			}
 			else
 			{
-				if (triBox.getMin()[plane.getAxis()] < plane.getPosition())
-				{
-					outTrianglesLeft->push_back(tri);
-				}
-				if (triBox.getMax()[plane.getAxis()] > plane.getPosition())
-				{
-					outTrianglesRight->push_back(tri);
-				}
+				outEvents->push_back({ triangleBox.getMin()[k], triangle, axis, EventType::START });
+				outEvents->push_back({ triangleBox.getMax()[k], triangle, axis, EventType::END });
 			}
 		}
 	}
 
+	/*static*/ KdNode* KdNode::createLeaf(const std::vector<Event>& events, const BoundingBox& bBox, MemoryArena& arena)
+	{
+		// Every triangle has either a start or a planar event in each dimension
+		auto isFirstEvent = [](const Event& event) -> bool
+		{
+			return (event.dimension == Axis::X) && (event.type != EventType::END);
+		};
+
+		const uint32_t triangleCount = static_cast<uint32_t>(std::count_if(events.begin(), events.end(), isFirstEvent));
+		uint32_t* triangles = arena.createArray<uint32_t>(triangleCount);
+		uint32_t triangle{ 0 };
+		for (const Event& event : events)
+		{
+			if (isFirstEvent(event))
+			{
+				triangles[triangle++] = event.triangle;
+			}
+		}
+		return arena.create<KdNode>(triangles, triangleCount, bBox);
+	}
+
+	/*static*/ KdNode* KdNode::createLeaf(const std::vector<uint32_t>& triangles, const BoundingBox& bBox, MemoryArena& arena)
+	{
+		uint32_t* containedTriangles = arena.createArray<uint32_t>(triangles.size());
+		std::copy(triangles.begin(), triangles.end(), containedTriangles);
+		return arena.create<KdNode>(containedTriangles, static_cast<uint32_t>(triangles.size()), bBox);
+	}
+
 	/*static*/ bool KdNode::compareEvents(const Event& e1, const Event& e2)
 	{
-		return
-			// Primary condition: sort by position
-			(e1.position < e2.position) ||
-			// Secondary condition: sort by type
-			((e1.position == e2.position) && (e1.type < e2.type));
+		// Sort by position, then group the events of one dimension, then by type.
+		// The triangle index makes the order unique and therefore independent of the sort algorithm.
+		if (e1.position != e2.position)
+		{
+			return e1.position < e2.position;
+		}
+		if (e1.dimension != e2.dimension)
+		{
+			return e1.dimension < e2.dimension;
+		}
+		if (e1.type != e2.type)
+		{
+			return e1.type < e2.type;
+		}
+		return e1.triangle < e2.triangle;
 	}
 
 	/*static*/ bool KdNode::terminate(const unsigned int triangleCount, const float minCost)
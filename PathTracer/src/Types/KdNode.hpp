@@ -7,13 +7,16 @@
 /*--------------------------------< Includes >-------------------------------------------*/
 
 #include <vector>
+#include <deque>
+#include <atomic>
+#include <limits>
 
 #include "assimp/types.h"
 #include "assimp/mesh.h"
 
 #include "raytracing.hpp"
-#include "AccelerationStructure.hpp"
 #include "BoundingBox.hpp"
+#include "Utility/MemoryArena.hpp"
 
 namespace raytracing
 {
@@ -21,32 +24,111 @@ namespace raytracing
 
 	/*--------------------------------< Typedefs >------------------------------------------*/
 
+	// Start, end or planar event of a triangle along one dimension. Triangles are referenced by
+	// their index to keep the event lists compact.
 	typedef struct Event
 	{
-		Event(float pos, Axis k, EventType t, KdTriangle& tri) :
-			position(pos), dimension(k), type(t), triangle(tri)
+		float position;
+		uint32_t triangle;
+		Axis dimension;
+		EventType type;
+	}Event;
+
+	// Best splitting plane found by sweeping the events of one dimension
+	typedef struct SplitCandidate
+	{
+		Plane plane;
+		ChildSide side{ ChildSide::UNDEFINED };
+		float cost{ std::numeric_limits<float>::infinity() };
+	}SplitCandidate;
+
+	// Buffers reused by all build steps running on one thread. Aligned to keep the buffers of
+	// different threads off each other's cache lines.
+	typedef struct alignas(64) KdBuildScratch
+	{
+		KdBuildScratch(const size_t triangleCount) :
+			triangleSides(triangleCount, ChildSide::BOTH)
 		{};
 
-		Event& operator= (const Event& event)
+		// Side of every triangle relative to the plane of the node being split
+		std::vector<ChildSide> triangleSides;
+
+		// Events of triangles on one side only
+		std::vector<Event> eventsLeftOnly;
+
+		std::vector<Event> eventsRightOnly;
+
+		// Events of clipped triangles overlapping both sides
+		std::vector<Event> eventsBothLeft;
+
+		std::vector<Event> eventsBothRight;
+
+		// Events of the children of the node split at every depth. A deque keeps the buffers of
+		// the ancestors in place while deeper levels are added.
+		std::deque<std::vector<Event>> childEventsLeft;
+
+		std::deque<std::vector<Event>> childEventsRight;
+	}KdBuildScratch;
+
+	// State shared by all build steps of one tree, possibly running on several threads. Every
+	// thread owns a worker slot with its own node arena and scratch buffers, so building never
+	// locks. The calling thread uses the first slot.
+	typedef struct KdBuildContext
+	{
+		KdBuildContext(const std::vector<BoundingBox>& bounds, std::vector<utility::MemoryArena>& nodeArenas, const unsigned int deferAt) :
+			triangleBounds(bounds), arenas(nodeArenas), deferDepth(deferAt), busyWorkers(nodeArenas.size())
 		{
-			this->position = event.position;
-			this->dimension = event.dimension;
-			this->type = event.type;
-			this->triangle = event.triangle;
-			return *this;
+			this->scratches.reserve(nodeArenas.size());
+			for (size_t worker = 0; worker < nodeArenas.size(); worker++)
+			{
+				this->scratches.emplace_back(bounds.size());
+				this->busyWorkers[worker] = (worker == 0);
+			}
+		};
+
+		// Reserves a free worker slot for a parallel task
+		bool acquireWorker(uint32_t* outWorker)
+		{
+			for (uint32_t worker = 1; worker < this->busyWorkers.size(); worker++)
+			{
+				bool busy{ false };
+				if (this->busyWorkers[worker].compare_exchange_strong(busy, true))
+				{
+					*outWorker = worker;
+					return true;
+				}
+			}
+			return false;
 		}
 
-		float position;
-		Axis dimension;
-		EventType type;
-		KdTriangle triangle;
-	}Event;
+		void releaseWorker(const uint32_t worker)
+		{
+			this->busyWorkers[worker] = false;
+		}
+
+		const std::vector<BoundingBox>& triangleBounds;
+
+		// Nodes and leaf triangle lists allocated by every worker, owned by the caller
+		std::vector<utility::MemoryArena>& arenas;
+
+		std::vector<KdBuildScratch> scratches;
+
+		// Nodes at this depth become deferred leaves instead of being split
+		const unsigned int deferDepth;
+
+		// Slots used by a running thread
+		std::vector<std::atomic<bool>> busyWorkers;
+	}KdBuildContext;
 
 	/*--------------------------------< Constants >-----------------------------------------*/
 
-	class KdNode : public AccelerationStructure
+	// Node of the pointer based tree the kd-tree is built as. Nodes and their triangle lists are
+	// placed in memory arenas, which free the whole tree at once.
+	class KdNode
 	{
 
+	friend class KdTree;
+
 	static constexpr unsigned int MAX_TRIANGLES_PER_LEAF = 32;
 
 	static constexpr unsigned int MAX_DEPTH = 512;
@@ -58,36 +140,42 @@ namespace raytracing
 	static constexpr float INTERSECTION_COST = 5.25f;
 
 	static constexpr uint8_t MAX_TREE_DIMENSION = 3;
+
+	// Bit mask of the dimensions swept for a node
+	static constexpr uint32_t ALL_DIMENSIONS = (1U << MAX_TREE_DIMENSION) - 1;
+
+	// Nodes with less events are built on the current thread
+	static constexpr size_t PARALLEL_BUILD_CUTOFF = 16384;
+
+	// Nodes with less events sweep all dimensions on the current thread
+	static constexpr size_t PARALLEL_SWEEP_CUTOFF = 131072;
 	
 	/*--------------------------------< Public methods >------------------------------------*/
 	public:
 
 		KdNode() = default;
 
-		KdNode(Plane& location, KdNode* leftChild, KdNode* rightChild, BoundingBox& box) :
-			splittingPlane(location), left(leftChild), right(rightChild), boundingBox(box)
+		KdNode(const Plane& location, KdNode* leftChild, KdNode* rightChild, const BoundingBox& box) :
+			boundingBox(box), splittingPlane(location), left(leftChild), right(rightChild)
 		{};
 
-		KdNode(std::vector<KdTriangle>& triangles, BoundingBox& box) :
-			containedTriangles(triangles), boundingBox(box), left(nullptr), right(nullptr)
+		KdNode(const uint32_t* triangles, const uint32_t triangleCount, const BoundingBox& box) :
+			boundingBox(box), left(nullptr), right(nullptr), containedTriangles(triangles), containedTriangleCount(triangleCount)
 		{};
 
-		~KdNode()
-		{
-			if (this->left && this->right)
-			{
-				this->left->~KdNode();
-				this->right->~KdNode();
-			}
-			delete left;
-			delete right;
-		}
-
-		static KdNode* buildTree(std::vector<KdTriangle>& triangles);
+		// Nodes are allocated from the arena and stay valid as long as it is not released
+		static KdNode* buildTree(const std::vector<KdTriangle>& triangles, utility::MemoryArena& arena);
 
-		static KdNode* buildTreeSAH(std::vector<KdTriangle>& triangles);
-		
-		virtual bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) override;
+		// Builds the tree using the surface area heuristic. Large subtrees are built in parallel
+		// using up to one thread per arena, each allocating from its own arena. The nodes stay
+		// valid as long as none of the arenas is released. The resulting tree does not depend on
+		// the thread count. Nodes reaching deferDepth are left unsplit and marked as deferred. If
+		// a region is given, the tree covers only the part of the triangles inside of it.
+		static KdNode* buildTreeSAH(
+			const std::vector<KdTriangle>& triangles,
+			std::vector<utility::MemoryArena>& arenas,
+			const unsigned int deferDepth = MAX_DEPTH,
+			const BoundingBox* region = nullptr);
 
 	/*--------------------------------< Protected methods >---------------------------------*/
 	protected:
@@ -95,11 +183,19 @@ namespace raytracing
 	/*--------------------------------< Private methods >-----------------------------------*/
 	private:
 		
-		static KdNode* build(std::vector<KdTriangle>& triangles, BoundingBox& bBox, unsigned int depth = 1);
-
+		static KdNode* build(
+			const std::vector<KdTriangle>& triangles,
+			std::vector<uint32_t>& triangleIndices,
+			BoundingBox& bBox,
+			utility::MemoryArena& arena,
+			unsigned int depth = 1);
+
+		// Builds the subtree with the arena and scratch buffers of the worker slot
 		static KdNode* buildSAH(
-			std::vector<KdTriangle>& triangles,
-			BoundingBox bBox,
+			const std::vector<Event>& events,
+			KdBuildContext& context,
+			const uint32_t worker,
+			const BoundingBox& bBox,
 			unsigned int depth = 0);
 
 		static std::pair<float, ChildSide> SAH(
@@ -116,15 +212,37 @@ namespace raytracing
 			const int64_t triangleCountRight);
 
 		static std::pair<Plane, ChildSide> findPlane(
-			std::vector<KdTriangle>& triangles,
+			const std::vector<Event>& events,
+			const int64_t triangleCount,
 			const BoundingBox& bBox,
+			KdBuildContext& context,
 			float* outCost);
 
+		// Sweeps the planes of the dimensions set in the bit mask in a single pass over the events
+		// and stores the best plane of every swept dimension in its candidate
+		static void sweep(
+			const std::vector<Event>& events,
+			const uint32_t dimensions,
+			const int64_t triangleCount,
+			const BoundingBox& bBox,
+			SplitCandidate* outCandidates);
+
 		static void classifyTriangles(
-			std::vector<KdTriangle>& triangles,
-			std::pair<Plane, ChildSide>& splittingPlane,
-			std::vector<KdTriangle>* outTrianglesLeft,
-			std::vector<KdTriangle>* outTrianglesRight);
+			const std::vector<Event>& events,
+			const std::pair<Plane, ChildSide>& splittingPlane,
+			const std::vector<BoundingBox>& triangleBounds,
+			KdBuildScratch& scratch,
+			const BoundingBox& leftBox,
+			const BoundingBox& rightBox,
+			std::vector<Event>* outEventsLeft,
+			std::vector<Event>* outEventsRight);
+
+		static void createEvents(const uint32_t triangle, const BoundingBox& triangleBox, std::vector<Event>* outEvents);
+
+		// Creates a leaf holding the triangles of the events
+		static KdNode* createLeaf(const std::vector<Event>& events, const BoundingBox& bBox, utility::MemoryArena& arena);
+
+		static KdNode* createLeaf(const std::vector<uint32_t>& triangles, const BoundingBox& bBox, utility::MemoryArena& arena);
 
 		static bool compareEvents(const Event& e1, const Event& e2);
 
@@ -152,8 +270,13 @@ namespace raytracing
 		// Right subtree
 		KdNode* right;
 		
-		// Triangles contained by a leaf
-		std::vector<KdTriangle> containedTriangles;
+		// Indices of the triangles contained by a leaf
+		const uint32_t* containedTriangles{ nullptr };
+
+		uint32_t containedTriangleCount{ 0 };
+
+		// Set for leaves whose subtree is still to be built
+		bool deferred{ false };
 
 	};
 	
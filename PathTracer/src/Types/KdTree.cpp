@@ -0,0 +1,873 @@
+/*
+ * KdTree.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <memory>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "sdl2/SDL.h"
+
+#include "KdTree.hpp"
+#include "exceptions.hpp"
+#include "Utility/Simd.hpp"
+
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	using utility::SimdFloat;
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	static const char CACHE_MAGIC[8] = { 'P', 'T', 'K', 'D', 'T', 'R', 'E', 'E' };
+
+	static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+	// Sections of the cache start on a cache line boundary like the in-memory arrays
+	static constexpr uint64_t CACHE_ALIGNMENT = utility::CACHE_LINE_SIZE;
+
+	static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+	static constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	/*static*/ KdTree* KdTree::build(const std::vector<KdTriangle>& triangles, const uint32_t threadCount/* = 1*/)
+	{
+		return build(triangles, threadCount, KdNode::MAX_DEPTH, nullptr);
+	}
+
+	/*static*/ KdTree* KdTree::buildLazy(const std::vector<KdTriangle>& triangles, const uint32_t threadCount/* = 1*/)
+	{
+		return build(triangles, threadCount, LAZY_BUILD_DEPTH, nullptr);
+	}
+
+	/*static*/ uint64_t KdTree::computeCacheKey(const std::vector<KdTriangle>& triangles)
+	{
+		uint64_t key = FNV_OFFSET_BASIS;
+
+		// Build parameters
+		const uint32_t version = CACHE_VERSION;
+		const uint32_t packetSize = TRIANGLE_PACKET_WIDTH;
+		const uint32_t maxTrianglesPerLeaf = KdNode::MAX_TRIANGLES_PER_LEAF;
+		const uint32_t maxDepth = KdNode::MAX_DEPTH;
+		const float traversalCost = KdNode::TRAVERSIAL_COST;
+		const float intersectionCost = KdNode::INTERSECTION_COST;
+		const uint64_t triangleCount = triangles.size();
+		key = hash(&version, sizeof(version), key);
+		key = hash(&packetSize, sizeof(packetSize), key);
+		key = hash(&maxTrianglesPerLeaf, sizeof(maxTrianglesPerLeaf), key);
+		key = hash(&maxDepth, sizeof(maxDepth), key);
+		key = hash(&traversalCost, sizeof(traversalCost), key);
+		key = hash(&intersectionCost, sizeof(intersectionCost), key);
+		key = hash(&triangleCount, sizeof(triangleCount), key);
+
+		// Geometry in the order the triangles are referenced by the tree
+		for (const KdTriangle& triangle : triangles)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const aiVector3D vertex = triangle.getVertex(corner);
+				key = hash(&vertex, sizeof(aiVector3D), key);
+			}
+		}
+		return key;
+	}
+
+	/*static*/ KdTree* KdTree::loadCache(const std::string& path, const uint64_t key, const std::vector<KdTriangle>& triangles)
+	{
+		std::unique_ptr<utility::MappedFile> file(new utility::MappedFile());
+		if (!file->map(path) || (file->getSize() < sizeof(KdTreeCacheHeader)))
+		{
+			return nullptr;
+		}
+
+		KdTreeCacheHeader header;
+		std::memcpy(&header, file->getData(), sizeof(header));
+		if ((std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0) && (header.version == CACHE_VERSION) &&
+			(header.packetSize != TrianglePacket::WIDTH))
+		{
+			SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Kd-tree cache %s holds packets of %u triangles, this build uses %u, rebuilding",
+				path.c_str(), header.packetSize, TrianglePacket::WIDTH);
+			return nullptr;
+		}
+		if ((std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) ||
+			(header.version != CACHE_VERSION) ||
+			(header.byteOrderMark != BYTE_ORDER_MARK) ||
+			(header.nodeSize != sizeof(KdTreeNode)) ||
+			(header.key != key) ||
+			(header.triangleCount != triangles.size()) ||
+			(header.nodeCount == 0) ||
+			(header.nodesOffset % CACHE_ALIGNMENT != 0) ||
+			(header.packetsOffset % CACHE_ALIGNMENT != 0) ||
+			(header.nodesOffset + header.nodeCount * sizeof(KdTreeNode) > file->getSize()) ||
+			(header.packetsOffset + header.packetCount * sizeof(TrianglePacket) > file->getSize()))
+		{
+			return nullptr;
+		}
+
+		const BoundingBox box(
+			aiVector3D(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+			aiVector3D(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
+		std::unique_ptr<KdTree> tree(new KdTree(triangles, box));
+		tree->nodeData = reinterpret_cast<const KdTreeNode*>(file->getData() + header.nodesOffset);
+		tree->nodeCount = static_cast<size_t>(header.nodeCount);
+		tree->packetData = reinterpret_cast<const TrianglePacket*>(file->getData() + header.packetsOffset);
+		tree->packetCount = static_cast<size_t>(header.packetCount);
+		tree->triangleReferenceCount = static_cast<size_t>(header.triangleReferenceCount);
+		tree->cacheFile = std::move(file);
+
+		if (!tree->validate())
+		{
+			return nullptr;
+		}
+		return tree.release();
+	}
+
+	void KdTree::saveCache(const std::string& path, const uint64_t key) const
+	{
+		if (this->isLazy())
+		{
+			throw AccStructure("Lazily built kd-trees cannot be cached");
+		}
+
+		KdTreeCacheHeader header{};
+		std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		header.version = CACHE_VERSION;
+		header.byteOrderMark = BYTE_ORDER_MARK;
+		header.nodeSize = sizeof(KdTreeNode);
+		header.packetSize = TrianglePacket::WIDTH;
+		header.key = key;
+		header.triangleCount = this->triangles.size();
+		header.nodeCount = this->nodeCount;
+		header.nodesOffset = (sizeof(KdTreeCacheHeader) + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+		header.packetCount = this->packetCount;
+		header.packetsOffset = (header.nodesOffset + header.nodeCount * sizeof(KdTreeNode) + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+		header.triangleReferenceCount = this->triangleReferenceCount;
+		for (int k = 0; k < 3; k++)
+		{
+			header.boundsMin[k] = this->boundingBox.getMin()[k];
+			header.boundsMax[k] = this->boundingBox.getMax()[k];
+		}
+
+		// Write to a temporary file first, so concurrent runs never map a partial cache
+		const std::string temporaryPath = path + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			const char padding[CACHE_ALIGNMENT] = {};
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(padding, header.nodesOffset - sizeof(header));
+			file.write(reinterpret_cast<const char*>(this->nodeData), header.nodeCount * sizeof(KdTreeNode));
+			file.write(padding, header.packetsOffset - header.nodesOffset - header.nodeCount * sizeof(KdTreeNode));
+			file.write(reinterpret_cast<const char*>(this->packetData), header.packetCount * sizeof(TrianglePacket));
+			if (!file)
+			{
+				file.close();
+				std::remove(temporaryPath.c_str());
+				throw AccStructure("Writing kd-tree cache failed");
+			}
+		}
+
+		std::remove(path.c_str());
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+		{
+			std::remove(temporaryPath.c_str());
+			throw AccStructure("Writing kd-tree cache failed");
+		}
+	}
+
+	bool KdTree::calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection)
+	{
+		float tMin, tMax;
+		if (!this->boundingBox.intersects(ray, &tMin, &tMax))
+		{
+			this->recordTraversal(0, 0);
+			return false;
+		}
+
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		const bool intersects = this->intersectSubtree(0, tMin, tMax, ray, outIntersection, &nodesVisited, &trianglesTested);
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return intersects;
+	}
+
+	bool KdTree::occluded(const aiRay& ray, const float tMax)
+	{
+		float tNear, tFar;
+		if (!this->boundingBox.intersects(ray, &tNear, &tFar) || (tNear >= tMax))
+		{
+			this->recordTraversal(0, 0);
+			return false;
+		}
+
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		const bool occluded = this->occludedSubtree(0, tNear, std::min(tFar, tMax), ray, tMax, &nodesVisited, &trianglesTested);
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return occluded;
+	}
+
+	uint32_t KdTree::intersectPacket(const aiRay* rays, const uint32_t rayCount, IntersectionInformation* outIntersections)
+	{
+		RayPacket packet;
+		if (!loadRayPacket(rays, rayCount, outIntersections, &packet))
+		{
+			// Rays heading in different directions split up right away, they are traced one by one
+			return AccelerationStructure::intersectPacket(rays, rayCount, outIntersections);
+		}
+
+		// Clip every ray against the scene bounds. Rays missing it leave the packet.
+		alignas(sizeof(float) * RayPacket::WIDTH) float sceneEntry[RayPacket::WIDTH] = {};
+		alignas(sizeof(float) * RayPacket::WIDTH) float sceneExit[RayPacket::WIDTH] = {};
+		uint32_t activeMask{ 0 };
+		for (uint32_t i = 0; i < rayCount; i++)
+		{
+			if (this->boundingBox.intersects(rays[i], &sceneEntry[i], &sceneExit[i]))
+			{
+				activeMask |= 1U << i;
+			}
+		}
+
+		const SimdFloat origin[3] = {
+			SimdFloat::load(packet.originX),
+			SimdFloat::load(packet.originY),
+			SimdFloat::load(packet.originZ) };
+		const SimdFloat inverseDirection[3] = {
+			SimdFloat::load(packet.inverseDirectionX),
+			SimdFloat::load(packet.inverseDirectionY),
+			SimdFloat::load(packet.inverseDirectionZ) };
+
+		KdPacketStackEntry stack[MAX_STACK_SIZE];
+		uint32_t stackSize{ 0 };
+		uint32_t nodeIndex{ 0 };
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		uint32_t hitMask{ 0 };
+		SimdFloat tMin = SimdFloat::load(sceneEntry);
+		SimdFloat tMax = SimdFloat::load(sceneExit);
+
+		while (true)
+		{
+			// Rays with a hit before the current segment are done
+			activeMask &= ~(SimdFloat::load(packet.tMax) < tMin);
+
+			if ((activeMask & (activeMask - 1)) == 0)
+			{
+				// At most one ray is left. It continues on its own instead of occupying all lanes.
+				if (activeMask != 0)
+				{
+					const uint32_t lane = RayPacket::getLowestLane(activeMask);
+					tMin.store(sceneEntry);
+					tMax.store(sceneExit);
+					if (this->intersectSubtree(nodeIndex, sceneEntry[lane], sceneExit[lane], rays[lane], &outIntersections[lane], &nodesVisited, &trianglesTested))
+					{
+						hitMask |= 1U << lane;
+						packet.tMax[lane] = outIntersections[lane].intersectionDistance / packet.directionLength[lane];
+					}
+				}
+			}
+			else
+			{
+				const KdTreeNode* node = &this->nodeData[nodeIndex];
+				nodesVisited++;
+
+				if (!node->isLeaf())
+				{
+					const Axis axis = node->getAxis();
+					const SimdFloat tPlane = (SimdFloat::broadcast(node->getSplitPosition()) - origin[axis]) * inverseDirection[axis];
+
+					// All rays head the same way, so they share the near child. Rays whose segment
+					// ends before the plane stay on the near side, those starting behind it only
+					// pass the far side.
+					const bool belowFirst = rays[0].dir[axis] > 0.f;
+					const uint32_t firstChild = belowFirst ? nodeIndex + 1 : node->getRightChild();
+					const uint32_t secondChild = belowFirst ? node->getRightChild() : nodeIndex + 1;
+					const uint32_t nearMask = activeMask & ~(tPlane < tMin);
+					const uint32_t farMask = activeMask & ~(tPlane > tMax);
+
+					if (farMask == 0)
+					{
+						nodeIndex = firstChild;
+					}
+					else if (nearMask == 0)
+					{
+						nodeIndex = secondChild;
+					}
+					else
+					{
+						// Postpone the far side for the rays reaching it
+						KdPacketStackEntry& entry = stack[stackSize++];
+						SimdFloat::max(tMin, tPlane).store(entry.tMin);
+						tMax.store(entry.tMax);
+						entry.node = secondChild;
+						entry.activeMask = farMask;
+
+						nodeIndex = firstChild;
+						activeMask = nearMask;
+						tMax = SimdFloat::min(tMax, tPlane);
+					}
+					continue;
+				}
+
+				if (node->isDeferred())
+				{
+					// Subtrees of a lazy tree are traversed ray by ray
+					const KdTree* subtree = this->expand(node->getTriangleOffset());
+					tMin.store(sceneEntry);
+					tMax.store(sceneExit);
+					for (uint32_t lanes = activeMask; lanes != 0; lanes &= lanes - 1)
+					{
+						const uint32_t lane = RayPacket::getLowestLane(lanes);
+						if (subtree->intersectSubtree(0, sceneEntry[lane], sceneExit[lane], rays[lane], &outIntersections[lane], &nodesVisited, &trianglesTested))
+						{
+							hitMask |= 1U << lane;
+							packet.tMax[lane] = outIntersections[lane].intersectionDistance / packet.directionLength[lane];
+						}
+					}
+				}
+				else
+				{
+					for (uint32_t lanes = activeMask; lanes != 0; lanes &= lanes - 1)
+					{
+						const uint32_t lane = RayPacket::getLowestLane(lanes);
+						trianglesTested += node->getTriangleCount();
+						if (this->intersectTriangles(
+							this->triangles,
+							this->packetData + node->getTriangleOffset(),
+							node->getTriangleCount(),
+							rays[lane],
+							&outIntersections[lane]))
+						{
+							hitMask |= 1U << lane;
+							packet.tMax[lane] = outIntersections[lane].intersectionDistance / packet.directionLength[lane];
+						}
+					}
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+			const KdPacketStackEntry& entry = stack[--stackSize];
+			nodeIndex = entry.node;
+			activeMask = entry.activeMask;
+			tMin = SimdFloat::load(entry.tMin);
+			tMax = SimdFloat::load(entry.tMax);
+		}
+
+		this->recordTraversal(nodesVisited, trianglesTested, rayCount);
+		return hitMask;
+	}
+
+	size_t KdTree::getMemoryFootprint() const
+	{
+		size_t footprint =
+			sizeof(KdTree) +
+			this->nodes.capacity() * sizeof(KdTreeNode) +
+			this->trianglePackets.capacity() * sizeof(TrianglePacket) +
+			this->triangles.capacity() * sizeof(KdTriangle) +
+			(this->cacheFile ? this->cacheFile->getSize() : 0) +
+			this->deferredSubtrees.capacity() * sizeof(std::unique_ptr<KdDeferredSubtree>);
+		for (const std::unique_ptr<KdDeferredSubtree>& subtree : this->deferredSubtrees)
+		{
+			const KdTree* tree = subtree->tree.load(std::memory_order_acquire);
+			footprint +=
+				sizeof(KdDeferredSubtree) +
+				subtree->triangles.capacity() * sizeof(KdTriangle) +
+				(tree ? tree->getMemoryFootprint() : 0);
+		}
+		return footprint;
+	}
+
+	size_t KdTree::getExpandedSubtreeCount() const
+	{
+		size_t expanded{ 0 };
+		for (const std::unique_ptr<KdDeferredSubtree>& subtree : this->deferredSubtrees)
+		{
+			expanded += subtree->tree.load(std::memory_order_acquire) ? 1 : 0;
+		}
+		return expanded;
+	}
+
+	KdTreeReport KdTree::createReport() const
+	{
+		KdTreeReport report;
+		report.nodeCount = this->nodeCount;
+		report.triangleCount = this->triangles.size();
+		report.triangleReferenceCount = this->triangleReferenceCount;
+		report.duplicationFactor = report.triangleCount > 0 ? static_cast<double>(this->triangleReferenceCount) / report.triangleCount : 0.;
+		report.memoryBytes = this->getMemoryFootprint();
+		report.traversalCost = KdNode::TRAVERSIAL_COST;
+		report.intersectionCost = KdNode::INTERSECTION_COST;
+		report.maxTrianglesPerLeaf = KdNode::MAX_TRIANGLES_PER_LEAF;
+
+		// Node bounds are not stored, they follow from splitting the scene bounds
+		struct ReportStackEntry
+		{
+			uint32_t node;
+			uint32_t depth;
+			BoundingBox box;
+		};
+
+		const float rootArea = this->boundingBox.getSurfaceArea();
+		const float inverseRootArea = (rootArea > 0.f) ? 1.f / rootArea : 0.f;
+		std::vector<ReportStackEntry> stack{ { 0, 0, this->boundingBox } };
+		uint64_t leafDepthSum{ 0 };
+
+		while (!stack.empty() && (this->nodeCount > 0))
+		{
+			const ReportStackEntry entry = stack.back();
+			stack.pop_back();
+
+			const KdTreeNode& node = this->nodeData[entry.node];
+			const double hitProbability = entry.box.getSurfaceArea() * inverseRootArea;
+			report.maxDepth = std::max(report.maxDepth, entry.depth);
+
+			if (node.isLeaf())
+			{
+				const bool deferred = node.isDeferred();
+				const uint32_t triangleCount = deferred ?
+					static_cast<uint32_t>(this->deferredSubtrees[node.getTriangleOffset()]->triangles.size()) :
+					node.getTriangleCount();
+				uint32_t bucket{ 0 };
+				while ((bucket + 1 < KdTreeReport::HISTOGRAM_BUCKETS) && (KdTreeReport::getBucketStart(bucket + 1) <= triangleCount))
+				{
+					bucket++;
+				}
+				report.leafHistogram[bucket]++;
+				report.leafCount++;
+				report.emptyLeafCount += (triangleCount == 0) ? 1 : 0;
+				report.deferredLeafCount += deferred ? 1 : 0;
+				report.sahCost += KdNode::INTERSECTION_COST * triangleCount * hitProbability;
+				leafDepthSum += entry.depth;
+				continue;
+			}
+
+			report.sahCost += KdNode::TRAVERSIAL_COST * hitProbability;
+
+			BoundingBox leftBox;
+			BoundingBox rightBox;
+			entry.box.split(leftBox, rightBox, Plane(node.getSplitPosition(), node.getAxis()));
+			stack.push_back({ node.getRightChild(), entry.depth + 1, rightBox });
+			stack.push_back({ entry.node + 1, entry.depth + 1, leftBox });
+		}
+
+		report.averageLeafDepth = report.leafCount > 0 ? static_cast<double>(leafDepthSum) / report.leafCount : 0.;
+		return report;
+	}
+
+	void KdTreeReport::log() const
+	{
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Kd-tree report: %zu nodes, %zu leaves of which %zu are empty, depth %u max and %.2f average",
+			this->nodeCount,
+			this->leafCount,
+			this->emptyLeafCount,
+			this->maxDepth,
+			this->averageLeafDepth);
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Kd-tree report: %zu triangle references for %zu triangles (%.2fx), SAH cost %.2f, %.2f MiB",
+			this->triangleReferenceCount,
+			this->triangleCount,
+			this->duplicationFactor,
+			this->sahCost,
+			this->memoryBytes / (1024. * 1024.));
+
+		std::string histogram;
+		for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+		{
+			const uint32_t start = getBucketStart(bucket);
+			const uint32_t end = getBucketStart(bucket + 1) - 1;
+			std::string range = std::to_string(start);
+			if (bucket + 1 == HISTOGRAM_BUCKETS)
+			{
+				range += "+";
+			}
+			else if (end > start)
+			{
+				range += "-" + std::to_string(end);
+			}
+			histogram += (bucket > 0 ? ", " : "") + range + ": " + std::to_string(this->leafHistogram[bucket]);
+		}
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Kd-tree report: leaves by triangle count %s", histogram.c_str());
+	}
+
+	void KdTreeReport::writeJson(const std::string& path) const
+	{
+		std::ofstream file(path, std::ios::trunc);
+		file << "{\n";
+		file << "\t\"nodeCount\": " << this->nodeCount << ",\n";
+		file << "\t\"leafCount\": " << this->leafCount << ",\n";
+		file << "\t\"emptyLeafCount\": " << this->emptyLeafCount << ",\n";
+		file << "\t\"deferredLeafCount\": " << this->deferredLeafCount << ",\n";
+		file << "\t\"maxDepth\": " << this->maxDepth << ",\n";
+		file << "\t\"averageLeafDepth\": " << this->averageLeafDepth << ",\n";
+		file << "\t\"triangleCount\": " << this->triangleCount << ",\n";
+		file << "\t\"triangleReferenceCount\": " << this->triangleReferenceCount << ",\n";
+		file << "\t\"duplicationFactor\": " << this->duplicationFactor << ",\n";
+		file << "\t\"sahCost\": " << this->sahCost << ",\n";
+		file << "\t\"memoryBytes\": " << this->memoryBytes << ",\n";
+
+		// Allows comparing reports of builds with different parameters
+		file << "\t\"traversalCost\": " << this->traversalCost << ",\n";
+		file << "\t\"intersectionCost\": " << this->intersectionCost << ",\n";
+		file << "\t\"maxTrianglesPerLeaf\": " << this->maxTrianglesPerLeaf << ",\n";
+
+		// Every bucket lists the lowest triangle count of its leaves
+		file << "\t\"leafHistogram\": [";
+		for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+		{
+			file << (bucket > 0 ? ", " : "") << "{ \"minTriangles\": " << getBucketStart(bucket) << ", \"leaves\": " << this->leafHistogram[bucket] << " }";
+		}
+		file << "]\n";
+		file << "}\n";
+
+		if (!file)
+		{
+			throw AccStructure("Writing kd-tree report failed");
+		}
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	/*static*/ KdTree* KdTree::build(
+		const std::vector<KdTriangle>& triangles,
+		const uint32_t threadCount,
+		const unsigned int deferDepth,
+		const BoundingBox* region)
+	{
+		// The pointer based tree is only needed until it is flattened. Freeing the arenas
+		// releases all its nodes at once. Every build thread allocates from its own arena.
+		std::vector<utility::MemoryArena> arenas(std::max(threadCount, 1U));
+		const KdNode* root = KdNode::buildTreeSAH(triangles, arenas, deferDepth, region);
+
+		std::unique_ptr<KdTree> tree(new KdTree(triangles, root->boundingBox));
+		tree->flatten(root);
+		tree->nodes.shrink_to_fit();
+		tree->trianglePackets.shrink_to_fit();
+		tree->nodeData = tree->nodes.data();
+		tree->nodeCount = tree->nodes.size();
+		tree->packetData = tree->trianglePackets.data();
+		tree->packetCount = tree->trianglePackets.size();
+
+		return tree.release();
+	}
+
+	bool KdTree::intersectSubtree(
+		uint32_t nodeIndex,
+		float tMin,
+		float tMax,
+		const aiRay& ray,
+		IntersectionInformation* outIntersection,
+		uint64_t* nodesVisited,
+		uint64_t* trianglesTested) const
+	{
+		// Hit distances are measured in world space, the traversal works with the ray parameter
+		const float directionLength = ray.dir.Length();
+		const aiVector3D inverseDirection(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+		KdStackEntry stack[MAX_STACK_SIZE];
+		uint32_t stackSize{ 0 };
+		bool intersects{ false };
+
+		while (true)
+		{
+			// Nothing behind the closest hit found so far can occlude it
+			if (outIntersection->intersectionDistance < tMin * directionLength)
+			{
+				break;
+			}
+
+			const KdTreeNode* node = &this->nodeData[nodeIndex];
+			(*nodesVisited)++;
+
+			if (!node->isLeaf())
+			{
+				const Axis axis = node->getAxis();
+				const float splitPosition = node->getSplitPosition();
+				const float tPlane = (ray.dir[axis] != 0.f) ?
+					(splitPosition - ray.pos[axis]) * inverseDirection[axis] :
+					std::numeric_limits<float>::infinity();
+
+				// The child containing the ray origin is entered first
+				const bool belowFirst =
+					(ray.pos[axis] < splitPosition) ||
+					((ray.pos[axis] == splitPosition) && (ray.dir[axis] <= 0.f));
+				const uint32_t firstChild = belowFirst ? nodeIndex + 1 : node->getRightChild();
+				const uint32_t secondChild = belowFirst ? node->getRightChild() : nodeIndex + 1;
+
+				if ((tPlane > tMax) || (tPlane <= 0.f))
+				{
+					// Ray only passes the near side of the plane
+					nodeIndex = firstChild;
+				}
+				else if (tPlane < tMin)
+				{
+					// Ray only passes the far side of the plane
+					nodeIndex = secondChild;
+				}
+				else
+				{
+					// Ray passes both sides. Postpone the far side
+					stack[stackSize++] = { secondChild, tPlane, tMax };
+					nodeIndex = firstChild;
+					tMax = tPlane;
+				}
+				continue;
+			}
+
+			if (node->isDeferred())
+			{
+				// Hits outside of the region are possible, but a closer one is kept in either case
+				if (this->expand(node->getTriangleOffset())->intersectSubtree(0, tMin, tMax, ray, outIntersection, nodesVisited, trianglesTested))
+				{
+					intersects = true;
+				}
+			}
+			else
+			{
+				*trianglesTested += node->getTriangleCount();
+				if (this->intersectTriangles(
+					this->triangles,
+					this->packetData + node->getTriangleOffset(),
+					node->getTriangleCount(),
+					ray,
+					outIntersection))
+				{
+					intersects = true;
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+			const KdStackEntry& entry = stack[--stackSize];
+			nodeIndex = entry.node;
+			tMin = entry.tMin;
+			tMax = entry.tMax;
+		}
+
+		return intersects;
+	}
+
+	bool KdTree::occludedSubtree(
+		uint32_t nodeIndex,
+		float tMin,
+		float tMax,
+		const aiRay& ray,
+		const float tLimit,
+		uint64_t* nodesVisited,
+		uint64_t* trianglesTested) const
+	{
+		const aiVector3D inverseDirection(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+		KdStackEntry stack[MAX_STACK_SIZE];
+		uint32_t stackSize{ 0 };
+
+		while (true)
+		{
+			const KdTreeNode* node = &this->nodeData[nodeIndex];
+			(*nodesVisited)++;
+
+			if (!node->isLeaf())
+			{
+				const Axis axis = node->getAxis();
+				const float splitPosition = node->getSplitPosition();
+				const float tPlane = (ray.dir[axis] != 0.f) ?
+					(splitPosition - ray.pos[axis]) * inverseDirection[axis] :
+					std::numeric_limits<float>::infinity();
+
+				// Same child order as the closest hit traversal, so segments close to the origin are
+				// tested first. Occluders near the shading point are the most likely ones.
+				const bool belowFirst =
+					(ray.pos[axis] < splitPosition) ||
+					((ray.pos[axis] == splitPosition) && (ray.dir[axis] <= 0.f));
+				const uint32_t firstChild = belowFirst ? nodeIndex + 1 : node->getRightChild();
+				const uint32_t secondChild = belowFirst ? node->getRightChild() : nodeIndex + 1;
+
+				if ((tPlane > tMax) || (tPlane <= 0.f))
+				{
+					nodeIndex = firstChild;
+				}
+				else if (tPlane < tMin)
+				{
+					nodeIndex = secondChild;
+				}
+				else
+				{
+					stack[stackSize++] = { secondChild, tPlane, tMax };
+					nodeIndex = firstChild;
+					tMax = tPlane;
+				}
+				continue;
+			}
+
+			if (node->isDeferred())
+			{
+				if (this->expand(node->getTriangleOffset())->occludedSubtree(0, tMin, tMax, ray, tLimit, nodesVisited, trianglesTested))
+				{
+					return true;
+				}
+			}
+			else
+			{
+				*trianglesTested += node->getTriangleCount();
+				if (this->occludedTriangles(
+					this->packetData + node->getTriangleOffset(),
+					node->getTriangleCount(),
+					ray,
+					tLimit))
+				{
+					return true;
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+			const KdStackEntry& entry = stack[--stackSize];
+			nodeIndex = entry.node;
+			tMin = entry.tMin;
+			tMax = entry.tMax;
+		}
+
+		return false;
+	}
+
+	void KdTree::flatten(const KdNode* node)
+	{
+		const uint32_t nodeIndex = static_cast<uint32_t>(this->nodes.size());
+		this->nodes.emplace_back();
+
+		// Leaf nodes have neither a left nor a right subtree
+		if (!node->left && !node->right)
+		{
+			if (node->deferred && (node->containedTriangleCount > 0))
+			{
+				std::unique_ptr<KdDeferredSubtree> subtree(new KdDeferredSubtree());
+				subtree->region = node->boundingBox;
+				subtree->triangles.reserve(node->containedTriangleCount);
+				for (uint32_t i = 0; i < node->containedTriangleCount; i++)
+				{
+					subtree->triangles.push_back(this->triangles[node->containedTriangles[i]]);
+				}
+				this->nodes[nodeIndex].initLeaf(static_cast<uint32_t>(this->deferredSubtrees.size()), KdTreeNode::DEFERRED);
+				this->deferredSubtrees.push_back(std::move(subtree));
+				return;
+			}
+
+			const size_t triangleOffset = this->trianglePackets.size();
+			const size_t triangleCount = node->containedTriangleCount;
+			if ((triangleOffset > UINT32_MAX) || (triangleCount > MAX_NODE_VALUE))
+			{
+				throw AccStructure("Kd-tree exceeds the capacity of the flattened node layout");
+			}
+
+			appendTrianglePackets(
+				this->triangles,
+				node->containedTriangles,
+				static_cast<uint32_t>(triangleCount),
+				&this->trianglePackets);
+			this->triangleReferenceCount += triangleCount;
+			this->nodes[nodeIndex].initLeaf(static_cast<uint32_t>(triangleOffset), static_cast<uint32_t>(triangleCount));
+			return;
+		}
+
+		// Left child directly follows its parent
+		this->flatten(node->left);
+
+		const size_t rightChild = this->nodes.size();
+		if (rightChild > MAX_NODE_VALUE)
+		{
+			throw AccStructure("Kd-tree exceeds the capacity of the flattened node layout");
+		}
+		this->flatten(node->right);
+
+		this->nodes[nodeIndex].initInterior(
+			node->splittingPlane.getAxis(),
+			node->splittingPlane.getPosition(),
+			static_cast<uint32_t>(rightChild));
+	}
+
+	const KdTree* KdTree::expand(const uint32_t subtree) const
+	{
+		KdDeferredSubtree& deferred = *this->deferredSubtrees[subtree];
+		const KdTree* tree = deferred.tree.load(std::memory_order_acquire);
+		if (tree)
+		{
+			return tree;
+		}
+
+		// Only the first ray reaching the region builds it, the others wait for the result
+		std::lock_guard<std::mutex> lock(deferred.buildMutex);
+		tree = deferred.tree.load(std::memory_order_relaxed);
+		if (!tree)
+		{
+			// Built on the calling render thread. Other threads are busy with their own rays.
+			deferred.builtTree.reset(build(deferred.triangles, 1, KdNode::MAX_DEPTH, &deferred.region));
+			tree = deferred.builtTree.get();
+			deferred.tree.store(tree, std::memory_order_release);
+		}
+		return tree;
+	}
+
+	bool KdTree::validate() const
+	{
+		for (size_t nodeIndex = 0; nodeIndex < this->nodeCount; nodeIndex++)
+		{
+			const KdTreeNode& node = this->nodeData[nodeIndex];
+			if (node.isLeaf())
+			{
+				// Deferred leaves are never cached
+				if (node.isDeferred() ||
+					(static_cast<uint64_t>(node.getTriangleOffset()) + TrianglePacket::getPacketCount(node.getTriangleCount()) > this->packetCount))
+				{
+					return false;
+				}
+			}
+			else if ((node.getRightChild() <= nodeIndex + 1) || (node.getRightChild() >= this->nodeCount))
+			{
+				return false;
+			}
+		}
+		for (size_t i = 0; i < this->packetCount; i++)
+		{
+			for (uint32_t lane = 0; lane < TrianglePacket::WIDTH; lane++)
+			{
+				const uint32_t triangle = this->packetData[i].triangle[lane];
+				if ((triangle >= this->triangles.size()) && (triangle != TrianglePacket::EMPTY))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/*static*/ uint64_t KdTree::hash(const void* data, const size_t size, uint64_t seed)
+	{
+		// 64 bit FNV-1a
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			seed ^= bytes[i];
+			seed *= FNV_PRIME;
+		}
+		return seed;
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
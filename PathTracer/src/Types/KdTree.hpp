@@ -0,0 +1,392 @@
+/*
+ * KdTree.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <vector>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+#include "assimp/types.h"
+#include "assimp/mesh.h"
+
+#include "raytracing.hpp"
+#include "AccelerationStructure.hpp"
+#include "BoundingBox.hpp"
+#include "KdNode.hpp"
+#include "Utility/AlignedAllocator.hpp"
+#include "Utility/MappedFile.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Node of the flattened kd-tree. Interior nodes hold the split position, the split axis and
+	// the index of their right child. The left child is always stored directly after its parent.
+	// Leaves hold the offset of their first triangle packet and the number of triangles.
+	// Deferred leaves of a lazily built tree hold the index of their subtree instead.
+	struct KdTreeNode
+	{
+		static constexpr uint32_t LEAF = 3;
+
+		// Triangle count marking a deferred leaf
+		static constexpr uint32_t DEFERRED = (1U << 30) - 1;
+
+		inline void initInterior(const Axis axis, const float position, const uint32_t rightChild)
+		{
+			this->splitPosition = position;
+			this->flags = static_cast<uint32_t>(axis) | (rightChild << 2);
+		}
+
+		inline void initLeaf(const uint32_t offset, const uint32_t count)
+		{
+			this->triangleOffset = offset;
+			this->flags = LEAF | (count << 2);
+		}
+
+		inline bool isLeaf() const
+		{
+			return (this->flags & LEAF) == LEAF;
+		}
+
+		inline Axis getAxis() const
+		{
+			return static_cast<Axis>(this->flags & LEAF);
+		}
+
+		inline float getSplitPosition() const
+		{
+			return this->splitPosition;
+		}
+
+		inline uint32_t getRightChild() const
+		{
+			return this->flags >> 2;
+		}
+
+		inline uint32_t getTriangleOffset() const
+		{
+			return this->triangleOffset;
+		}
+
+		inline uint32_t getTriangleCount() const
+		{
+			return this->flags >> 2;
+		}
+
+		inline bool isDeferred() const
+		{
+			return this->flags == (LEAF | (DEFERRED << 2));
+		}
+
+		union
+		{
+			float splitPosition;
+			uint32_t triangleOffset;
+		};
+
+		// Lower two bits: split axis or leaf tag. Upper 30 bits: index of right child or triangle count
+		uint32_t flags;
+	};
+
+	static_assert(sizeof(KdTreeNode) == 8, "Flattened kd-tree nodes are expected to be 8 bytes");
+
+	// Far child postponed during traversal together with the ray interval overlapping it
+	struct KdStackEntry
+	{
+		uint32_t node;
+		float tMin;
+		float tMax;
+	};
+
+	// Far child postponed by the packet traversal together with the interval of every ray
+	// overlapping it and the rays entering it
+	struct alignas(sizeof(float) * TRIANGLE_PACKET_WIDTH) KdPacketStackEntry
+	{
+		float tMin[RayPacket::WIDTH];
+		float tMax[RayPacket::WIDTH];
+		uint32_t node;
+		uint32_t activeMask;
+	};
+
+	class KdTree;
+
+	// Region of a lazily built tree whose subtree is built when the first ray reaches it
+	struct KdDeferredSubtree
+	{
+		// Triangles overlapping the region
+		std::vector<KdTriangle> triangles;
+
+		BoundingBox region;
+
+		// Set once the subtree is built, read by the traversal without locking
+		std::atomic<const KdTree*> tree{ nullptr };
+
+		std::unique_ptr<KdTree> builtTree;
+
+		// Held while the subtree is built, so rays reaching it meanwhile wait instead of building it again
+		std::mutex buildMutex;
+	};
+
+	// Shape and expected cost of a built tree, used to tune the build parameters per scene
+	struct KdTreeReport
+	{
+		// Leaves are counted by triangle count in power of two buckets: empty, 1, 2-3, 4-7, ...
+		// The last bucket holds all larger leaves.
+		static constexpr uint32_t HISTOGRAM_BUCKETS = 12;
+
+		// Lowest triangle count of a histogram bucket
+		static inline uint32_t getBucketStart(const uint32_t bucket)
+		{
+			return (bucket == 0) ? 0 : (1U << (bucket - 1));
+		}
+
+		void log() const;
+
+		// Throws AccStructure if the file cannot be written
+		void writeJson(const std::string& path) const;
+
+		size_t nodeCount{ 0 };
+
+		size_t leafCount{ 0 };
+
+		size_t emptyLeafCount{ 0 };
+
+		// Leaves of a lazily built tree not split yet. Counted as leaves with their triangles.
+		size_t deferredLeafCount{ 0 };
+
+		uint32_t maxDepth{ 0 };
+
+		// Mean depth of all leaves, the root has depth 0
+		double averageLeafDepth{ 0. };
+
+		size_t leafHistogram[HISTOGRAM_BUCKETS]{};
+
+		size_t triangleCount{ 0 };
+
+		size_t triangleReferenceCount{ 0 };
+
+		// Triangle references per triangle
+		double duplicationFactor{ 0. };
+
+		// Expected traversal cost of a random ray hitting the scene bounds, in the units of the
+		// build parameters TRAVERSIAL_COST and INTERSECTION_COST
+		double sahCost{ 0. };
+
+		size_t memoryBytes{ 0 };
+
+		// Build parameters the tree was built with
+		float traversalCost{ 0.f };
+
+		float intersectionCost{ 0.f };
+
+		uint32_t maxTrianglesPerLeaf{ 0 };
+	};
+
+	// Header of the binary tree cache. The node array follows at nodesOffset and the triangle
+	// packets at packetsOffset, both in the in-memory layout of the flattened tree.
+	struct KdTreeCacheHeader
+	{
+		char magic[8];
+
+		uint32_t version;
+
+		// Detects caches written on a machine with different byte order or node layout
+		uint32_t byteOrderMark;
+
+		uint32_t nodeSize;
+
+		// Triangles per packet, the packet array is unusable with a different TRIANGLE_PACKET_WIDTH
+		uint32_t packetSize;
+
+		// Hash of scene geometry and build parameters
+		uint64_t key;
+
+		uint64_t triangleCount;
+
+		uint64_t nodeCount;
+
+		uint64_t nodesOffset;
+
+		uint64_t packetCount;
+
+		uint64_t packetsOffset;
+
+		uint64_t triangleReferenceCount;
+
+		float boundsMin[3];
+
+		float boundsMax[3];
+	};
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	class KdTree : public AccelerationStructure
+	{
+
+	// Upper limit of the 30 bit wide child index and triangle count of a node
+	static constexpr uint32_t MAX_NODE_VALUE = KdTreeNode::DEFERRED - 1;
+
+	// Depth at which a lazily built tree stops splitting
+	static constexpr unsigned int LAZY_BUILD_DEPTH = 10;
+
+	// Every interior node on the way to a leaf pushes at most one far child
+	static constexpr uint32_t MAX_STACK_SIZE = KdNode::MAX_DEPTH + 1;
+
+	// Increment whenever the node layout or the build changes
+	static constexpr uint32_t CACHE_VERSION = 4;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		// Builds a kd-tree using the surface area heuristic and flattens it into the compact layout
+		static KdTree* build(const std::vector<KdTriangle>& triangles, const uint32_t threadCount = 1);
+
+		// Builds only the top levels of the tree. The subtrees below are built one by one when
+		// a ray first reaches them, so regions never hit are never split. Such trees are not cached.
+		static KdTree* buildLazy(const std::vector<KdTriangle>& triangles, const uint32_t threadCount = 1);
+
+		// Hash identifying the tree built for the given triangles with the current build parameters
+		static uint64_t computeCacheKey(const std::vector<KdTriangle>& triangles);
+
+		// Maps a tree written by saveCache. The arrays are used in place without any fix-ups.
+		// Returns nullptr if the cache does not exist or does not match the key.
+		static KdTree* loadCache(const std::string& path, const uint64_t key, const std::vector<KdTriangle>& triangles);
+
+		// Throws AccStructure if the tree is built lazily or the file cannot be written
+		void saveCache(const std::string& path, const uint64_t key) const;
+
+		virtual bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) override;
+
+		virtual bool occluded(const aiRay& ray, const float tMax) override;
+
+		// Traverses the rays together as long as more than one of them enters a node
+		virtual uint32_t intersectPacket(const aiRay* rays, const uint32_t rayCount, IntersectionInformation* outIntersections) override;
+
+		virtual size_t getMemoryFootprint() const override;
+
+		// Walks the whole tree, so it is meant to be called once after building or loading
+		KdTreeReport createReport() const;
+
+		inline size_t getNodeCount() const
+		{
+			return this->nodeCount;
+		}
+
+		inline size_t getTriangleReferenceCount() const
+		{
+			return this->triangleReferenceCount;
+		}
+
+		inline bool isLoadedFromCache() const
+		{
+			return static_cast<bool>(this->cacheFile);
+		}
+
+		inline bool isLazy() const
+		{
+			return !this->deferredSubtrees.empty();
+		}
+
+		inline size_t getDeferredSubtreeCount() const
+		{
+			return this->deferredSubtrees.size();
+		}
+
+		// Number of deferred subtrees built so far
+		size_t getExpandedSubtreeCount() const;
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		KdTree(const std::vector<KdTriangle>& triangles, const BoundingBox& box) :
+			boundingBox(box), triangles(triangles)
+		{};
+
+		static KdTree* build(
+			const std::vector<KdTriangle>& triangles,
+			const uint32_t threadCount,
+			const unsigned int deferDepth,
+			const BoundingBox* region);
+
+		void flatten(const KdNode* node);
+
+		// Returns the subtree of a deferred leaf, building it if no ray reached it before
+		const KdTree* expand(const uint32_t subtree) const;
+
+		// Closest hit traversal of the subtree below nodeIndex for the ray segment [tMin, tMax]
+		bool intersectSubtree(
+			uint32_t nodeIndex,
+			float tMin,
+			float tMax,
+			const aiRay& ray,
+			IntersectionInformation* outIntersection,
+			uint64_t* nodesVisited,
+			uint64_t* trianglesTested) const;
+
+		// Any hit traversal of the subtree below nodeIndex for the ray segment [tMin, tMax].
+		// Triangles are tested up to tLimit.
+		bool occludedSubtree(
+			uint32_t nodeIndex,
+			float tMin,
+			float tMax,
+			const aiRay& ray,
+			const float tLimit,
+			uint64_t* nodesVisited,
+			uint64_t* trianglesTested) const;
+
+		// Checks that all child and triangle references of mapped arrays are in range
+		bool validate() const;
+
+		static uint64_t hash(const void* data, const size_t size, uint64_t seed);
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		// Bounding box of the whole scene
+		BoundingBox boundingBox;
+
+		// All nodes in depth first order, starting with the root node. Empty if loaded from cache
+		std::vector<KdTreeNode, utility::AlignedAllocator<KdTreeNode>> nodes;
+
+		// Packed triangles, stored consecutively for every leaf. Empty if loaded from cache
+		TrianglePacketArray trianglePackets;
+
+		// Every triangle of the scene exactly once
+		std::vector<KdTriangle> triangles;
+
+		// Arrays used by the traversal. Point either into the vectors above or into the cache
+		const KdTreeNode* nodeData{ nullptr };
+
+		size_t nodeCount{ 0 };
+
+		const TrianglePacket* packetData{ nullptr };
+
+		size_t packetCount{ 0 };
+
+		size_t triangleReferenceCount{ 0 };
+
+		// Mapping holding the arrays of a tree loaded from cache
+		std::unique_ptr<utility::MappedFile> cacheFile;
+
+		// Subtrees referenced by the deferred leaves of a lazily built tree
+		std::vector<std::unique_ptr<KdDeferredSubtree>> deferredSubtrees;
+
+	};
+
+} // end of namespace raytracer
\ No newline at end of file
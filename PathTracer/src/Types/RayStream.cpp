@@ -0,0 +1,113 @@
+/*
+ * RayStream.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+
+#include "RayStream.hpp"
+
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	RayStream::RayStream(const BoundingBox& sceneBounds) :
+		boundsMin(sceneBounds.getMin())
+	{
+		const float cells = static_cast<float>(1U << MORTON_BITS);
+		for (int k = 0; k < 3; k++)
+		{
+			const float extent = sceneBounds.getMax()[k] - sceneBounds.getMin()[k];
+			this->scale[k] = (extent > 0.f) ? cells / extent : 0.f;
+		}
+	}
+
+	void RayStream::push(const aiRay& ray, const aiColor3D& throughput, const uint32_t pixel)
+	{
+		this->paths.push_back({ ray, throughput, pixel, this->computeSortKey(ray) });
+	}
+
+	void RayStream::sort()
+	{
+		const uint32_t pathCount = static_cast<uint32_t>(this->paths.size());
+		this->sortEntries.resize(pathCount);
+		this->sortScratch.resize(pathCount);
+		uint64_t* entries = this->sortEntries.data();
+		uint64_t* scratch = this->sortScratch.data();
+
+		// Histograms of all digits are counted in a single pass
+		uint32_t bucketOffsets[RADIX_PASSES][RADIX_BUCKETS] = {};
+		for (uint32_t i = 0; i < pathCount; i++)
+		{
+			const uint32_t key = this->paths[i].sortKey;
+			entries[i] = (static_cast<uint64_t>(key) << 32) | i;
+			for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+			{
+				bucketOffsets[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+			}
+		}
+
+		// Least significant digit first, every pass is stable
+		for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+		{
+			uint32_t offset{ 0 };
+			for (uint32_t& bucketOffset : bucketOffsets[pass])
+			{
+				const uint32_t count = bucketOffset;
+				bucketOffset = offset;
+				offset += count;
+			}
+
+			const uint32_t shift = 32 + pass * RADIX_BITS;
+			for (uint32_t i = 0; i < pathCount; i++)
+			{
+				scratch[bucketOffsets[pass][(entries[i] >> shift) & (RADIX_BUCKETS - 1)]++] = entries[i];
+			}
+			std::swap(entries, scratch);
+		}
+
+		this->sortedPaths.resize(pathCount);
+		for (uint32_t i = 0; i < pathCount; i++)
+		{
+			this->sortedPaths[i] = this->paths[static_cast<uint32_t>(entries[i])];
+		}
+		this->paths.swap(this->sortedPaths);
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	uint32_t RayStream::computeSortKey(const aiRay& ray) const
+	{
+		const uint32_t maxCell = (1U << MORTON_BITS) - 1;
+		uint32_t morton{ 0 };
+		uint32_t octant{ 0 };
+		for (int k = 0; k < 3; k++)
+		{
+			// Origins outside the scene bounds are clamped to the border cells
+			const float cell = std::min(std::max((ray.pos[k] - this->boundsMin[k]) * this->scale[k], 0.f), static_cast<float>(maxCell));
+			morton |= expandBits(static_cast<uint32_t>(cell)) << k;
+			octant |= (ray.dir[k] < 0.f) ? (1U << k) : 0U;
+		}
+		return (octant << (KEY_BITS - 3)) | morton;
+	}
+
+	/*static*/ uint32_t RayStream::expandBits(uint32_t value)
+	{
+		static_assert(MORTON_BITS <= 10, "Three interleaved axes have to fit into 32 bits");
+		value = (value * 0x00010001U) & 0xFF0000FFU;
+		value = (value * 0x00000101U) & 0x0F00F00FU;
+		value = (value * 0x00000011U) & 0xC30C30C3U;
+		value = (value * 0x00000005U) & 0x49249249U;
+		return value;
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
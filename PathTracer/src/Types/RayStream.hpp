@@ -0,0 +1,129 @@
+/*
+ * RayStream.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <cstdint>
+#include <vector>
+
+#include "assimp/types.h"
+
+#include "raytracing.hpp"
+#include "BoundingBox.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Camera sample traced one bounce at a time. The radiance of the path is the product of the
+	// throughput and the light found at its end.
+	struct PathState
+	{
+		aiRay ray;
+
+		aiColor3D throughput;
+
+		// Pixel the path contributes to, relative to its tile
+		uint32_t pixel;
+
+		// Direction octant in the upper 3 bits, Morton code of the origin in the lower 27 bits
+		uint32_t sortKey;
+	};
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Rays of all paths of a tile waiting for their next bounce. Sorting groups rays that start
+	// close to each other and head the same way, so consecutive traversals touch the same nodes
+	// and triangles.
+	class RayStream
+	{
+	// Bits per axis of the quantized ray origin
+	static constexpr uint32_t MORTON_BITS = 9;
+
+	static constexpr uint32_t KEY_BITS = 3 * MORTON_BITS + 3;
+
+	// Key bits sorted per radix pass
+	static constexpr uint32_t RADIX_BITS = 10;
+
+	static constexpr uint32_t RADIX_BUCKETS = 1U << RADIX_BITS;
+
+	static constexpr uint32_t RADIX_PASSES = (KEY_BITS + RADIX_BITS - 1) / RADIX_BITS;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		RayStream(const BoundingBox& sceneBounds);
+
+		void push(const aiRay& ray, const aiColor3D& throughput, const uint32_t pixel);
+
+		// Orders the rays by direction octant first and by the Morton code of their origin second.
+		// Radix sorts keys and indices and moves every path only once.
+		void sort();
+
+		inline void clear()
+		{
+			this->paths.clear();
+		}
+
+		inline bool empty() const
+		{
+			return this->paths.empty();
+		}
+
+		inline size_t size() const
+		{
+			return this->paths.size();
+		}
+
+		inline const PathState& operator[](const size_t index) const
+		{
+			return this->paths[index];
+		}
+
+		inline void swap(RayStream& other)
+		{
+			this->paths.swap(other.paths);
+		}
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		uint32_t computeSortKey(const aiRay& ray) const;
+
+		// Spreads the lower MORTON_BITS bits of the value to every third bit
+		static uint32_t expandBits(uint32_t value);
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		std::vector<PathState> paths;
+
+		// Buffers reused by every sort
+		std::vector<PathState> sortedPaths;
+
+		// Sort key in the upper, path index in the lower 32 bits
+		std::vector<uint64_t> sortEntries;
+
+		std::vector<uint64_t> sortScratch;
+
+		aiVector3D boundsMin;
+
+		// Maps positions inside the scene bounds to [0, 2^MORTON_BITS)
+		aiVector3D scale;
+
+	};
+
+} // end of namespace raytracer
\ No newline at end of file
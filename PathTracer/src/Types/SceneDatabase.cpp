@@ -0,0 +1,257 @@
+/*
+ * SceneDatabase.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+
+#include "SceneDatabase.hpp"
+#include "exceptions.hpp"
+
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	SceneDatabase::SceneDatabase(const aiScene* scene)
+	{
+		// Count first, so every array is allocated exactly once
+		uint32_t vertexCount{ 0 };
+		uint32_t triangleCount{ 0 };
+		this->meshTriangleOffsets.reserve(scene->mNumMeshes + 1);
+		this->meshVertexOffsets.reserve(scene->mNumMeshes + 1);
+		for (unsigned int currentMesh = 0; currentMesh < scene->mNumMeshes; currentMesh++)
+		{
+			this->meshTriangleOffsets.push_back(triangleCount);
+			this->meshVertexOffsets.push_back(vertexCount);
+
+			const aiMesh* mesh = scene->mMeshes[currentMesh];
+			if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+			{
+				// Ignore points, lines and faces with more than 3 edges
+				triangleCount += mesh->mNumFaces;
+				vertexCount += mesh->mNumVertices;
+			}
+		}
+		this->meshTriangleOffsets.push_back(triangleCount);
+		this->meshVertexOffsets.push_back(vertexCount);
+
+		for (std::vector<float>* attribute : { &this->positionX, &this->positionY, &this->positionZ,
+			&this->normalX, &this->normalY, &this->normalZ, &this->textureU, &this->textureV })
+		{
+			attribute->resize(vertexCount, 0.f);
+		}
+		this->indices.resize(3 * static_cast<size_t>(triangleCount));
+		this->materials.resize(triangleCount);
+
+		for (unsigned int currentMesh = 0; currentMesh < scene->mNumMeshes; currentMesh++)
+		{
+			const aiMesh* mesh = scene->mMeshes[currentMesh];
+			if (this->meshTriangleOffsets[currentMesh] == this->meshTriangleOffsets[currentMesh + 1])
+			{
+				continue;
+			}
+
+			const uint32_t firstVertex = this->meshVertexOffsets[currentMesh];
+			std::fill(
+				this->materials.begin() + this->meshTriangleOffsets[currentMesh],
+				this->materials.begin() + this->meshTriangleOffsets[currentMesh + 1],
+				mesh->mMaterialIndex);
+			this->copyFaces(currentMesh, mesh);
+			this->copyVertices(currentMesh, mesh);
+
+			if (mesh->HasTextureCoords(0))
+			{
+				// Always use first texture channel
+				for (unsigned int currentVertex = 0; currentVertex < mesh->mNumVertices; currentVertex++)
+				{
+					this->textureU[firstVertex + currentVertex] = mesh->mTextureCoords[0][currentVertex].x;
+					this->textureV[firstVertex + currentVertex] = mesh->mTextureCoords[0][currentVertex].y;
+				}
+			}
+			this->bounds.extend(this->getMeshBounds(currentMesh));
+		}
+
+		this->lights.reserve(scene->mNumLights);
+		for (unsigned int currentLight = 0; currentLight < scene->mNumLights; currentLight++)
+		{
+			const aiLight* light = scene->mLights[currentLight];
+			SceneLight sceneLight;
+			sceneLight.type = light->mType;
+			sceneLight.position = light->mPosition;
+			sceneLight.direction = light->mDirection;
+			sceneLight.colorDiffuse = light->mColorDiffuse;
+			sceneLight.colorAmbient = light->mColorAmbient;
+			sceneLight.attenuationConstant = light->mAttenuationConstant;
+			sceneLight.attenuationLinear = light->mAttenuationLinear;
+			sceneLight.attenuationQuadratic = light->mAttenuationQuadratic;
+			this->lights.push_back(sceneLight);
+		}
+
+		this->cameras.reserve(scene->mNumCameras);
+		for (unsigned int currentCamera = 0; currentCamera < scene->mNumCameras; currentCamera++)
+		{
+			const aiCamera* camera = scene->mCameras[currentCamera];
+			SceneCamera sceneCamera;
+			sceneCamera.position = camera->mPosition;
+			sceneCamera.up = aiVector3D(camera->mUp).Normalize();
+			sceneCamera.lookAt = aiVector3D(camera->mLookAt).Normalize();
+			sceneCamera.right = aiVector3D(camera->mRight).Normalize();
+			sceneCamera.horizontalFOV = camera->mHorizontalFOV;
+			sceneCamera.aspect = camera->mAspect;
+			this->cameras.push_back(sceneCamera);
+		}
+	}
+
+	std::vector<KdTriangle> SceneDatabase::getTriangles() const
+	{
+		std::vector<KdTriangle> triangles(this->getTriangleCount());
+		for (uint32_t currentTriangle = 0; currentTriangle < triangles.size(); currentTriangle++)
+		{
+			triangles[currentTriangle] = { this, currentTriangle };
+		}
+		return triangles;
+	}
+
+	std::vector<KdTriangle> SceneDatabase::getMeshTriangles(const uint32_t mesh) const
+	{
+		const uint32_t firstTriangle = this->meshTriangleOffsets[mesh];
+		std::vector<KdTriangle> triangles(this->meshTriangleOffsets[mesh + 1] - firstTriangle);
+		for (uint32_t currentTriangle = 0; currentTriangle < triangles.size(); currentTriangle++)
+		{
+			triangles[currentTriangle] = { this, firstTriangle + currentTriangle };
+		}
+		return triangles;
+	}
+
+	void SceneDatabase::updateMesh(const uint32_t mesh, const aiMesh* source)
+	{
+		if ((source->mNumFaces != (this->meshTriangleOffsets[mesh + 1] - this->meshTriangleOffsets[mesh])) ||
+			(source->mNumVertices != (this->meshVertexOffsets[mesh + 1] - this->meshVertexOffsets[mesh])))
+		{
+			throw AccStructure("Number of faces or vertices of the mesh changed");
+		}
+		this->copyFaces(mesh, source);
+		this->copyVertices(mesh, source);
+
+		// Meshes only grow the scene bounds, they are used to sort rays and stay valid
+		this->bounds.extend(this->getMeshBounds(mesh));
+	}
+
+	SurfaceInteraction SceneDatabase::getSurface(const aiRay& ray, const IntersectionInformation& intersection, const aiMatrix3x3* normalTransform) const
+	{
+		SurfaceInteraction surface;
+		surface.ray = ray;
+		surface.uv = intersection.uv;
+		surface.material = this->materials[intersection.triangle];
+
+		// The distance is measured in world space, where the ray parameter is shared by instances
+		surface.hitPoint = ray.pos + ray.dir * (intersection.intersectionDistance / ray.dir.Length());
+
+		const uint32_t* vertex = &this->indices[3 * intersection.triangle];
+		const float weights[3] = { 1.f - intersection.uv.x - intersection.uv.y, intersection.uv.x, intersection.uv.y };
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			const uint32_t index = vertex[corner];
+			surface.vertices[corner] = aiVector3D(this->positionX[index], this->positionY[index], this->positionZ[index]);
+			surface.smoothNormal += weights[corner] * aiVector3D(this->normalX[index], this->normalY[index], this->normalZ[index]);
+			surface.uvTextureCoords += weights[corner] * aiVector3D(this->textureU[index], this->textureV[index], 0.f);
+		}
+		if (normalTransform)
+		{
+			surface.smoothNormal = *normalTransform * surface.smoothNormal;
+		}
+		surface.smoothNormal.Normalize();
+		return surface;
+	}
+
+	BoundingBox SceneDatabase::getMeshBounds(const uint32_t mesh) const
+	{
+		BoundingBox meshBounds;
+		for (uint32_t vertex = this->meshVertexOffsets[mesh]; vertex < this->meshVertexOffsets[mesh + 1]; vertex++)
+		{
+			meshBounds.extend(aiVector3D(this->positionX[vertex], this->positionY[vertex], this->positionZ[vertex]));
+		}
+		return meshBounds;
+	}
+
+	size_t SceneDatabase::getMemoryFootprint() const
+	{
+		return
+			sizeof(SceneDatabase) +
+			8 * this->positionX.capacity() * sizeof(float) +
+			(this->indices.capacity() + this->materials.capacity()) * sizeof(uint32_t) +
+			(this->meshTriangleOffsets.capacity() + this->meshVertexOffsets.capacity()) * sizeof(uint32_t) +
+			this->lights.capacity() * sizeof(SceneLight) +
+			this->cameras.capacity() * sizeof(SceneCamera);
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	void SceneDatabase::copyFaces(const uint32_t mesh, const aiMesh* source)
+	{
+		// Invariant: A face always consists of 3 vertices
+		const uint32_t firstTriangle = this->meshTriangleOffsets[mesh];
+		const uint32_t firstVertex = this->meshVertexOffsets[mesh];
+		for (unsigned int currentFace = 0; currentFace < source->mNumFaces; currentFace++)
+		{
+			const aiFace& face = source->mFaces[currentFace];
+			for (unsigned int currentIndex = 0; currentIndex < 3; currentIndex++)
+			{
+				this->indices[3 * (firstTriangle + currentFace) + currentIndex] = firstVertex + face.mIndices[currentIndex];
+			}
+		}
+	}
+
+	void SceneDatabase::copyVertices(const uint32_t mesh, const aiMesh* source)
+	{
+		const uint32_t firstVertex = this->meshVertexOffsets[mesh];
+		for (unsigned int currentVertex = 0; currentVertex < source->mNumVertices; currentVertex++)
+		{
+			const aiVector3D& position = source->mVertices[currentVertex];
+			this->positionX[firstVertex + currentVertex] = position.x;
+			this->positionY[firstVertex + currentVertex] = position.y;
+			this->positionZ[firstVertex + currentVertex] = position.z;
+		}
+
+		if (source->HasNormals())
+		{
+			for (unsigned int currentVertex = 0; currentVertex < source->mNumVertices; currentVertex++)
+			{
+				const aiVector3D& normal = source->mNormals[currentVertex];
+				this->normalX[firstVertex + currentVertex] = normal.x;
+				this->normalY[firstVertex + currentVertex] = normal.y;
+				this->normalZ[firstVertex + currentVertex] = normal.z;
+			}
+			return;
+		}
+
+		// Meshes without normals are shaded with the area weighted normals of the adjacent faces
+		std::vector<aiVector3D> normals(source->mNumVertices);
+		for (uint32_t triangle = this->meshTriangleOffsets[mesh]; triangle < this->meshTriangleOffsets[mesh + 1]; triangle++)
+		{
+			const aiVector3D vertex0 = this->getVertex(triangle, 0);
+			const aiVector3D faceNormal = (this->getVertex(triangle, 1) - vertex0) ^ (this->getVertex(triangle, 2) - vertex0);
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				normals[this->indices[3 * triangle + corner] - firstVertex] += faceNormal;
+			}
+		}
+		for (unsigned int currentVertex = 0; currentVertex < source->mNumVertices; currentVertex++)
+		{
+			const aiVector3D normal = normals[currentVertex].Normalize();
+			this->normalX[firstVertex + currentVertex] = normal.x;
+			this->normalY[firstVertex + currentVertex] = normal.y;
+			this->normalZ[firstVertex + currentVertex] = normal.z;
+		}
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
@@ -0,0 +1,201 @@
+/*
+ * SceneDatabase.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <cstdint>
+#include <vector>
+
+#include "assimp/scene.h"
+
+#include "raytracing.hpp"
+#include "BoundingBox.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Light source in world space
+	struct SceneLight
+	{
+		aiLightSourceType type;
+
+		aiVector3D position;
+
+		aiVector3D direction;
+
+		aiColor3D colorDiffuse;
+
+		aiColor3D colorAmbient;
+
+		float attenuationConstant;
+
+		float attenuationLinear;
+
+		float attenuationQuadratic;
+	};
+
+	// Camera in world space with normalized axes
+	struct SceneCamera
+	{
+		aiVector3D position;
+
+		aiVector3D up;
+
+		aiVector3D lookAt;
+
+		aiVector3D right;
+
+		float horizontalFOV;
+
+		float aspect;
+	};
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Geometry, lights and cameras of the imported scene in the layout read by intersection and
+	// shading. Vertex attributes are stored as structure of arrays and indexed by one triple per
+	// triangle, so a triangle is identified by a single index instead of a face and its mesh.
+	// It is built once after the import. Materials stay with the imported scene and are referenced
+	// by their index.
+	class SceneDatabase
+	{
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		// Copies all triangle meshes of the scene. Lights and cameras are expected in world space.
+		explicit SceneDatabase(const aiScene* scene);
+
+		// References to all triangles of the scene
+		std::vector<KdTriangle> getTriangles() const;
+
+		// References to the triangles of a single mesh. Empty for meshes which are not triangle meshes.
+		std::vector<KdTriangle> getMeshTriangles(const uint32_t mesh) const;
+
+		// Copies the faces, vertex positions and normals of a mesh again after it was edited. The
+		// number of faces and vertices has to stay the same.
+		void updateMesh(const uint32_t mesh, const aiMesh* source);
+
+		// Interpolates the surface attributes at a hit. Normals of instanced meshes are mapped to
+		// world space by normalTransform, which is nullptr for meshes which are not instanced.
+		SurfaceInteraction getSurface(const aiRay& ray, const IntersectionInformation& intersection, const aiMatrix3x3* normalTransform) const;
+
+		// Bounds of the vertices of a mesh in object space
+		BoundingBox getMeshBounds(const uint32_t mesh) const;
+
+		size_t getMemoryFootprint() const;
+
+		inline aiVector3D getVertex(const uint32_t triangle, const uint32_t corner) const
+		{
+			const uint32_t vertex = this->indices[3 * triangle + corner];
+			return aiVector3D(this->positionX[vertex], this->positionY[vertex], this->positionZ[vertex]);
+		}
+
+		inline uint32_t getMaterial(const uint32_t triangle) const
+		{
+			return this->materials[triangle];
+		}
+
+		inline uint32_t getTriangleCount() const
+		{
+			return static_cast<uint32_t>(this->materials.size());
+		}
+
+		inline uint32_t getFirstTriangle(const uint32_t mesh) const
+		{
+			return this->meshTriangleOffsets[mesh];
+		}
+
+		inline uint32_t getMeshTriangleCount(const uint32_t mesh) const
+		{
+			return this->meshTriangleOffsets[mesh + 1] - this->meshTriangleOffsets[mesh];
+		}
+
+		inline uint32_t getMeshCount() const
+		{
+			return static_cast<uint32_t>(this->meshTriangleOffsets.size() - 1);
+		}
+
+		inline const std::vector<SceneLight>& getLights() const
+		{
+			return this->lights;
+		}
+
+		inline const std::vector<SceneCamera>& getCameras() const
+		{
+			return this->cameras;
+		}
+
+		// Bounds of all meshes
+		inline const BoundingBox& getBounds() const
+		{
+			return this->bounds;
+		}
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		// Writes the vertex indices of the faces of a mesh starting at its triangle offset
+		void copyFaces(const uint32_t mesh, const aiMesh* source);
+
+		// Writes the positions and normals of a mesh starting at its vertex offset
+		void copyVertices(const uint32_t mesh, const aiMesh* source);
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		std::vector<float> positionX;
+
+		std::vector<float> positionY;
+
+		std::vector<float> positionZ;
+
+		std::vector<float> normalX;
+
+		std::vector<float> normalY;
+
+		std::vector<float> normalZ;
+
+		// First texture channel, zero for meshes without texture coordinates
+		std::vector<float> textureU;
+
+		std::vector<float> textureV;
+
+		// Three vertex indices per triangle
+		std::vector<uint32_t> indices;
+
+		// Material index of every triangle
+		std::vector<uint32_t> materials;
+
+		// First triangle and vertex of every mesh, followed by the total count
+		std::vector<uint32_t> meshTriangleOffsets;
+
+		std::vector<uint32_t> meshVertexOffsets;
+
+		std::vector<SceneLight> lights;
+
+		std::vector<SceneCamera> cameras;
+
+		BoundingBox bounds;
+
+	};
+
+	inline aiVector3D KdTriangle::getVertex(const uint32_t corner) const
+	{
+		return this->database->getVertex(this->triangle, corner);
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
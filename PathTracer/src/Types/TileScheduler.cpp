@@ -0,0 +1,335 @@
+/*
+ * TileScheduler.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <thread>
+
+#include "sdl2/SDL.h"
+
+#include "TileScheduler.hpp"
+
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	using SteadyClock = std::chrono::steady_clock;
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	void TileScheduler::reset(const uint32_t workerCount)
+	{
+		this->workers.clear();
+		for (uint32_t worker = 0; worker < std::max(workerCount, 1U); worker++)
+		{
+			this->workers.emplace_back(new TileWorker());
+		}
+		this->queuedTiles = 0;
+		this->unfinishedTiles = 0;
+	}
+
+	void TileScheduler::distribute(const std::vector<RenderJob>& jobs)
+	{
+		// Consecutive tiles hit the same geometry if the order keeps them close together, so
+		// worker w gets the band [w * n / W, (w + 1) * n / W)
+		const size_t workerCount = this->workers.size();
+		for (size_t worker = 0; worker < workerCount; worker++)
+		{
+			TileWorker& tileWorker = *this->workers[worker];
+			std::lock_guard<std::mutex> lock(tileWorker.mutex);
+			tileWorker.tiles.insert(tileWorker.tiles.end(),
+				jobs.begin() + worker * jobs.size() / workerCount,
+				jobs.begin() + (worker + 1) * jobs.size() / workerCount);
+		}
+		this->unfinishedTiles += static_cast<uint32_t>(jobs.size());
+		this->queuedTiles += static_cast<uint32_t>(jobs.size());
+	}
+
+	bool TileScheduler::next(const uint32_t worker, RenderJob& outJob)
+	{
+		TileWorker& self = *this->workers[worker];
+		const SteadyClock::time_point searchStart = SteadyClock::now();
+		if (self.rendering)
+		{
+			self.busySeconds += std::chrono::duration<double>(searchStart - self.tileStart).count();
+			self.tilesRendered++;
+			self.rendering = false;
+			this->unfinishedTiles.fetch_sub(1, std::memory_order_acq_rel);
+		}
+
+		while (true)
+		{
+			if (this->takeOwn(self, outJob) || this->steal(worker, outJob))
+			{
+				self.tileStart = SteadyClock::now();
+				self.idleSeconds += std::chrono::duration<double>(self.tileStart - searchStart).count();
+				self.rendering = true;
+				return true;
+			}
+
+			// Tiles still being rendered may be split and shared, so only leave once all are done
+			if (this->unfinishedTiles.load(std::memory_order_acquire) == 0)
+			{
+				self.idleSeconds += std::chrono::duration<double>(SteadyClock::now() - searchStart).count();
+				return false;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	void TileScheduler::logStatistics() const
+	{
+		uint64_t tilesRendered{ 0 };
+		uint64_t tilesStolen{ 0 };
+		uint64_t tilesSplit{ 0 };
+		uint64_t lockContentions{ 0 };
+		double busySeconds{ 0. };
+		double idleSeconds{ 0. };
+		for (const std::unique_ptr<TileWorker>& worker : this->workers)
+		{
+			tilesRendered += worker->tilesRendered;
+			tilesStolen += worker->tilesStolen;
+			tilesSplit += worker->tilesSplit;
+			lockContentions += worker->lockContentions;
+			busySeconds += worker->busySeconds;
+			idleSeconds += worker->idleSeconds;
+		}
+		const double threadSeconds = busySeconds + idleSeconds;
+
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Tile scheduler: %llu tiles rendered, %llu split, %llu stolen, %llu lock contentions",
+			static_cast<unsigned long long>(tilesRendered),
+			static_cast<unsigned long long>(tilesSplit),
+			static_cast<unsigned long long>(tilesStolen),
+			static_cast<unsigned long long>(lockContentions));
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Render threads were idle %.1f%% of %.2f thread seconds",
+			(threadSeconds > 0.) ? 100. * idleSeconds / threadSeconds : 0.,
+			threadSeconds);
+		for (size_t worker = 0; worker < this->workers.size(); worker++)
+		{
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "  Thread %zu: %llu tiles, %.2f seconds busy, %.2f seconds idle",
+				worker,
+				static_cast<unsigned long long>(this->workers[worker]->tilesRendered),
+				this->workers[worker]->busySeconds,
+				this->workers[worker]->idleSeconds);
+		}
+	}
+
+	/*static*/ std::vector<RenderJob> TileScheduler::createTiles(const uint16_t width, const uint16_t height, const uint16_t tileSize, const TileOrder order)
+	{
+		const uint32_t tilesX = width / tileSize;
+		const uint32_t tilesY = height / tileSize;
+
+		// Indices of the tiles in rows, brought into the requested order
+		std::vector<uint32_t> tileIndices;
+		if (order == TileOrder::SPIRAL)
+		{
+			tileIndices = spiralOrder(tilesX, tilesY);
+		}
+		else
+		{
+			uint32_t curveSize{ 1 };
+			while ((curveSize < tilesX) || (curveSize < tilesY))
+			{
+				curveSize *= 2;
+			}
+
+			// Curve position in the upper half, so sorting keeps rows for equal positions
+			std::vector<uint64_t> keys;
+			keys.reserve(static_cast<size_t>(tilesX) * tilesY);
+			for (uint32_t y = 0; y < tilesY; y++)
+			{
+				for (uint32_t x = 0; x < tilesX; x++)
+				{
+					uint64_t curveIndex{ 0 };
+					if (order == TileOrder::MORTON)
+					{
+						curveIndex = mortonIndex(x, y);
+					}
+					else if (order == TileOrder::HILBERT)
+					{
+						curveIndex = hilbertIndex(curveSize, x, y);
+					}
+					keys.push_back((curveIndex << 32) | (y * tilesX + x));
+				}
+			}
+			std::sort(keys.begin(), keys.end());
+
+			tileIndices.reserve(keys.size());
+			for (const uint64_t key : keys)
+			{
+				tileIndices.push_back(static_cast<uint32_t>(key));
+			}
+		}
+
+		std::vector<RenderJob> jobs;
+		jobs.reserve(tileIndices.size());
+		for (const uint32_t tile : tileIndices)
+		{
+			const uint16_t startX = static_cast<uint16_t>((tile % tilesX) * tileSize);
+			const uint16_t startY = static_cast<uint16_t>((tile / tilesX) * tileSize);
+			jobs.emplace_back(startX, startY, startX + tileSize, startY + tileSize);
+		}
+		return jobs;
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	bool TileScheduler::takeOwn(TileWorker& worker, RenderJob& outJob)
+	{
+		lockCounted(worker, worker.mutex);
+		if (worker.tiles.empty())
+		{
+			worker.mutex.unlock();
+			return false;
+		}
+		outJob = worker.tiles.front();
+		worker.tiles.pop_front();
+		this->queuedTiles.fetch_sub(1, std::memory_order_relaxed);
+		this->split(worker, outJob);
+		worker.mutex.unlock();
+		return true;
+	}
+
+	bool TileScheduler::steal(const uint32_t thief, RenderJob& outJob)
+	{
+		TileWorker& self = *this->workers[thief];
+		for (size_t offset = 1; offset < this->workers.size(); offset++)
+		{
+			// Keep idle workers from locking every deque while the last tiles are rendered
+			if (this->queuedTiles.load(std::memory_order_relaxed) == 0)
+			{
+				return false;
+			}
+
+			TileWorker& victim = *this->workers[(thief + offset) % this->workers.size()];
+			if (!victim.mutex.try_lock())
+			{
+				self.lockContentions++;
+				continue;
+			}
+			if (victim.tiles.empty())
+			{
+				victim.mutex.unlock();
+				continue;
+			}
+			outJob = victim.tiles.back();
+			victim.tiles.pop_back();
+			this->queuedTiles.fetch_sub(1, std::memory_order_relaxed);
+			victim.mutex.unlock();
+
+			self.tilesStolen++;
+			lockCounted(self, self.mutex);
+			this->split(self, outJob);
+			self.mutex.unlock();
+			return true;
+		}
+		return false;
+	}
+
+	void TileScheduler::split(TileWorker& worker, RenderJob& job)
+	{
+		if ((this->queuedTiles.load(std::memory_order_relaxed) >= this->workers.size()) ||
+			(job.getTileWidth() < 2 * MIN_SUBTILE_SIZE) ||
+			(job.getTileHeight() < 2 * MIN_SUBTILE_SIZE))
+		{
+			return;
+		}
+
+		// Quarters stay multiples of MIN_SUBTILE_SIZE as long as the tile is
+		const uint16_t centerX = job.getTileStartX() + job.getTileWidth() / 2 / MIN_SUBTILE_SIZE * MIN_SUBTILE_SIZE;
+		const uint16_t centerY = job.getTileStartY() + job.getTileHeight() / 2 / MIN_SUBTILE_SIZE * MIN_SUBTILE_SIZE;
+
+		// The worker continues with the quarters in order, thieves take the tiles from the back
+		this->unfinishedTiles.fetch_add(3, std::memory_order_relaxed);
+		worker.tiles.emplace_front(centerX, centerY, job.getTileEndX(), job.getTileEndY());
+		worker.tiles.emplace_front(job.getTileStartX(), centerY, centerX, job.getTileEndY());
+		worker.tiles.emplace_front(centerX, job.getTileStartY(), job.getTileEndX(), centerY);
+		this->queuedTiles.fetch_add(3, std::memory_order_relaxed);
+		job = RenderJob(job.getTileStartX(), job.getTileStartY(), centerX, centerY);
+		worker.tilesSplit++;
+	}
+
+	/*static*/ void TileScheduler::lockCounted(TileWorker& worker, std::mutex& mutex)
+	{
+		if (!mutex.try_lock())
+		{
+			worker.lockContentions++;
+			mutex.lock();
+		}
+	}
+
+	/*static*/ uint32_t TileScheduler::mortonIndex(uint32_t x, uint32_t y)
+	{
+		uint32_t index{ 0 };
+		for (uint32_t bit = 0; bit < 16; bit++)
+		{
+			index |= ((x >> bit) & 1U) << (2 * bit);
+			index |= ((y >> bit) & 1U) << (2 * bit + 1);
+		}
+		return index;
+	}
+
+	/*static*/ uint32_t TileScheduler::hilbertIndex(const uint32_t size, uint32_t x, uint32_t y)
+	{
+		uint32_t index{ 0 };
+		for (uint32_t quadrant = size / 2; quadrant > 0; quadrant /= 2)
+		{
+			const uint32_t right = (x & quadrant) ? 1 : 0;
+			const uint32_t lower = (y & quadrant) ? 1 : 0;
+			index += quadrant * quadrant * ((3 * right) ^ lower);
+
+			// Rotate the quadrant, so the curve inside it starts where the previous one ended
+			if (lower == 0)
+			{
+				if (right == 1)
+				{
+					x = size - 1 - x;
+					y = size - 1 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return index;
+	}
+
+	/*static*/ std::vector<uint32_t> TileScheduler::spiralOrder(const uint32_t tilesX, const uint32_t tilesY)
+	{
+		const size_t tileCount = static_cast<size_t>(tilesX) * tilesY;
+		std::vector<uint32_t> tileIndices;
+		tileIndices.reserve(tileCount);
+		if (tileCount == 0)
+		{
+			return tileIndices;
+		}
+
+		// Legs of growing length turning right: 1 right, 1 down, 2 left, 2 up, 3 right, ...
+		// Positions outside of the image are walked over but not rendered.
+		const int32_t stepX[4] = { 1, 0, -1, 0 };
+		const int32_t stepY[4] = { 0, 1, 0, -1 };
+		int32_t x = static_cast<int32_t>(tilesX - 1) / 2;
+		int32_t y = static_cast<int32_t>(tilesY - 1) / 2;
+		tileIndices.push_back(y * tilesX + x);
+		for (uint32_t leg = 0; tileIndices.size() < tileCount; leg++)
+		{
+			for (uint32_t step = 0; step < leg / 2 + 1; step++)
+			{
+				x += stepX[leg % 4];
+				y += stepY[leg % 4];
+				if ((x >= 0) && (y >= 0) && (x < static_cast<int32_t>(tilesX)) && (y < static_cast<int32_t>(tilesY)))
+				{
+					tileIndices.push_back(y * tilesX + x);
+				}
+			}
+		}
+		return tileIndices;
+	}
+
+} // end of namespace raytracing
\ No newline at end of file
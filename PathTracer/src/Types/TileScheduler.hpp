@@ -0,0 +1,134 @@
+/*
+ * TileScheduler.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "RenderJob.hpp"
+#include "settings.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Tiles and statistics of one render thread. Aligned to keep the state of different threads
+	// off each other's cache lines.
+	struct alignas(64) TileWorker
+	{
+		// Front is taken by the owner, back is stolen by other workers
+		std::deque<RenderJob> tiles;
+
+		std::mutex mutex;
+
+		// Set while the worker renders a tile it took
+		bool rendering{ false };
+
+		std::chrono::steady_clock::time_point tileStart;
+
+		// Statistics, only written by the owning worker
+		uint64_t tilesRendered{ 0 };
+
+		uint64_t tilesStolen{ 0 };
+
+		uint64_t tilesSplit{ 0 };
+
+		// Failed attempts to lock a tile deque right away
+		uint64_t lockContentions{ 0 };
+
+		double busySeconds{ 0. };
+
+		double idleSeconds{ 0. };
+	};
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Distributes the tiles of a frame to the render threads. Every thread starts with its own
+	// contiguous band of the frame order, which is a compact region of the image for the curve
+	// orders, and steals from the far end of other bands once its own band is done. When fewer
+	// tiles are queued than threads, taken tiles are split into quarters, so the expensive tiles
+	// at the end of a frame are shared instead of leaving threads idle.
+	class TileScheduler
+	{
+
+	// Tiles are not split below this width and height, which is a multiple of every packet block
+	static constexpr uint16_t MIN_SUBTILE_SIZE = 8;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		// Drops all queued tiles and statistics. At least one worker is created.
+		void reset(const uint32_t workerCount);
+
+		// Queues tiles in rendering order, split into one contiguous band per worker
+		void distribute(const std::vector<RenderJob>& jobs);
+
+		// Finishes the previous tile of the worker and takes the next one. Waits while other
+		// workers still render tiles that may be split. Returns false once the frame is done.
+		bool next(const uint32_t worker, RenderJob& outJob);
+
+		// Logs the tile counts, lock contention and the time render threads spent idle
+		void logStatistics() const;
+
+		// Full tiles of tileSize pixels covering the image in the given order. Pixels right of
+		// and below the last full tile are not covered.
+		static std::vector<RenderJob> createTiles(const uint16_t width, const uint16_t height, const uint16_t tileSize, const TileOrder order);
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		// Pops the front tile of the worker's own deque, splitting it if the queues run low
+		bool takeOwn(TileWorker& worker, RenderJob& outJob);
+
+		// Pops the back tile of another worker's deque. Busy deques are skipped.
+		bool steal(const uint32_t thief, RenderJob& outJob);
+
+		// Renders one quarter of the tile and queues the other quarters at the front of the worker
+		// if the tile is large enough. Expects the worker's deque to be locked.
+		void split(TileWorker& worker, RenderJob& job);
+
+		static void lockCounted(TileWorker& worker, std::mutex& mutex);
+
+		// Position of the tile on the Z-order curve, interleaving the bits of x and y
+		static uint32_t mortonIndex(uint32_t x, uint32_t y);
+
+		// Position of the tile on the Hilbert curve filling a grid of size x size tiles. The size
+		// is a power of two.
+		static uint32_t hilbertIndex(const uint32_t size, uint32_t x, uint32_t y);
+
+		// Tile indices in rows of tilesX, walking square rings around the center tile
+		static std::vector<uint32_t> spiralOrder(const uint32_t tilesX, const uint32_t tilesY);
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		std::vector<std::unique_ptr<TileWorker>> workers;
+
+		// Tiles waiting in any deque
+		std::atomic<uint32_t> queuedTiles{ 0 };
+
+		// Tiles waiting or being rendered. The frame is done once it drops to zero.
+		std::atomic<uint32_t> unfinishedTiles{ 0 };
+
+	};
+
+} // end of namespace raytracing
\ No newline at end of file
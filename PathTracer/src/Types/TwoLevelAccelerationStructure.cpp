@@ -0,0 +1,227 @@
+/*
+ * TwoLevelAccelerationStructure.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <memory>
+
+#include "TwoLevelAccelerationStructure.hpp"
+#include "exceptions.hpp"
+
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	/*static*/ TwoLevelAccelerationStructure* TwoLevelAccelerationStructure::build(const aiScene* scene, SceneDatabase& database, const BottomLevelBuilder& buildBottomLevel)
+	{
+		std::unique_ptr<TwoLevelAccelerationStructure> structure(new TwoLevelAccelerationStructure(scene, database, buildBottomLevel));
+
+		structure->collectInstances(scene->mRootNode, aiMatrix4x4());
+		if (structure->instances.empty())
+		{
+			throw AccStructure("Cannot build a two level acceleration structure without triangle meshes");
+		}
+
+		structure->topLevelOutdated = true;
+		structure->commit();
+
+		return structure.release();
+	}
+
+	void TwoLevelAccelerationStructure::setInstanceTransform(const uint32_t instance, const aiMatrix4x4& objectToWorld)
+	{
+		this->placeInstance(instance, objectToWorld);
+		this->topLevelOutdated = true;
+	}
+
+	void TwoLevelAccelerationStructure::updateMesh(const unsigned int meshIndex, const bool facesChanged)
+	{
+		const uint32_t bottomLevel = this->bottomLevelOfMesh[meshIndex];
+		if (bottomLevel == UINT32_MAX)
+		{
+			throw AccStructure("Mesh is not referenced by the scene graph");
+		}
+
+		this->database.updateMesh(meshIndex, this->scene->mMeshes[meshIndex]);
+		if (facesChanged || !this->bottomLevels[bottomLevel]->refit())
+		{
+			this->bottomLevels[bottomLevel].reset(this->buildBottomLevel(meshIndex));
+		}
+		this->bottomLevelBounds[bottomLevel] = this->database.getMeshBounds(meshIndex);
+
+		// Every instance of the mesh changes its extent
+		for (uint32_t instance = 0; instance < this->instances.size(); instance++)
+		{
+			if (this->instances[instance].bottomLevel == bottomLevel)
+			{
+				this->placeInstance(instance, this->instances[instance].objectToWorld);
+			}
+		}
+		this->topLevelOutdated = true;
+	}
+
+	void TwoLevelAccelerationStructure::commit()
+	{
+		if (!this->topLevelOutdated)
+		{
+			return;
+		}
+
+		// The top level is a hierarchy over boxes like any other, its leaves just list instances.
+		// It only holds a few nodes per instance, so it is always rebuilt instead of refit.
+		this->topLevel.reset(new BoundingVolumeHierarchy(std::vector<KdTriangle>()));
+		this->topLevel->buildNodes(this->instanceBounds);
+		this->topLevelOutdated = false;
+	}
+
+	bool TwoLevelAccelerationStructure::calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection)
+	{
+		// Hit distances are measured in world space, the traversal works with the ray parameter
+		const float directionLength = ray.dir.Length();
+		float nearestDistance{ outIntersection->intersectionDistance };
+		bool intersects{ false };
+
+		const uint64_t nodesVisited = this->topLevel->traverseLeaves(ray, nearestDistance / directionLength,
+			[&](const uint32_t instanceIndex, float* tMax)
+			{
+				const MeshInstance& instance = this->instances[instanceIndex];
+				const aiRay objectRay = toObjectSpace(instance, ray);
+
+				// The object space direction is not normalized, so both rays share the ray parameter.
+				// Distances scale with the length of the direction.
+				const float toObjectDistance = objectRay.dir.Length() / directionLength;
+				outIntersection->intersectionDistance = nearestDistance * toObjectDistance;
+				if (this->bottomLevels[instance.bottomLevel]->calculateIntersection(objectRay, outIntersection))
+				{
+					intersects = true;
+					nearestDistance = outIntersection->intersectionDistance / toObjectDistance;
+					outIntersection->instance = instanceIndex;
+					*tMax = nearestDistance / directionLength;
+				}
+				return false;
+			});
+		outIntersection->intersectionDistance = nearestDistance;
+
+		// Triangle tests are counted by the bottom levels
+		this->recordTraversal(nodesVisited, 0);
+		return intersects;
+	}
+
+	bool TwoLevelAccelerationStructure::occluded(const aiRay& ray, const float tMax)
+	{
+		bool occluded{ false };
+
+		const uint64_t nodesVisited = this->topLevel->traverseLeaves(ray, tMax,
+			[&](const uint32_t instanceIndex, float* /*tMax*/)
+			{
+				// The ray parameter is the same in object space, so tMax needs no conversion
+				const MeshInstance& instance = this->instances[instanceIndex];
+				occluded = this->bottomLevels[instance.bottomLevel]->occluded(toObjectSpace(instance, ray), tMax);
+				return occluded;
+			});
+
+		this->recordTraversal(nodesVisited, 0);
+		return occluded;
+	}
+
+	size_t TwoLevelAccelerationStructure::getMemoryFootprint() const
+	{
+		size_t footprint =
+			sizeof(TwoLevelAccelerationStructure) +
+			this->topLevel->getMemoryFootprint() +
+			this->instances.capacity() * (sizeof(MeshInstance) + sizeof(BoundingBox)) +
+			this->bottomLevels.capacity() * (sizeof(std::unique_ptr<AccelerationStructure>) + sizeof(BoundingBox)) +
+			this->bottomLevelOfMesh.capacity() * sizeof(uint32_t);
+		for (const std::unique_ptr<AccelerationStructure>& bottomLevel : this->bottomLevels)
+		{
+			footprint += bottomLevel->getMemoryFootprint();
+		}
+		return footprint;
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	const aiMatrix3x3* TwoLevelAccelerationStructure::getNormalTransform(const uint32_t instance) const
+	{
+		return &this->instances[instance].normalToWorld;
+	}
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	void TwoLevelAccelerationStructure::collectInstances(const aiNode* node, const aiMatrix4x4& parentToWorld)
+	{
+		const aiMatrix4x4 nodeToWorld = parentToWorld * node->mTransformation;
+
+		for (unsigned int currentMesh = 0; currentMesh < node->mNumMeshes; currentMesh++)
+		{
+			const unsigned int meshIndex = node->mMeshes[currentMesh];
+			const aiMesh* mesh = this->scene->mMeshes[meshIndex];
+			if ((mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE) || (mesh->mNumFaces == 0))
+			{
+				// Ignore points, lines and faces with more than 3 edges
+				continue;
+			}
+
+			if (this->bottomLevelOfMesh[meshIndex] == UINT32_MAX)
+			{
+				this->bottomLevelOfMesh[meshIndex] = static_cast<uint32_t>(this->bottomLevels.size());
+				this->bottomLevels.emplace_back(this->buildBottomLevel(meshIndex));
+				this->bottomLevelBounds.push_back(this->database.getMeshBounds(meshIndex));
+			}
+
+			MeshInstance instance;
+			instance.bottomLevel = this->bottomLevelOfMesh[meshIndex];
+			instance.node = node;
+			instance.mesh = meshIndex;
+			this->instances.push_back(instance);
+			this->instanceBounds.emplace_back();
+			this->placeInstance(static_cast<uint32_t>(this->instances.size() - 1), nodeToWorld);
+		}
+
+		for (unsigned int currentChild = 0; currentChild < node->mNumChildren; currentChild++)
+		{
+			this->collectInstances(node->mChildren[currentChild], nodeToWorld);
+		}
+	}
+
+	AccelerationStructure* TwoLevelAccelerationStructure::buildBottomLevel(const unsigned int meshIndex)
+	{
+		AccelerationStructure* bottomLevel = this->bottomLevelBuilder(this->database.getMeshTriangles(meshIndex));
+		this->countTraversalsOf(*bottomLevel);
+		return bottomLevel;
+	}
+
+	void TwoLevelAccelerationStructure::placeInstance(const uint32_t instance, const aiMatrix4x4& objectToWorld)
+	{
+		MeshInstance& meshInstance = this->instances[instance];
+		meshInstance.objectToWorld = objectToWorld;
+		meshInstance.worldToObject = aiMatrix4x4(objectToWorld).Inverse();
+		meshInstance.normalToWorld = aiMatrix3x3(meshInstance.worldToObject).Transpose();
+
+		// Bounds of the transformed corners of the mesh bounds
+		const BoundingBox& meshBounds = this->bottomLevelBounds[meshInstance.bottomLevel];
+		BoundingBox worldBounds;
+		for (uint8_t corner = 0; corner < 8; corner++)
+		{
+			const aiVector3D point(
+				(corner & 1) ? meshBounds.getMax().x : meshBounds.getMin().x,
+				(corner & 2) ? meshBounds.getMax().y : meshBounds.getMin().y,
+				(corner & 4) ? meshBounds.getMax().z : meshBounds.getMin().z);
+			worldBounds.extend(objectToWorld * point);
+		}
+		this->instanceBounds[instance] = worldBounds;
+	}
+
+	/*static*/ aiRay TwoLevelAccelerationStructure::toObjectSpace(const MeshInstance& instance, const aiRay& ray)
+	{
+		return aiRay(instance.worldToObject * ray.pos, aiMatrix3x3(instance.worldToObject) * ray.dir, ray.type);
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
@@ -0,0 +1,161 @@
+/*
+ * TwoLevelAccelerationStructure.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "assimp/scene.h"
+
+#include "raytracing.hpp"
+#include "AccelerationStructure.hpp"
+#include "BoundingVolumeHierarchy.hpp"
+#include "SceneDatabase.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Placement of a mesh in the scene, as referenced by a node of the scene graph
+	struct MeshInstance
+	{
+		aiMatrix4x4 objectToWorld;
+
+		aiMatrix4x4 worldToObject;
+
+		// Inverse transpose of the upper 3x3 part of objectToWorld
+		aiMatrix3x3 normalToWorld;
+
+		// Index into the bottom level structures
+		uint32_t bottomLevel;
+
+		// Scene graph node and mesh the instance was created for
+		const aiNode* node;
+
+		unsigned int mesh;
+	};
+
+	// Builds the bottom level structure of a single mesh from its triangles
+	typedef std::function<AccelerationStructure*(const std::vector<KdTriangle>&)> BottomLevelBuilder;
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Bounding volume hierarchy over the mesh instances of the scene graph. Every referenced mesh
+	// gets one bottom level structure in object space, so repeated meshes are stored only once.
+	// Rays are transformed into object space when they enter an instance.
+	// Moved instances and edited meshes are updated without touching the rest of the scene. Updates
+	// must not overlap with intersection queries.
+	class TwoLevelAccelerationStructure : public AccelerationStructure
+	{
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		// Collects all instances of triangle meshes below the root node of the scene. The triangles
+		// of the meshes are referenced in the database, which is refreshed by updateMesh.
+		static TwoLevelAccelerationStructure* build(const aiScene* scene, SceneDatabase& database, const BottomLevelBuilder& buildBottomLevel);
+
+		virtual bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) override;
+
+		virtual bool occluded(const aiRay& ray, const float tMax) override;
+
+		virtual size_t getMemoryFootprint() const override;
+
+		// Places an instance anew. Takes effect with the next call of commit().
+		void setInstanceTransform(const uint32_t instance, const aiMatrix4x4& objectToWorld);
+
+		// Updates the bottom level of a mesh after its vertices moved. It is refit if the faces are
+		// unchanged and the structure supports it, otherwise it is rebuilt. The number of faces and
+		// vertices has to stay the same. Takes effect with the next call of commit().
+		void updateMesh(const unsigned int meshIndex, const bool facesChanged);
+
+		// Rebuilds the top level if instance bounds changed since the last commit. Bottom levels
+		// of unchanged meshes are reused as they are.
+		void commit();
+
+		inline size_t getInstanceCount() const
+		{
+			return this->instances.size();
+		}
+
+		inline const MeshInstance& getInstance(const uint32_t instance) const
+		{
+			return this->instances[instance];
+		}
+
+		inline size_t getBottomLevelCount() const
+		{
+			return this->bottomLevels.size();
+		}
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+		virtual const aiMatrix3x3* getNormalTransform(const uint32_t instance) const override;
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		TwoLevelAccelerationStructure(const aiScene* scene, SceneDatabase& database, const BottomLevelBuilder& bottomLevelBuilder) :
+			scene(scene),
+			database(database),
+			bottomLevelBuilder(bottomLevelBuilder),
+			bottomLevelOfMesh(scene->mNumMeshes, UINT32_MAX)
+		{};
+
+		// Appends the instances of the node and its children. Bottom levels are built the first
+		// time a mesh is referenced.
+		void collectInstances(const aiNode* node, const aiMatrix4x4& parentToWorld);
+
+		// Builds the structure over the triangles of the mesh, which counts its traversals into
+		// the statistics of this structure
+		AccelerationStructure* buildBottomLevel(const unsigned int meshIndex);
+
+		// Sets the transform of the instance and updates its world space bounds
+		void placeInstance(const uint32_t instance, const aiMatrix4x4& objectToWorld);
+
+		static aiRay toObjectSpace(const MeshInstance& instance, const aiRay& ray);
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		// Hierarchy over the world space bounds of the instances. Leaves reference instances.
+		std::unique_ptr<BoundingVolumeHierarchy> topLevel;
+
+		std::vector<MeshInstance> instances;
+
+		// World space bounds of every instance
+		std::vector<BoundingBox> instanceBounds;
+
+		// One structure per referenced mesh
+		std::vector<std::unique_ptr<AccelerationStructure>> bottomLevels;
+
+		// Object space bounds of every bottom level
+		std::vector<BoundingBox> bottomLevelBounds;
+
+		const aiScene* scene;
+
+		SceneDatabase& database;
+
+		BottomLevelBuilder bottomLevelBuilder;
+
+		// Bottom level of every mesh of the scene, UINT32_MAX for meshes without instances
+		std::vector<uint32_t> bottomLevelOfMesh;
+
+		// Set if instance bounds changed since the top level was built
+		bool topLevelOutdated{ false };
+
+	};
+
+} // end of namespace raytracer
\ No newline at end of file
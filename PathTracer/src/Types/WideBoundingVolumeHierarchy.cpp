@@ -0,0 +1,296 @@
+/*
+ * WideBoundingVolumeHierarchy.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+#include <memory>
+
+#include "WideBoundingVolumeHierarchy.hpp"
+#include "exceptions.hpp"
+
+/*--------------------------------< Defines >--------------------------------------------*/
+
+// Select the vector instructions matching the node width. Other combinations use the scalar loop.
+#if (WIDE_BVH_WIDTH == 8) && defined(__AVX__)
+#define WIDE_BVH_AVX 1
+#include <immintrin.h>
+#elif (WIDE_BVH_WIDTH == 4) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define WIDE_BVH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+
+namespace raytracing
+{
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	static_assert((WIDE_BVH_WIDTH == 4) || (WIDE_BVH_WIDTH == 8), "Wide BVH nodes hold either 4 or 8 children");
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	/*static*/ WideBoundingVolumeHierarchy* WideBoundingVolumeHierarchy::build(const std::vector<KdTriangle>& triangles)
+	{
+		std::unique_ptr<BoundingVolumeHierarchy> bvh(BoundingVolumeHierarchy::build(triangles));
+
+		std::unique_ptr<WideBoundingVolumeHierarchy> wideBvh(new WideBoundingVolumeHierarchy());
+		wideBvh->nodes.reserve(bvh->nodes.size() / (WideBvhNode::WIDTH - 1) + 1);
+		wideBvh->collapse(*bvh, 0);
+		wideBvh->nodes.shrink_to_fit();
+
+		// Leaves keep their triangle ranges, so the packets can be taken over as they are
+		wideBvh->trianglePackets = std::move(bvh->trianglePackets);
+		wideBvh->triangles = std::move(bvh->triangles);
+
+		return wideBvh.release();
+	}
+
+	bool WideBoundingVolumeHierarchy::calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection)
+	{
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		const bool intersects = intersectClosest(ray, *outIntersection,
+			[this](const uint32_t nodeIndex) -> const WideBvhNode&
+			{
+				return this->nodes[nodeIndex];
+			},
+			[this, &ray, outIntersection](const uint32_t packet, const uint32_t triangleCount)
+			{
+				return this->intersectTriangles(this->triangles, this->trianglePackets.data() + packet, triangleCount, ray, outIntersection);
+			},
+			&nodesVisited,
+			&trianglesTested);
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return intersects;
+	}
+
+	bool WideBoundingVolumeHierarchy::occluded(const aiRay& ray, const float tMax)
+	{
+		uint64_t nodesVisited{ 0 };
+		uint64_t trianglesTested{ 0 };
+		const bool occluded = intersectAny(ray, tMax,
+			[this](const uint32_t nodeIndex) -> const WideBvhNode&
+			{
+				return this->nodes[nodeIndex];
+			},
+			[this, &ray, tMax](const uint32_t packet, const uint32_t triangleCount)
+			{
+				return this->occludedTriangles(this->trianglePackets.data() + packet, triangleCount, ray, tMax);
+			},
+			&nodesVisited,
+			&trianglesTested);
+
+		this->recordTraversal(nodesVisited, trianglesTested);
+		return occluded;
+	}
+
+	bool WideBoundingVolumeHierarchy::refit()
+	{
+		// Children are always stored behind their parent
+		for (size_t nodeIndex = this->nodes.size(); nodeIndex-- > 0;)
+		{
+			WideBvhNode& node = this->nodes[nodeIndex];
+			for (uint32_t i = 0; i < WideBvhNode::WIDTH; i++)
+			{
+				if (node.child[i] == WideBvhNode::EMPTY)
+				{
+					continue;
+				}
+
+				BoundingBox bounds;
+				if (node.isLeaf(i))
+				{
+					bounds = refreshTrianglePackets(this->triangles, this->trianglePackets.data() + node.child[i], node.triangleCount[i]);
+				}
+				else
+				{
+					const WideBvhNode& child = this->nodes[node.child[i]];
+					for (uint32_t j = 0; j < WideBvhNode::WIDTH; j++)
+					{
+						if (child.child[j] != WideBvhNode::EMPTY)
+						{
+							bounds.extend(BoundingBox(
+								aiVector3D(child.minX[j], child.minY[j], child.minZ[j]),
+								aiVector3D(child.maxX[j], child.maxY[j], child.maxZ[j])));
+						}
+					}
+				}
+				node.minX[i] = bounds.getMin().x;
+				node.minY[i] = bounds.getMin().y;
+				node.minZ[i] = bounds.getMin().z;
+				node.maxX[i] = bounds.getMax().x;
+				node.maxY[i] = bounds.getMax().y;
+				node.maxZ[i] = bounds.getMax().z;
+			}
+		}
+		return true;
+	}
+
+	size_t WideBoundingVolumeHierarchy::getMemoryFootprint() const
+	{
+		return
+			sizeof(WideBoundingVolumeHierarchy) +
+			this->nodes.capacity() * sizeof(WideBvhNode) +
+			this->trianglePackets.capacity() * sizeof(TrianglePacket) +
+			this->triangles.capacity() * sizeof(KdTriangle);
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+	uint32_t WideBoundingVolumeHierarchy::collapse(const BoundingVolumeHierarchy& bvh, const uint32_t binaryIndex)
+	{
+		const uint32_t nodeIndex = static_cast<uint32_t>(this->nodes.size());
+		this->nodes.emplace_back();
+
+		uint32_t children[WideBvhNode::WIDTH];
+		const uint32_t childCount = selectChildren(bvh, binaryIndex, children);
+
+		// Collapse the interior children first. Appending nodes invalidates references
+		uint32_t wideChildren[WideBvhNode::WIDTH];
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			const BvhNode& binaryChild = bvh.nodes[children[i]];
+			wideChildren[i] = binaryChild.isLeaf() ? binaryChild.offset : this->collapse(bvh, children[i]);
+		}
+
+		WideBvhNode& node = this->nodes[nodeIndex];
+		for (uint32_t i = 0; i < WideBvhNode::WIDTH; i++)
+		{
+			if (i < childCount)
+			{
+				const BvhNode& binaryChild = bvh.nodes[children[i]];
+				node.minX[i] = binaryChild.min.x;
+				node.minY[i] = binaryChild.min.y;
+				node.minZ[i] = binaryChild.min.z;
+				node.maxX[i] = binaryChild.max.x;
+				node.maxY[i] = binaryChild.max.y;
+				node.maxZ[i] = binaryChild.max.z;
+				node.child[i] = wideChildren[i];
+				node.triangleCount[i] = binaryChild.triangleCount;
+			}
+			else
+			{
+				// Inverted box, rejected by the slab test for every ray direction
+				node.minX[i] = node.minY[i] = node.minZ[i] = std::numeric_limits<float>::infinity();
+				node.maxX[i] = node.maxY[i] = node.maxZ[i] = -std::numeric_limits<float>::infinity();
+				node.child[i] = WideBvhNode::EMPTY;
+				node.triangleCount[i] = 0;
+			}
+		}
+
+		return nodeIndex;
+	}
+
+	/*static*/ uint32_t WideBoundingVolumeHierarchy::selectChildren(const BoundingVolumeHierarchy& bvh, const uint32_t binaryIndex, uint32_t* outChildren)
+	{
+		// Open the interior node with the largest surface area until all slots are used
+		outChildren[0] = binaryIndex;
+		uint32_t childCount{ 1 };
+		while (childCount < WideBvhNode::WIDTH)
+		{
+			uint32_t largest{ WideBvhNode::EMPTY };
+			float largestArea{ -1.f };
+			for (uint32_t i = 0; i < childCount; i++)
+			{
+				const BvhNode& candidate = bvh.nodes[outChildren[i]];
+				if (candidate.isLeaf())
+				{
+					continue;
+				}
+				const float area = BoundingBox(candidate.min, candidate.max).getSurfaceArea();
+				if (area > largestArea)
+				{
+					largestArea = area;
+					largest = i;
+				}
+			}
+			if (largest == WideBvhNode::EMPTY)
+			{
+				break;
+			}
+
+			// The left child directly follows its parent in the binary layout
+			const uint32_t opened = outChildren[largest];
+			outChildren[largest] = opened + 1;
+			outChildren[childCount++] = bvh.nodes[opened].offset;
+		}
+		return childCount;
+	}
+
+	/*static*/ uint32_t WideBoundingVolumeHierarchy::intersectChildren(
+		const WideBvhNode& node,
+		const aiRay& ray,
+		const aiVector3D& inverseDirection,
+		const float tMax,
+		float* outEntryDistances)
+	{
+		// The near plane of a slab depends only on the sign of the direction. Using the inverse
+		// direction keeps the sign of negative zero components
+		const float* nearX = (inverseDirection.x < 0.f) ? node.maxX : node.minX;
+		const float* nearY = (inverseDirection.y < 0.f) ? node.maxY : node.minY;
+		const float* nearZ = (inverseDirection.z < 0.f) ? node.maxZ : node.minZ;
+		const float* farX = (inverseDirection.x < 0.f) ? node.minX : node.maxX;
+		const float* farY = (inverseDirection.y < 0.f) ? node.minY : node.maxY;
+		const float* farZ = (inverseDirection.z < 0.f) ? node.minZ : node.maxZ;
+
+#if WIDE_BVH_AVX
+		const __m256 originX = _mm256_set1_ps(ray.pos.x);
+		const __m256 originY = _mm256_set1_ps(ray.pos.y);
+		const __m256 originZ = _mm256_set1_ps(ray.pos.z);
+		const __m256 inverseX = _mm256_set1_ps(inverseDirection.x);
+		const __m256 inverseY = _mm256_set1_ps(inverseDirection.y);
+		const __m256 inverseZ = _mm256_set1_ps(inverseDirection.z);
+
+		const __m256 tNearX = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearX), originX), inverseX);
+		const __m256 tNearY = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearY), originY), inverseY);
+		const __m256 tNearZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearZ), originZ), inverseZ);
+		const __m256 tFarX = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farX), originX), inverseX);
+		const __m256 tFarY = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farY), originY), inverseY);
+		const __m256 tFarZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farZ), originZ), inverseZ);
+
+		const __m256 tEntry = _mm256_max_ps(_mm256_max_ps(tNearX, tNearY), _mm256_max_ps(tNearZ, _mm256_setzero_ps()));
+		const __m256 tExit = _mm256_min_ps(_mm256_min_ps(tFarX, tFarY), _mm256_min_ps(tFarZ, _mm256_set1_ps(tMax)));
+
+		_mm256_store_ps(outEntryDistances, tEntry);
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tEntry, tExit, _CMP_LE_OQ)));
+#elif WIDE_BVH_SSE
+		const __m128 originX = _mm_set1_ps(ray.pos.x);
+		const __m128 originY = _mm_set1_ps(ray.pos.y);
+		const __m128 originZ = _mm_set1_ps(ray.pos.z);
+		const __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+		const __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+		const __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+
+		const __m128 tNearX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearX), originX), inverseX);
+		const __m128 tNearY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearY), originY), inverseY);
+		const __m128 tNearZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearZ), originZ), inverseZ);
+		const __m128 tFarX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farX), originX), inverseX);
+		const __m128 tFarY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farY), originY), inverseY);
+		const __m128 tFarZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farZ), originZ), inverseZ);
+
+		const __m128 tEntry = _mm_max_ps(_mm_max_ps(tNearX, tNearY), _mm_max_ps(tNearZ, _mm_setzero_ps()));
+		const __m128 tExit = _mm_min_ps(_mm_min_ps(tFarX, tFarY), _mm_min_ps(tFarZ, _mm_set1_ps(tMax)));
+
+		_mm_store_ps(outEntryDistances, tEntry);
+		return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tEntry, tExit)));
+#else
+		uint32_t hitMask{ 0 };
+		for (uint32_t i = 0; i < WideBvhNode::WIDTH; i++)
+		{
+			const float tEntry = std::max(std::max((nearX[i] - ray.pos.x) * inverseDirection.x, (nearY[i] - ray.pos.y) * inverseDirection.y),
+				std::max((nearZ[i] - ray.pos.z) * inverseDirection.z, 0.f));
+			const float tExit = std::min(std::min((farX[i] - ray.pos.x) * inverseDirection.x, (farY[i] - ray.pos.y) * inverseDirection.y),
+				std::min((farZ[i] - ray.pos.z) * inverseDirection.z, tMax));
+			outEntryDistances[i] = tEntry;
+			hitMask |= (tEntry <= tExit) ? (1U << i) : 0U;
+		}
+		return hitMask;
+#endif
+	}
+
+} // end of namespace raytracer
\ No newline at end of file
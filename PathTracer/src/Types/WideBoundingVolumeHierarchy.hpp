@@ -0,0 +1,268 @@
+/*
+ * WideBoundingVolumeHierarchy.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <vector>
+
+#include "assimp/types.h"
+#include "assimp/mesh.h"
+
+#include "raytracing.hpp"
+#include "settings.hpp"
+#include "AccelerationStructure.hpp"
+#include "BoundingVolumeHierarchy.hpp"
+#include "Utility/AlignedAllocator.hpp"
+
+namespace raytracing
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	// Node of the wide hierarchy. The bounds of all children are stored as structure of arrays
+	// to test a ray against every child with one sequence of vector instructions. Unused child
+	// slots hold an empty box which is never hit.
+	struct alignas(32) WideBvhNode
+	{
+		static constexpr uint32_t WIDTH = WIDE_BVH_WIDTH;
+
+		// Marks an unused child slot
+		static constexpr uint32_t EMPTY = UINT32_MAX;
+
+		inline bool isLeaf(const uint32_t child) const
+		{
+			return this->triangleCount[child] > 0;
+		}
+
+		float minX[WIDTH];
+
+		float minY[WIDTH];
+
+		float minZ[WIDTH];
+
+		float maxX[WIDTH];
+
+		float maxY[WIDTH];
+
+		float maxZ[WIDTH];
+
+		// Index of the child node, or first triangle packet for leaves
+		uint32_t child[WIDTH];
+
+		// Number of triangles of leaf children, zero for interior children
+		uint32_t triangleCount[WIDTH];
+	};
+
+	// Child postponed during traversal together with the distance it is entered at
+	struct WideBvhStackEntry
+	{
+		uint32_t child;
+		uint32_t triangleCount;
+		float tEntry;
+	};
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Bounding volume hierarchy with WIDE_BVH_WIDTH children per node. Built by collapsing
+	// the binary binned SAH hierarchy, so it shares its build speed and triangle references.
+	class WideBoundingVolumeHierarchy : public AccelerationStructure
+	{
+
+	// Collapses the binary hierarchy the same way and traverses its decoded nodes with the same loops
+	friend class CompressedBoundingVolumeHierarchy;
+
+	// Every node on the way to a leaf pushes at most all but one of its children
+	static constexpr uint32_t MAX_STACK_SIZE = BoundingVolumeHierarchy::MAX_DEPTH * (WideBvhNode::WIDTH - 1) + 1;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		static WideBoundingVolumeHierarchy* build(const std::vector<KdTriangle>& triangles);
+
+		virtual bool calculateIntersection(const aiRay& ray, IntersectionInformation* outIntersection) override;
+
+		virtual bool occluded(const aiRay& ray, const float tMax) override;
+
+		virtual size_t getMemoryFootprint() const override;
+
+		// Recomputes all bounds bottom up. The tree quality degrades with large deformations.
+		virtual bool refit() override;
+
+		inline size_t getNodeCount() const
+		{
+			return this->nodes.size();
+		}
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+		WideBoundingVolumeHierarchy() = default;
+
+		// Appends a wide node holding the binary subtree below binaryIndex and collapses its
+		// children recursively
+		uint32_t collapse(const BoundingVolumeHierarchy& bvh, const uint32_t binaryIndex);
+
+		// Cuts the binary subtree below binaryIndex off at the WIDTH nodes with the largest surface
+		// area, which become the children of a wide node. Returns the number of children.
+		static uint32_t selectChildren(const BoundingVolumeHierarchy& bvh, const uint32_t binaryIndex, uint32_t* outChildren);
+
+		// Closest hit traversal of a wide hierarchy. fetchNode(index) returns the node to test,
+		// intersectLeaf(packet, triangleCount) tests the triangles of a leaf and updates the
+		// intersection, which limits the rest of the traversal. Returns true if a leaf was hit.
+		template<typename NodeFetch, typename LeafIntersect>
+		static bool intersectClosest(
+			const aiRay& ray,
+			const IntersectionInformation& intersection,
+			NodeFetch&& fetchNode,
+			LeafIntersect&& intersectLeaf,
+			uint64_t* outNodesVisited,
+			uint64_t* outTrianglesTested)
+		{
+			// Hit distances are measured in world space, the traversal works with the ray parameter
+			const float directionLength = ray.dir.Length();
+			const aiVector3D inverseDirection(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+			WideBvhStackEntry stack[MAX_STACK_SIZE];
+			uint32_t stackSize{ 0 };
+			bool intersects{ false };
+
+			alignas(32) float entryDistances[WideBvhNode::WIDTH];
+			stack[stackSize++] = { 0, 0, 0.f };
+
+			while (stackSize > 0)
+			{
+				const WideBvhStackEntry entry = stack[--stackSize];
+				const float tMax = intersection.intersectionDistance / directionLength;
+				if (entry.tEntry > tMax)
+				{
+					// Entered behind the closest hit found since it was pushed
+					continue;
+				}
+
+				if (entry.triangleCount > 0)
+				{
+					*outTrianglesTested += entry.triangleCount;
+					if (intersectLeaf(entry.child, entry.triangleCount))
+					{
+						intersects = true;
+					}
+					continue;
+				}
+
+				const WideBvhNode& node = fetchNode(entry.child);
+				(*outNodesVisited)++;
+
+				uint32_t hitMask = intersectChildren(node, ray, inverseDirection, tMax, entryDistances);
+
+				// Push the hit children ordered far to near, so the nearest one is visited next
+				const uint32_t firstPushed = stackSize;
+				while (hitMask != 0)
+				{
+					uint32_t child{ 0 };
+					while ((hitMask & (1U << child)) == 0)
+					{
+						child++;
+					}
+					hitMask &= ~(1U << child);
+
+					const WideBvhStackEntry childEntry = { node.child[child], node.triangleCount[child], entryDistances[child] };
+					uint32_t position = stackSize++;
+					while ((position > firstPushed) && (stack[position - 1].tEntry < childEntry.tEntry))
+					{
+						stack[position] = stack[position - 1];
+						position--;
+					}
+					stack[position] = childEntry;
+				}
+			}
+			return intersects;
+		}
+
+		// Any-hit traversal of a wide hierarchy. occludedLeaf(packet, triangleCount) returns true
+		// if a triangle of the leaf blocks the ray, which ends the traversal.
+		template<typename NodeFetch, typename LeafOcclusion>
+		static bool intersectAny(
+			const aiRay& ray,
+			const float tMax,
+			NodeFetch&& fetchNode,
+			LeafOcclusion&& occludedLeaf,
+			uint64_t* outNodesVisited,
+			uint64_t* outTrianglesTested)
+		{
+			const aiVector3D inverseDirection(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+			WideBvhStackEntry stack[MAX_STACK_SIZE];
+			uint32_t stackSize{ 0 };
+
+			alignas(32) float entryDistances[WideBvhNode::WIDTH];
+			stack[stackSize++] = { 0, 0, 0.f };
+
+			while (stackSize > 0)
+			{
+				const WideBvhStackEntry entry = stack[--stackSize];
+				if (entry.triangleCount > 0)
+				{
+					*outTrianglesTested += entry.triangleCount;
+					if (occludedLeaf(entry.child, entry.triangleCount))
+					{
+						return true;
+					}
+					continue;
+				}
+
+				const WideBvhNode& node = fetchNode(entry.child);
+				(*outNodesVisited)++;
+
+				// The segment never shrinks, so the order of the children does not matter
+				uint32_t hitMask = intersectChildren(node, ray, inverseDirection, tMax, entryDistances);
+				while (hitMask != 0)
+				{
+					uint32_t slot{ 0 };
+					while ((hitMask & (1U << slot)) == 0)
+					{
+						slot++;
+					}
+					hitMask &= ~(1U << slot);
+
+					stack[stackSize++] = { node.child[slot], node.triangleCount[slot], entryDistances[slot] };
+				}
+			}
+			return false;
+		}
+
+		// Tests the ray against all children of a node. Returns a bit mask of the children hit
+		// within [0, tMax] and their entry distances.
+		static uint32_t intersectChildren(
+			const WideBvhNode& node,
+			const aiRay& ray,
+			const aiVector3D& inverseDirection,
+			const float tMax,
+			float* outEntryDistances);
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		// All nodes in depth first order, starting with the root node
+		std::vector<WideBvhNode, utility::AlignedAllocator<WideBvhNode>> nodes;
+
+		// Packed triangles, stored consecutively for every leaf
+		TrianglePacketArray trianglePackets;
+
+		// Every triangle of the scene exactly once
+		std::vector<KdTriangle> triangles;
+
+	};
+
+} // end of namespace raytracer
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * AlignedAllocator.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <cstddef>
+#include <new>
+
+namespace utility
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	constexpr std::size_t CACHE_LINE_SIZE{ 64 };
+
+	// Allocator for standard containers which places the first element on an aligned address.
+	// Used to start contiguous acceleration structure arrays on a cache line boundary.
+	template <typename T, std::size_t Alignment = CACHE_LINE_SIZE>
+	class AlignedAllocator
+	{
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		using value_type = T;
+
+		template <typename U>
+		struct rebind
+		{
+			using other = AlignedAllocator<U, Alignment>;
+		};
+
+		AlignedAllocator() noexcept = default;
+
+		template <typename U>
+		AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+		{};
+
+		T* allocate(std::size_t count)
+		{
+			return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+		}
+
+		void deallocate(T* pointer, std::size_t) noexcept
+		{
+			::operator delete(pointer, std::align_val_t(Alignment));
+		}
+
+		template <typename U>
+		bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept
+		{
+			return true;
+		}
+
+		template <typename U>
+		bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept
+		{
+			return false;
+		}
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+	};
+
+} // end of namespace utility
\ No newline at end of file
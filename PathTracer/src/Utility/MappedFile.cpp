@@ -0,0 +1,138 @@
+/*
+ * MappedFile.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.hpp"
+
+
+namespace utility
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	MappedFile::~MappedFile()
+	{
+		this->unmap();
+	}
+
+#ifdef _WIN32
+	bool MappedFile::map(const std::string& path)
+	{
+		this->unmap();
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		this->file = file;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0))
+		{
+			this->unmap();
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			this->unmap();
+			return false;
+		}
+		this->mapping = mapping;
+
+		const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view)
+		{
+			this->unmap();
+			return false;
+		}
+		this->data = static_cast<const uint8_t*>(view);
+		this->size = static_cast<size_t>(fileSize.QuadPart);
+		return true;
+	}
+
+	void MappedFile::unmap()
+	{
+		if (this->data)
+		{
+			UnmapViewOfFile(this->data);
+		}
+		if (this->mapping)
+		{
+			CloseHandle(this->mapping);
+		}
+		if (this->file)
+		{
+			CloseHandle(this->file);
+		}
+		this->data = nullptr;
+		this->size = 0;
+		this->mapping = nullptr;
+		this->file = nullptr;
+	}
+#else
+	bool MappedFile::map(const std::string& path)
+	{
+		this->unmap();
+
+		const int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat fileStatus;
+		if ((fstat(file, &fileStatus) != 0) || (fileStatus.st_size == 0))
+		{
+			close(file);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		// The mapping keeps its own reference to the file
+		close(file);
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+		this->data = static_cast<const uint8_t*>(view);
+		this->size = static_cast<size_t>(fileStatus.st_size);
+		return true;
+	}
+
+	void MappedFile::unmap()
+	{
+		if (this->data)
+		{
+			munmap(const_cast<uint8_t*>(this->data), this->size);
+		}
+		this->data = nullptr;
+		this->size = 0;
+	}
+#endif
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+} // end of namespace utility
\ No newline at end of file
@@ -0,0 +1,78 @@
+/*
+ * MappedFile.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace utility
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Read-only memory mapping of a whole file. The mapping starts on a page boundary and stays
+	// valid until the object is destroyed.
+	class MappedFile
+	{
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		MappedFile() = default;
+
+		MappedFile(const MappedFile&) = delete;
+
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile();
+
+		// Maps the file. Returns false if it does not exist or cannot be mapped.
+		bool map(const std::string& path);
+
+		void unmap();
+
+		inline const uint8_t* getData() const
+		{
+			return this->data;
+		}
+
+		inline size_t getSize() const
+		{
+			return this->size;
+		}
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		const uint8_t* data{ nullptr };
+
+		size_t size{ 0 };
+
+#ifdef _WIN32
+		// Handles of the file and its mapping object
+		void* file{ nullptr };
+
+		void* mapping{ nullptr };
+#endif
+
+	};
+
+} // end of namespace utility
\ No newline at end of file
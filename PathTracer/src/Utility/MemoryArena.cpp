@@ -0,0 +1,58 @@
+/*
+ * MemoryArena.cpp
+ */
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <algorithm>
+
+#include "MemoryArena.hpp"
+
+
+namespace utility
+{
+	/*--------------------------------< Defines >--------------------------------------------*/
+
+	/*--------------------------------< Typedefs >-------------------------------------------*/
+
+	/*--------------------------------< Constants >------------------------------------------*/
+
+	/*--------------------------------< Public members >-------------------------------------*/
+
+	void* MemoryArena::allocate(const std::size_t size, const std::size_t alignment/* = alignof(std::max_align_t)*/)
+	{
+		std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(this->current) % alignment) % alignment;
+		if (padding + size > this->remaining)
+		{
+			// Oversized requests get a block of their own
+			const std::size_t blockSize = std::max(BLOCK_SIZE, size + alignment);
+			this->blocks.emplace_back(new uint8_t[blockSize]);
+			this->reservedBytes += blockSize;
+			this->current = this->blocks.back().get();
+			this->remaining = blockSize;
+			padding = (alignment - reinterpret_cast<std::uintptr_t>(this->current) % alignment) % alignment;
+		}
+
+		uint8_t* memory = this->current + padding;
+		this->current = memory + size;
+		this->remaining -= padding + size;
+		return memory;
+	}
+
+	void MemoryArena::release()
+	{
+		this->blocks.clear();
+		this->reservedBytes = 0;
+		this->current = nullptr;
+		this->remaining = 0;
+	}
+
+	std::size_t MemoryArena::getReservedBytes() const
+	{
+		return this->reservedBytes;
+	}
+
+	/*--------------------------------< Protected members >----------------------------------*/
+
+	/*--------------------------------< Private members >------------------------------------*/
+
+} // end of namespace utility
\ No newline at end of file
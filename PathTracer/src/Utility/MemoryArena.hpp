@@ -0,0 +1,92 @@
+/*
+ * MemoryArena.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace utility
+{
+	/*--------------------------------< Defines >-------------------------------------------*/
+
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	// Hands out memory from large blocks and releases all of it at once. Objects are never
+	// destroyed individually, so only trivially destructible types may be placed in the arena.
+	// Allocation only bumps a pointer and is not synchronized, so every thread needs an arena of
+	// its own. Aligned to keep the arenas of different threads off each other's cache lines.
+	class alignas(64) MemoryArena
+	{
+
+	static constexpr std::size_t BLOCK_SIZE = 1 << 20;
+
+	/*--------------------------------< Public methods >------------------------------------*/
+	public:
+
+		MemoryArena() = default;
+
+		MemoryArena(const MemoryArena&) = delete;
+
+		MemoryArena& operator=(const MemoryArena&) = delete;
+
+		// Returns uninitialized memory valid until the arena is released or destroyed
+		void* allocate(const std::size_t size, const std::size_t alignment = alignof(std::max_align_t));
+
+		template <typename T, typename... Args>
+		T* create(Args&&... args)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+			return new (this->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		// Uninitialized array of count elements
+		template <typename T>
+		T* createArray(const std::size_t count)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+			return static_cast<T*>(this->allocate(count * sizeof(T), alignof(T)));
+		}
+
+		// Frees all blocks. Every pointer handed out before becomes invalid
+		void release();
+
+		// Bytes of all blocks, including unused space at their ends
+		std::size_t getReservedBytes() const;
+
+	/*--------------------------------< Protected methods >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private methods >-----------------------------------*/
+	private:
+
+	/*--------------------------------< Public members >------------------------------------*/
+	public:
+
+	/*--------------------------------< Protected members >---------------------------------*/
+	protected:
+
+	/*--------------------------------< Private members >-----------------------------------*/
+	private:
+
+		std::vector<std::unique_ptr<uint8_t[]>> blocks;
+
+		std::size_t reservedBytes{ 0 };
+
+		// Free part of the last block
+		uint8_t* current{ nullptr };
+
+		std::size_t remaining{ 0 };
+
+	};
+
+} // end of namespace utility
\ No newline at end of file
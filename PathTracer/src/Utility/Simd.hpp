@@ -0,0 +1,154 @@
+/*
+ * Simd.hpp
+ */
+
+#pragma once
+
+/*--------------------------------< Includes >-------------------------------------------*/
+#include <cstdint>
+
+#include "settings.hpp"
+
+/*--------------------------------< Defines >-------------------------------------------*/
+
+// Select the vector instructions matching the packet width. Other combinations use scalar loops.
+#if (TRIANGLE_PACKET_WIDTH == 16) && defined(__AVX512F__)
+#define SIMD_AVX512 1
+#include <immintrin.h>
+#elif (TRIANGLE_PACKET_WIDTH == 8) && defined(__AVX__)
+#define SIMD_AVX 1
+#include <immintrin.h>
+#elif (TRIANGLE_PACKET_WIDTH == 4) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define SIMD_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace utility
+{
+	/*--------------------------------< Typedefs >------------------------------------------*/
+
+	/*--------------------------------< Constants >-----------------------------------------*/
+
+	static_assert((TRIANGLE_PACKET_WIDTH == 4) || (TRIANGLE_PACKET_WIDTH == 8) || (TRIANGLE_PACKET_WIDTH == 16),
+		"Triangle packets hold 4, 8 or 16 triangles");
+
+	// TRIANGLE_PACKET_WIDTH floats processed by one instruction. Comparisons return a bit mask
+	// with one bit per lane, so masks are combined with plain integer operations.
+	struct SimdFloat
+	{
+		static constexpr uint32_t WIDTH = TRIANGLE_PACKET_WIDTH;
+
+		static constexpr uint32_t ALL_LANES = (1U << WIDTH) - 1;
+
+#if SIMD_AVX512
+		__m512 value;
+
+		static inline SimdFloat load(const float* aligned) { return { _mm512_load_ps(aligned) }; }
+		static inline SimdFloat broadcast(const float scalar) { return { _mm512_set1_ps(scalar) }; }
+		inline void store(float* aligned) const { _mm512_store_ps(aligned, this->value); }
+
+		inline SimdFloat operator+(const SimdFloat& other) const { return { _mm512_add_ps(this->value, other.value) }; }
+		inline SimdFloat operator-(const SimdFloat& other) const { return { _mm512_sub_ps(this->value, other.value) }; }
+		inline SimdFloat operator*(const SimdFloat& other) const { return { _mm512_mul_ps(this->value, other.value) }; }
+		inline SimdFloat operator/(const SimdFloat& other) const { return { _mm512_div_ps(this->value, other.value) }; }
+
+		static inline SimdFloat min(const SimdFloat& a, const SimdFloat& b) { return { _mm512_min_ps(a.value, b.value) }; }
+		static inline SimdFloat max(const SimdFloat& a, const SimdFloat& b) { return { _mm512_max_ps(a.value, b.value) }; }
+
+		inline uint32_t operator<(const SimdFloat& other) const { return _mm512_cmp_ps_mask(this->value, other.value, _CMP_LT_OQ); }
+		inline uint32_t operator>(const SimdFloat& other) const { return _mm512_cmp_ps_mask(this->value, other.value, _CMP_GT_OQ); }
+		inline uint32_t operator<=(const SimdFloat& other) const { return _mm512_cmp_ps_mask(this->value, other.value, _CMP_LE_OQ); }
+		inline uint32_t operator>=(const SimdFloat& other) const { return _mm512_cmp_ps_mask(this->value, other.value, _CMP_GE_OQ); }
+#elif SIMD_AVX
+		__m256 value;
+
+		static inline SimdFloat load(const float* aligned) { return { _mm256_load_ps(aligned) }; }
+		static inline SimdFloat broadcast(const float scalar) { return { _mm256_set1_ps(scalar) }; }
+		inline void store(float* aligned) const { _mm256_store_ps(aligned, this->value); }
+
+		inline SimdFloat operator+(const SimdFloat& other) const { return { _mm256_add_ps(this->value, other.value) }; }
+		inline SimdFloat operator-(const SimdFloat& other) const { return { _mm256_sub_ps(this->value, other.value) }; }
+		inline SimdFloat operator*(const SimdFloat& other) const { return { _mm256_mul_ps(this->value, other.value) }; }
+		inline SimdFloat operator/(const SimdFloat& other) const { return { _mm256_div_ps(this->value, other.value) }; }
+
+		static inline SimdFloat min(const SimdFloat& a, const SimdFloat& b) { return { _mm256_min_ps(a.value, b.value) }; }
+		static inline SimdFloat max(const SimdFloat& a, const SimdFloat& b) { return { _mm256_max_ps(a.value, b.value) }; }
+
+		inline uint32_t operator<(const SimdFloat& other) const { return _mm256_movemask_ps(_mm256_cmp_ps(this->value, other.value, _CMP_LT_OQ)); }
+		inline uint32_t operator>(const SimdFloat& other) const { return _mm256_movemask_ps(_mm256_cmp_ps(this->value, other.value, _CMP_GT_OQ)); }
+		inline uint32_t operator<=(const SimdFloat& other) const { return _mm256_movemask_ps(_mm256_cmp_ps(this->value, other.value, _CMP_LE_OQ)); }
+		inline uint32_t operator>=(const SimdFloat& other) const { return _mm256_movemask_ps(_mm256_cmp_ps(this->value, other.value, _CMP_GE_OQ)); }
+#elif SIMD_SSE
+		__m128 value;
+
+		static inline SimdFloat load(const float* aligned) { return { _mm_load_ps(aligned) }; }
+		static inline SimdFloat broadcast(const float scalar) { return { _mm_set1_ps(scalar) }; }
+		inline void store(float* aligned) const { _mm_store_ps(aligned, this->value); }
+
+		inline SimdFloat operator+(const SimdFloat& other) const { return { _mm_add_ps(this->value, other.value) }; }
+		inline SimdFloat operator-(const SimdFloat& other) const { return { _mm_sub_ps(this->value, other.value) }; }
+		inline SimdFloat operator*(const SimdFloat& other) const { return { _mm_mul_ps(this->value, other.value) }; }
+		inline SimdFloat operator/(const SimdFloat& other) const { return { _mm_div_ps(this->value, other.value) }; }
+
+		static inline SimdFloat min(const SimdFloat& a, const SimdFloat& b) { return { _mm_min_ps(a.value, b.value) }; }
+		static inline SimdFloat max(const SimdFloat& a, const SimdFloat& b) { return { _mm_max_ps(a.value, b.value) }; }
+
+		inline uint32_t operator<(const SimdFloat& other) const { return _mm_movemask_ps(_mm_cmplt_ps(this->value, other.value)); }
+		inline uint32_t operator>(const SimdFloat& other) const { return _mm_movemask_ps(_mm_cmpgt_ps(this->value, other.value)); }
+		inline uint32_t operator<=(const SimdFloat& other) const { return _mm_movemask_ps(_mm_cmple_ps(this->value, other.value)); }
+		inline uint32_t operator>=(const SimdFloat& other) const { return _mm_movemask_ps(_mm_cmpge_ps(this->value, other.value)); }
+#else
+		float value[WIDTH];
+
+		static inline SimdFloat load(const float* aligned)
+		{
+			SimdFloat result;
+			for (uint32_t i = 0; i < WIDTH; i++) { result.value[i] = aligned[i]; }
+			return result;
+		}
+
+		static inline SimdFloat broadcast(const float scalar)
+		{
+			SimdFloat result;
+			for (uint32_t i = 0; i < WIDTH; i++) { result.value[i] = scalar; }
+			return result;
+		}
+
+		inline void store(float* aligned) const
+		{
+			for (uint32_t i = 0; i < WIDTH; i++) { aligned[i] = this->value[i]; }
+		}
+
+		inline SimdFloat operator+(const SimdFloat& other) const { return apply(other, [](float a, float b) { return a + b; }); }
+		inline SimdFloat operator-(const SimdFloat& other) const { return apply(other, [](float a, float b) { return a - b; }); }
+		inline SimdFloat operator*(const SimdFloat& other) const { return apply(other, [](float a, float b) { return a * b; }); }
+		inline SimdFloat operator/(const SimdFloat& other) const { return apply(other, [](float a, float b) { return a / b; }); }
+
+		// Same operand order as the vector instructions: the second operand is returned for NaNs
+		static inline SimdFloat min(const SimdFloat& a, const SimdFloat& b) { return a.apply(b, [](float x, float y) { return x < y ? x : y; }); }
+		static inline SimdFloat max(const SimdFloat& a, const SimdFloat& b) { return a.apply(b, [](float x, float y) { return x > y ? x : y; }); }
+
+		inline uint32_t operator<(const SimdFloat& other) const { return compare(other, [](float a, float b) { return a < b; }); }
+		inline uint32_t operator>(const SimdFloat& other) const { return compare(other, [](float a, float b) { return a > b; }); }
+		inline uint32_t operator<=(const SimdFloat& other) const { return compare(other, [](float a, float b) { return a <= b; }); }
+		inline uint32_t operator>=(const SimdFloat& other) const { return compare(other, [](float a, float b) { return a >= b; }); }
+
+		template <typename Operation>
+		inline SimdFloat apply(const SimdFloat& other, Operation operation) const
+		{
+			SimdFloat result;
+			for (uint32_t i = 0; i < WIDTH; i++) { result.value[i] = operation(this->value[i], other.value[i]); }
+			return result;
+		}
+
+		template <typename Comparison>
+		inline uint32_t compare(const SimdFloat& other, Comparison comparison) const
+		{
+			uint32_t mask{ 0 };
+			for (uint32_t i = 0; i < WIDTH; i++) { mask |= comparison(this->value[i], other.value[i]) ? (1U << i) : 0U; }
+			return mask;
+		}
+#endif
+	};
+
+} // end of namespace utility
\ No newline at end of file
@@ -206,16 +206,6 @@ namespace utility
 		}
 	}
 
-	aiVector3D mathUtility::calculateSmoothNormal(aiVector2D& uv, std::vector<aiVector3D*>& vertexNormals)
-	{
-		aiVector3D smoothNormal = 
-			(1 - uv.x - uv.y) *
-			*(vertexNormals[0]) + uv.x *
-			*(vertexNormals[1]) + uv.y *
-			*(vertexNormals[2]);
-		return smoothNormal.Normalize();
-	}
-
 	void mathUtility::gammaCorrectSrgb(aiColor3D* color)
 	{
 		color->r = sRgb(color->r);
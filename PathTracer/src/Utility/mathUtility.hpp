@@ -70,8 +70,6 @@ namespace utility
 			aiVector3D* outIntersectionPoint,
 			aiVector2D* outUV);
 
-		static aiVector3D calculateSmoothNormal(aiVector2D& uv, std::vector<aiVector3D*>& vertexNormals);
-
 		static void gammaCorrectSrgb(aiColor3D* color);
 		
 		static void gammaCorrectAdobeRgb(aiColor3D* color);
@@ -19,7 +19,12 @@
 #include "PathTracer.hpp"
 #include "Timer.hpp"
 #include "Types/BoundingVolume.hpp"
-#include "Types/KdNode.hpp"
+#include "Types/BoundingVolumeHierarchy.hpp"
+#include "Types/CompressedBoundingVolumeHierarchy.hpp"
+#include "Types/KdTree.hpp"
+#include "Types/SceneDatabase.hpp"
+#include "Types/TwoLevelAccelerationStructure.hpp"
+#include "Types/WideBoundingVolumeHierarchy.hpp"
 #include "Utility/ArgParser.hpp"
 
 namespace filesystem = std::filesystem;
@@ -43,7 +48,15 @@ int main(int argc, char* argv[])
 			"[--aperture <aperture as float>] "
 			"[--focal <focal distance as float>] "
 			"[--use-anti-aliasing <randomly distribute samples for MSAA>] "
-			"[--threading <number of threads for rendering>] " << std::endl;
+			"[--threading <number of threads for rendering>] "
+			"[--acceleration <kdtree|bvh|sbvh|wbvh|cbvh|bv>] "
+			"[--duplication-budget <additional sbvh references per triangle as float>] "
+			"[--no-cache <always rebuild the kd-tree>] "
+			"[--lazy-build <build kd-tree subtrees when the first ray reaches them>] "
+			"[--instancing <build one structure per mesh and place it by the scene graph>] "
+			"[--ray-sorting <trace the bounces of a tile together, sorted by origin and direction>] "
+			"[--tile-order <scanline|morton|hilbert|spiral>] "
+			"[--stats-json <file to write the kd-tree report to>] " << std::endl;
 		return 0;
 	}
 
@@ -184,8 +197,119 @@ int main(int argc, char* argv[])
 	{
 		threadCount = static_cast<uint8_t>(std::stoi(threadsStr));
 	}
+	if (threadCount == 0)
+	{
+		SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "At least one render thread is needed. Proceeding with 1..");
+		threadCount = 1;
+	}
+
+	std::string acceleration{ "kdtree" };
+	const std::string& accelerationStr(options.getCmdOption("--acceleration"));
+	if (accelerationStr.empty())
+	{
+		// Kd-tree is the default acceleration structure
+	}
+	else if ((accelerationStr == "kdtree") || (accelerationStr == "bvh") || (accelerationStr == "sbvh") || (accelerationStr == "wbvh") || (accelerationStr == "cbvh") || (accelerationStr == "bv"))
+	{
+		acceleration = accelerationStr;
+	}
+	else
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown acceleration structure %s. Use kdtree, bvh, sbvh, wbvh, cbvh or bv. Exiting..", accelerationStr.c_str());
+		return 1;
+	}
+
+	float duplicationBudget{ 0.3f };
+	const std::string& duplicationBudgetStr(options.getCmdOption("--duplication-budget"));
+	if (duplicationBudgetStr.empty())
+	{
+		// No duplication budget provided
+	}
+	else
+	{
+		duplicationBudget = std::stof(duplicationBudgetStr);
+	}
+
+	bool useCache{ true };
+	if (options.cmdOptionExists("--no-cache"))
+	{
+		// Always rebuild the kd-tree and leave existing caches untouched
+		useCache = false;
+	}
+
+	bool useInstancing{ false };
+	if (options.cmdOptionExists("--instancing"))
+	{
+		// Share the structure of meshes referenced by several nodes
+		useInstancing = true;
+	}
+
+	bool useLazyBuild{ false };
+	if (!options.cmdOptionExists("--lazy-build"))
+	{
+		// The whole tree is built before rendering
+	}
+	else if ((acceleration != "kdtree") || useInstancing)
+	{
+		SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Lazy building is only available for a single kd-tree. Proceeding without..");
+	}
+	else
+	{
+		// Partially built trees are not cached
+		useLazyBuild = true;
+		useCache = false;
+	}
+
+	bool useRaySorting{ false };
+	if (options.cmdOptionExists("--ray-sorting"))
+	{
+#if PATH_TRACE
+		useRaySorting = true;
+#else
+		SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Ray sorting requires PATH_TRACE. Proceeding without..");
+#endif
+	}
+
+	raytracing::TileOrder tileOrder{ raytracing::TileOrder::SCANLINE };
+	const std::string& tileOrderStr(options.getCmdOption("--tile-order"));
+	if (tileOrderStr.empty() || (tileOrderStr == "scanline"))
+	{
+		// Tiles are rendered row by row
+	}
+	else if (tileOrderStr == "morton")
+	{
+		tileOrder = raytracing::TileOrder::MORTON;
+	}
+	else if (tileOrderStr == "hilbert")
+	{
+		tileOrder = raytracing::TileOrder::HILBERT;
+	}
+	else if (tileOrderStr == "spiral")
+	{
+		tileOrder = raytracing::TileOrder::SPIRAL;
+	}
+	else
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown tile order %s. Use scanline, morton, hilbert or spiral. Exiting..", tileOrderStr.c_str());
+		return 1;
+	}
+
+	std::string statsPath;
+	const std::string& statsPathStr(options.getCmdOption("--stats-json"));
+	if (statsPathStr.empty())
+	{
+		// The report is only logged
+	}
+	else if ((acceleration != "kdtree") || useInstancing)
+	{
+		SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "The tree report is only available for a single kd-tree. Proceeding without..");
+	}
+	else
+	{
+		statsPath = statsPathStr;
+	}
 
-	raytracing::Settings renderSettings(width, height, samples, depth, bias, aperture, fDist, useDOF, useAA);
+	raytracing::Settings renderSettings(width, height, samples, depth, bias, aperture, fDist, useDOF, useAA, useRaySorting, tileOrder);
 	raytracing::Application app(renderSettings);
 
 	try
@@ -284,45 +408,176 @@ int main(int argc, char* argv[])
 	}
 #endif
 
+	// Geometry, lights and cameras are read from the database while rendering
+	raytracing::SceneDatabase database(scene);
+	SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Scene database holds %u triangles using %.2f MiB",
+		database.getTriangleCount(),
+		database.getMemoryFootprint() / (1024. * 1024.));
+
 	// Create Kd-Tree
-	std::vector<raytracing::KdTriangle> triangleMeshCollection;
-	for (unsigned int currentMesh = 0; currentMesh < scene->mNumMeshes; currentMesh++)
+	std::vector<raytracing::KdTriangle> triangleMeshCollection = database.getTriangles();
+	std::unique_ptr<raytracing::AccelerationStructure> accelerationStructure;
+	raytracing::Timer::getInstance().start();
+	try
 	{
-		aiMesh* mesh = scene->mMeshes[currentMesh];
-		if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)
+		if (useInstancing)
 		{
-			// Ignore points, lines and faces with more than 3 edges
-			continue;
+			// Bottom levels are small, so they are neither cached nor built in parallel
+			raytracing::BottomLevelBuilder buildBottomLevel = [&acceleration, duplicationBudget](const std::vector<raytracing::KdTriangle>& triangles) -> raytracing::AccelerationStructure*
+			{
+				if (acceleration == "wbvh")
+				{
+					return raytracing::WideBoundingVolumeHierarchy::build(triangles);
+				}
+				else if (acceleration == "cbvh")
+				{
+					return raytracing::CompressedBoundingVolumeHierarchy::build(triangles);
+				}
+				else if ((acceleration == "bvh") || (acceleration == "bv"))
+				{
+					// A bounding volume over a single mesh is a plain BVH
+					return raytracing::BoundingVolumeHierarchy::build(triangles);
+				}
+				else if (acceleration == "sbvh")
+				{
+					return raytracing::BoundingVolumeHierarchy::buildSpatial(triangles, duplicationBudget);
+				}
+				return raytracing::KdTree::build(triangles);
+			};
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building %s for every mesh and a BVH over their instances..", acceleration.c_str());
+			std::unique_ptr<raytracing::TwoLevelAccelerationStructure> twoLevel(raytracing::TwoLevelAccelerationStructure::build(scene, database, buildBottomLevel));
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds", raytracing::Timer::getInstance().stop());
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Two level structure holds %zu instances of %zu meshes using %.2f MiB",
+				twoLevel->getInstanceCount(),
+				twoLevel->getBottomLevelCount(),
+				twoLevel->getMemoryFootprint() / (1024. * 1024.));
+			accelerationStructure = std::move(twoLevel);
 		}
-		for (unsigned int currentFace = 0; currentFace < mesh->mNumFaces; currentFace++)
+		else if (acceleration == "bv")
 		{
-			aiFace* face = (mesh->mFaces) + currentFace;
-			triangleMeshCollection.push_back({ std::make_pair(face, mesh), raytracing::ChildSide::UNDEFINED });
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building a BVH for every mesh and a BVH over the meshes..");
+			std::unique_ptr<raytracing::BoundingVolume> boundingVolume(raytracing::BoundingVolume::build(database));
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds", raytracing::Timer::getInstance().stop());
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Bounding volume holds %zu meshes using %.2f MiB",
+				boundingVolume->getMeshCount(),
+				boundingVolume->getMemoryFootprint() / (1024. * 1024.));
+			accelerationStructure = std::move(boundingVolume);
+		}
+		else if (acceleration == "wbvh")
+		{
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building %u-wide BVH..", raytracing::WideBvhNode::WIDTH);
+			std::unique_ptr<raytracing::WideBoundingVolumeHierarchy> wideBvh(raytracing::WideBoundingVolumeHierarchy::build(triangleMeshCollection));
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds", raytracing::Timer::getInstance().stop());
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Wide BVH holds %zu nodes using %.2f MiB",
+				wideBvh->getNodeCount(),
+				wideBvh->getMemoryFootprint() / (1024. * 1024.));
+			accelerationStructure = std::move(wideBvh);
+		}
+		else if (acceleration == "cbvh")
+		{
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building compressed %u-wide BVH..", raytracing::CompressedBvhNode::WIDTH);
+			std::unique_ptr<raytracing::CompressedBoundingVolumeHierarchy> compressedBvh(raytracing::CompressedBoundingVolumeHierarchy::build(triangleMeshCollection));
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds", raytracing::Timer::getInstance().stop());
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Compressed BVH holds %zu nodes using %.2f MiB",
+				compressedBvh->getNodeCount(),
+				compressedBvh->getMemoryFootprint() / (1024. * 1024.));
+			accelerationStructure = std::move(compressedBvh);
+		}
+		else if ((acceleration == "bvh") || (acceleration == "sbvh"))
+		{
+			std::unique_ptr<raytracing::BoundingVolumeHierarchy> bvh;
+			if (acceleration == "sbvh")
+			{
+				SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building spatial split BVH with a duplication budget of %.2f..", duplicationBudget);
+				bvh.reset(raytracing::BoundingVolumeHierarchy::buildSpatial(triangleMeshCollection, duplicationBudget));
+			}
+			else
+			{
+				SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building BVH..");
+				bvh.reset(raytracing::BoundingVolumeHierarchy::build(triangleMeshCollection));
+			}
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds", raytracing::Timer::getInstance().stop());
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "BVH holds %zu nodes and %zu triangle references using %.2f MiB",
+				bvh->getNodeCount(),
+				bvh->getTriangleReferenceCount(),
+				bvh->getMemoryFootprint() / (1024. * 1024.));
+			accelerationStructure = std::move(bvh);
+		}
+		else
+		{
+			// Reuse the tree of an earlier run if geometry and build parameters did not change
+			const filesystem::path cachePath = outputDir / (scenePath.stem().string() + ".kdtree");
+			const uint64_t cacheKey = raytracing::KdTree::computeCacheKey(triangleMeshCollection);
+			std::unique_ptr<raytracing::KdTree> kdTree;
+			if (useCache)
+			{
+				kdTree.reset(raytracing::KdTree::loadCache(cachePath.string(), cacheKey, triangleMeshCollection));
+			}
+			if (kdTree)
+			{
+				SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Loaded KD-Tree from cache %s. Took %.3f seconds", cachePath.string().c_str(), raytracing::Timer::getInstance().stop());
+			}
+			else if (useLazyBuild)
+			{
+				SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building top levels of KD-Tree using %u threads..", threadCount);
+				kdTree.reset(raytracing::KdTree::buildLazy(triangleMeshCollection, threadCount));
+				SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds, %zu subtrees are built on demand",
+					raytracing::Timer::getInstance().stop(),
+					kdTree->getDeferredSubtreeCount());
+			}
+			else
+			{
+				SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building KD-Tree using %u threads..", threadCount);
+				kdTree.reset(raytracing::KdTree::build(triangleMeshCollection, threadCount));
+				SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds", raytracing::Timer::getInstance().stop());
+				if (useCache)
+				{
+					try
+					{
+						kdTree->saveCache(cachePath.string(), cacheKey);
+					}
+					catch (raytracing::AccStructure& exception)
+					{
+						SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%s: %s. Proceeding..", exception.what(), cachePath.string().c_str());
+					}
+				}
+			}
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Kd-tree holds %zu nodes and %zu triangle references using %.2f MiB",
+				kdTree->getNodeCount(),
+				kdTree->getTriangleReferenceCount(),
+				kdTree->getMemoryFootprint() / (1024. * 1024.));
+
+			const raytracing::KdTreeReport report = kdTree->createReport();
+			report.log();
+			if (!statsPath.empty())
+			{
+				try
+				{
+					report.writeJson(statsPath);
+				}
+				catch (raytracing::AccStructure& exception)
+				{
+					SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%s: %s. Proceeding..", exception.what(), statsPath.c_str());
+				}
+			}
+			accelerationStructure = std::move(kdTree);
 		}
-	}
-	SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Building KD-Tree..");
-	raytracing::Timer::getInstance().start();
-	std::unique_ptr<raytracing::KdNode> kdTree;
-	try
-	{
-		kdTree.reset(raytracing::KdNode::buildTreeSAH(triangleMeshCollection));
 	}
 	catch(raytracing::AccStructure& exception)
 	{
-		SDL_LogError(SDL_LOG_CATEGORY_INPUT, "Building kd-tree failed: %s", exception.what());
+		SDL_LogError(SDL_LOG_CATEGORY_INPUT, "Building acceleration structure failed: %s", exception.what());
 		app.cleanUp();
 		return 1;
 	}
-	double kdBuildingTime = raytracing::Timer::getInstance().stop();
-	SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Done. Took %.2f seconds", kdBuildingTime);
-	triangleMeshCollection.~vector();
+	triangleMeshCollection.clear();
+	triangleMeshCollection.shrink_to_fit();
 
-	raytracing::PathTracer rayTracer(app, scene, renderSettings, std::move(kdTree));
+	raytracing::PathTracer rayTracer(app, scene, database, renderSettings, std::move(accelerationStructure));
 
 	try
 	{
 		filesystem::path sceneDir = scenePath.remove_filename();
-		rayTracer.initialize(sceneDir.string());
+		rayTracer.initialize(sceneDir.string(), threadCount);
 	}
 	catch (std::exception& exception)
 	{
@@ -336,9 +591,11 @@ int main(int argc, char* argv[])
 	raytracing::Timer::getInstance().start();
 	for (uint8_t i = 0; i < threadCount; i++)
 	{
-		threadPool.push_back(rayTracer.createRenderThread(threadsTerminated));
+		threadPool.push_back(rayTracer.createRenderThread(i, threadsTerminated));
 	}
 	app.handleEvents(rayTracer.getViewport(), threadPool, threadsTerminated, outputDir);
+	rayTracer.getAccelerationStructure().logStatistics();
+	rayTracer.getTileScheduler().logStatistics();
 	
 	assetImporter.FreeScene();
 
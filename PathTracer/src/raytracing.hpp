@@ -7,6 +7,8 @@
 /*--------------------------------< Includes >-------------------------------------------*/
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <type_traits>
 
 #include "assimp/types.h"
 #include "assimp/mesh.h"
@@ -93,31 +95,52 @@ namespace raytracing
 		uint8_t color[3];
 	};
 
+	class SceneDatabase;
+
+	// Closest hit found by the traversal. It only identifies the hit, so a closer hit costs a few
+	// stores. Surface attributes are fetched into a SurfaceInteraction once the closest hit is known.
 	struct IntersectionInformation
 	{
-		IntersectionInformation() :
-			hitMesh(nullptr),
-			hitPoint(),
-			hitTriangle(),
-			vertexNormals(),
-			textureCoordinates(),
-			intersectionDistance((std::numeric_limits<float>::max)()), // Paranthesize to prevent call of macro "max"
-			uv(),
-			uvTextureCoords(),
-			index(0),
-			ray()
-		{}
-		
-		const aiMesh* hitMesh;
-		aiVector3D hitPoint;
-		std::vector<aiVector3D*> hitTriangle;
-		std::vector<aiVector3D*> vertexNormals;
-		std::vector<aiVector3D*> textureCoordinates;
-		float intersectionDistance;
+		// Instance of hits on meshes which are not instanced
+		static constexpr uint32_t NO_INSTANCE = UINT32_MAX;
+
+		// Distance from the ray origin to the hit point in world space
+		float intersectionDistance{ (std::numeric_limits<float>::max)() }; // Paranthesize to prevent call of macro "max"
+
+		// Barycentric coordinates of the hit point, the weights of the second and third vertex
 		aiVector2D uv;
-		aiVector3D uvTextureCoords;
-		uint32_t index;
+
+		// Index of the hit triangle in the scene database
+		uint32_t triangle{ 0 };
+
+		// Instance of a two level acceleration structure the mesh was hit in
+		uint32_t instance{ NO_INSTANCE };
+	};
+
+	static_assert(std::is_trivially_copyable<IntersectionInformation>::value && (sizeof(IntersectionInformation) <= 64),
+		"Hit records are expected to be plain data fitting into a cache line");
+
+	// Surface attributes at the closest hit of a ray, interpolated once from its vertices by
+	// SceneDatabase::getSurface
+	struct SurfaceInteraction
+	{
+		// Ray the surface was hit by
 		aiRay ray;
+
+		aiVector2D uv;
+
+		aiVector3D hitPoint;
+
+		// Vertices of the hit triangle in object space
+		aiVector3D vertices[3];
+
+		// Interpolated vertex normal in world space
+		aiVector3D smoothNormal;
+
+		aiVector3D uvTextureCoords;
+
+		// Index of the material in the imported scene
+		uint32_t material;
 	};
 
 	typedef enum Axis : int8_t
@@ -143,14 +166,15 @@ namespace raytracing
 		START = 2
 	}EventType;
 
+	// Reference to a triangle of the scene database
 	typedef struct KdTriangle
 	{
-		KdTriangle(std::pair<aiFace*, aiMesh*> pair, ChildSide childSide):
-			faceMeshPair(pair), side(childSide)
-		{}
+		// Defined in SceneDatabase.hpp
+		inline aiVector3D getVertex(const uint32_t corner) const;
+
+		const SceneDatabase* database;
 
-		std::pair<aiFace*, aiMesh*> faceMeshPair;
-		ChildSide side;
+		uint32_t triangle;
 	}KdTriangle;
 
 	/*--------------------------------< Constants >-----------------------------------------*/
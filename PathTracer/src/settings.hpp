@@ -14,9 +14,32 @@ namespace raytracing
 
 #define USE_ACCELERATION_STRUCTURE 1
 #define PATH_TRACE 1
+#define COLLECT_TRAVERSAL_STATISTICS 1
+// Children per node of the wide BVH. 4 uses SSE, 8 uses AVX if the compiler targets it
+#define WIDE_BVH_WIDTH 4
+// Triangles per leaf packet. 4 uses SSE, 8 uses AVX, 16 uses AVX-512 if the compiler targets it
+#define TRIANGLE_PACKET_WIDTH 4
+// Trace primary rays in packets of TRIANGLE_PACKET_WIDTH rays through neighbouring pixels
+#define PRIMARY_RAY_PACKETS 1
 
 	/*--------------------------------< Typedefs >------------------------------------------*/
 
+	// Order in which the tiles of a frame are handed to the render threads
+	enum class TileOrder : uint8_t
+	{
+		// Rows from top to bottom
+		SCANLINE,
+
+		// Z-order curve over the tile grid
+		MORTON,
+
+		// Hilbert curve over the tile grid, consecutive tiles always share an edge
+		HILBERT,
+
+		// Square rings around the center tile, working outwards
+		SPIRAL
+	};
+
 	/*--------------------------------< Constants >-----------------------------------------*/
 
 	class Settings
@@ -24,8 +47,8 @@ namespace raytracing
 	/*--------------------------------< Public methods >------------------------------------*/
 	public:
 
-		Settings(uint16_t x, uint16_t y, uint8_t samples = 8, uint8_t maxDepth = 3, float offset = 0.001f, const float aperture = 0.f, const float fDist = 0.f, const bool dof = false, const bool aa = false) :
-			width(x), height(y), maxSamples(samples), maxRayDepth(maxDepth), bias(offset), apertureRadius(aperture), focalDistance(fDist), useDOF(dof), useAA(aa)
+		Settings(uint16_t x, uint16_t y, uint8_t samples = 8, uint8_t maxDepth = 3, float offset = 0.001f, const float aperture = 0.f, const float fDist = 0.f, const bool dof = false, const bool aa = false, const bool sorting = false, const TileOrder order = TileOrder::SCANLINE) :
+			width(x), height(y), maxSamples(samples), maxRayDepth(maxDepth), bias(offset), apertureRadius(aperture), focalDistance(fDist), useDOF(dof), useAA(aa), useRaySorting(sorting), tileOrder(order)
 		{};
 
 		inline uint8_t getMaxSamples() const
@@ -63,6 +86,16 @@ namespace raytracing
 			return this->useAA;
 		}
 
+		inline bool getUseRaySorting() const
+		{
+			return this->useRaySorting;
+		}
+
+		inline TileOrder getTileOrder() const
+		{
+			return this->tileOrder;
+		}
+
 		inline uint16_t getWidth() const
 		{
 			return this->width;
@@ -104,6 +137,11 @@ namespace raytracing
 
 		const bool useAA;
 
+		// Trace the bounces of all paths of a tile together, sorted by origin and direction
+		const bool useRaySorting;
+
+		const TileOrder tileOrder;
+
 		const uint16_t width;
 
 		const uint16_t height;